@@ -0,0 +1,66 @@
+/*
+Decompression throughput of the inflate backend selected with BFS_INFLATE_BACKEND, whole and streaming, on the same corpus
+whichever backend is built, so runs of builds with different backends compare.
+Usage: backendbench [corpus file, default 32 MB of generated data]
+*/
+
+#include "testsupport.hpp"
+
+#include "inflater.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+static bool inflateStreaming( Inflater& inflater, const std::string& in, std::string& out )
+{
+  inflater.reset();
+  const unsigned char* input = reinterpret_cast< const unsigned char* >( in.data() );
+  std::size_t inSize = in.size();
+  unsigned char* output = reinterpret_cast< unsigned char* >( &out[ 0 ] );
+  std::size_t remaining = out.size();
+  while( true )
+  {
+    // Reads of 64 KB at a time, like streaming file reads
+    std::size_t outSize = std::min< std::size_t >( remaining, 64 * 1024 );
+    const std::size_t outOffered = outSize;
+    const Inflater::Result result = inflater.inflate( input, inSize, output, outSize );
+    remaining -= outOffered - outSize;
+    if( result == Inflater::RESULT_END ) return remaining == 0;
+    if( result != Inflater::RESULT_OK || ( remaining == 0 && outOffered == outSize ) ) return false;
+  }
+}
+
+int main( int argc, char** argv )
+{
+  std::string corpus;
+  if( argc > 1 )
+  {
+    std::ifstream file( argv[ 1 ], std::ios::binary );
+    corpus.assign( std::istreambuf_iterator< char >( file ), std::istreambuf_iterator< char >() );
+  }
+  else
+  {
+    std::mt19937 random( 1 );
+    corpus = makeTestData( random, 32 << 20 );
+  }
+  if( corpus.empty() )
+  {
+    std::fprintf( stderr, "no corpus\n" );
+    return 1;
+  }
+  std::printf( "%s backend, %.1f MB corpus\n%-10s %12s %12s\n", Inflater::backendName(), corpus.size() / 1e6, "level", "whole", "streaming" );
+  Inflater inflater;
+  std::string out( corpus.size(), '\0' );
+  for( int level : { 1, 6, 9 } )
+  {
+    const std::string compressed = deflateZlib( corpus, level, STRATEGY_DEFAULT );
+    bool ok = true;
+    const double whole = bestOf( 5, [ & ]() { ok &= inflateWhole( compressed.data(), compressed.size(), &out[ 0 ], out.size() ); } );
+    ok &= out == corpus;
+    const double streaming = bestOf( 5, [ & ]() { ok &= inflateStreaming( inflater, compressed, out ); } );
+    ok &= out == corpus;
+    std::printf( "%-10d %7.1f MB/s %7.1f MB/s%s\n", level, corpus.size() / whole / 1e6, corpus.size() / streaming / 1e6, ok ? "" : "  MISMATCH" );
+  }
+  return 0;
+}
@@ -0,0 +1,84 @@
+/*
+Duplicating the PHYSFS_Io of compressed files halfway through them: duplicates closed right away, which share the decompression
+state and never copy it, and duplicates that read a little before closing, which take a copy of their own.
+Usage: duplicatebench [duplicates per file, default 2000]
+*/
+
+#include "testsupport.hpp"
+
+#include "bfsarchive.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+
+static const char* const ARCHIVE = "duplicatebench.bfs";
+static const std::size_t FILE_COUNT = 20;
+static const std::size_t FILE_SIZE = 1 << 20;
+
+int main( int argc, char** argv )
+{
+  const unsigned int duplicates = argc > 1 ? std::atoi( argv[ 1 ] ) : 2000;
+  BFSWriter writer;
+  std::vector< std::string > paths;
+  std::mt19937 random( 21 );
+  for( std::size_t i = 0; i < FILE_COUNT; ++i )
+  {
+    paths.push_back( "data/file" + std::to_string( i ) + ".bin" );
+    writer.add( paths.back(), makeTestData( random, FILE_SIZE ), 6 );
+  }
+  if( !writer.write( ARCHIVE ) )
+  {
+    std::fprintf( stderr, "could not write %s\n", ARCHIVE );
+    return 1;
+  }
+  std::ifstream stream( ARCHIVE, std::ios::binary );
+  const std::shared_ptr< const std::string > data = std::make_shared< const std::string >( std::istreambuf_iterator< char >( stream ), std::istreambuf_iterator< char >() );
+  PHYSFS_init( argv[ 0 ] );
+
+  bool ok = true;
+  std::vector< char > buffer( FILE_SIZE );
+  std::printf( "%u duplicates of each of %zu files, halfway through\n%-28s %12s\n", duplicates, FILE_COUNT, "", "per duplicate" );
+  try
+  {
+    BFSArchive archive( *createMemoryIo( data ), ARCHIVE, BFSArchive::Options() );
+    for( const PHYSFS_uint64 readSize : { 0, 256 } )
+    {
+      const double seconds = bestOf( 3, [ & ]()
+      {
+        for( const std::string& path : paths )
+        {
+          BFSFile* file = archive.openRead( path.c_str() );
+          if( !file )
+          {
+            ok = false;
+            continue;
+          }
+          PHYSFS_Io* io = file->getPhysFSInterface();
+          ok &= io->read( io, buffer.data(), FILE_SIZE / 2 ) == PHYSFS_sint64( FILE_SIZE / 2 );
+          for( unsigned int i = 0; i < duplicates; ++i )
+          {
+            PHYSFS_Io* duplicate = io->duplicate( io );
+            ok &= duplicate && duplicate->read( duplicate, buffer.data(), readSize ) == PHYSFS_sint64( readSize );
+            if( duplicate ) duplicate->destroy( duplicate );
+          }
+          // The original carries on with the state it shared
+          ok &= io->read( io, buffer.data(), 256 ) == 256;
+          io->destroy( io );
+        }
+      } );
+      std::printf( "%-28s %9.2f us\n", readSize ? "duplicate, read 256, close" : "duplicate, close", seconds / ( duplicates * FILE_COUNT ) * 1e6 );
+    }
+  }
+  catch( PHYSFS_ErrorCode code )
+  {
+    std::fprintf( stderr, "error %d\n", int( code ) );
+    ok = false;
+  }
+  if( !ok ) std::printf( "FAILED\n" );
+
+  PHYSFS_deinit();
+  std::remove( ARCHIVE );
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,90 @@
+/*
+Decoding the Huffman coded paths of a string pool with the lookup tables of HuffmannTable, against walking the tree
+a bit at a time with Huffmann::decode() as the string pool did before.
+Usage: huffmanbench [files, default 50000]
+*/
+
+#include "testsupport.hpp"
+
+#include "bfsformat.hpp"
+#include "bitstream.hpp"
+#include "huffmann.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <set>
+
+static const char* const ARCHIVE = "huffmanbench.bfs";
+
+int main( int argc, char** argv )
+{
+  const std::size_t fileCount = argc > 1 ? std::atoi( argv[ 1 ] ) : 50000;
+  BFSWriter writer;
+  std::mt19937 random( 4 );
+  for( std::size_t i = 0; i < fileCount; ++i )
+  {
+    const std::string path = "data/" + std::string( i % 3 ? "cars" : "tracks" ) + "/group_" + std::to_string( random() % 40 )
+      + "/Item_" + std::to_string( random() % 200 ) + "/file_" + std::to_string( i ) + ( i % 2 ? ".dds" : ".bgm" );
+    writer.add( path, std::string(), 0 );
+  }
+  const bool written = writer.write( ARCHIVE );
+  std::ifstream stream( ARCHIVE, std::ios::binary );
+  const std::string archive( ( std::istreambuf_iterator< char >( stream ) ), std::istreambuf_iterator< char >() );
+  stream.close();
+  std::remove( ARCHIVE );
+  if( !written || archive.size() < BFSHeader::HEADER_SIZE + sizeof( BFSStringPoolHeader ) )
+  {
+    std::fprintf( stderr, "could not write %s\n", ARCHIVE );
+    return 1;
+  }
+
+  // The parts of the string pool, each ending where the next one starts
+  const char* const pool = archive.data() + BFSHeader::HEADER_SIZE;
+  BFSStringPoolHeader header;
+  std::memcpy( &header, pool, sizeof( header ) );
+  const std::set< std::uint32_t > partOffsets{ header.huffmannTreeOffset, header.offsetsOffset, header.compressedStringsOffset, header.uncompressedSizesOffset, header.end };
+  auto partSize = [ &partOffsets ]( std::uint32_t offset ) { return *partOffsets.upper_bound( offset ) - offset; };
+  const Huffmann tree( pool + header.huffmannTreeOffset, pool + header.huffmannTreeOffset + partSize( header.huffmannTreeOffset ) );
+  const HuffmannTable table( tree );
+  std::vector< std::uint32_t > offsets( partSize( header.offsetsOffset ) / 4 );
+  std::memcpy( offsets.data(), pool + header.offsetsOffset, offsets.size() * 4 );
+  std::vector< std::uint16_t > sizes( partSize( header.uncompressedSizesOffset ) / 2 );
+  std::memcpy( sizes.data(), pool + header.uncompressedSizesOffset, sizes.size() * 2 );
+  const char* const strings = pool + header.compressedStringsOffset;
+  const char* const stringsEnd = strings + partSize( header.compressedStringsOffset );
+  const std::size_t stringCount = std::min( offsets.size(), sizes.size() );
+  std::size_t characters = 0;
+  for( std::size_t i = 0; i < stringCount; ++i ) characters += sizes[ i ];
+
+  std::string treeOut( characters, '\0' );
+  std::string tableOut( characters, '\0' );
+  bool ok = true;
+  const double treeSeconds = bestOf( 5, [ & ]()
+  {
+    char* out = &treeOut[ 0 ];
+    for( std::size_t i = 0; i < stringCount; ++i )
+    {
+      BitStream bits( strings + offsets[ i ], stringsEnd );
+      for( unsigned int j = 0; j < sizes[ i ]; ++j ) ok &= tree.decode( bits, *out++ );
+    }
+  } );
+  const double tableSeconds = bestOf( 5, [ & ]()
+  {
+    char* out = &tableOut[ 0 ];
+    for( std::size_t i = 0; i < stringCount; ++i )
+    {
+      BitStream bits( strings + offsets[ i ], stringsEnd );
+      ok &= table.decode( bits, sizes[ i ], out );
+      out += sizes[ i ];
+    }
+  } );
+  ok &= treeOut == tableOut;
+
+  std::printf( "%zu strings, %.1f MB decoded%s\n", stringCount, characters / 1e6, ok ? "" : ", MISMATCH" );
+  std::printf( "%-20s %8.2f ms %8.1f MB/s\n", "tree, bit by bit", treeSeconds * 1e3, characters / treeSeconds / 1e6 );
+  std::printf( "%-20s %8.2f ms %8.1f MB/s  %.1fx\n", "lookup tables", tableSeconds * 1e3, characters / tableSeconds / 1e6, treeSeconds / tableSeconds );
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,74 @@
+/*
+Mounting an archive and opening a file of it: parsing the string pool and indexing every path, against mapping the index
+from the cache file an earlier mount wrote, and against looking files up through the hash table.
+Usage: mountbench [files, default 50000]
+*/
+
+#include "testsupport.hpp"
+
+#include <physfs.h>
+#include "bfsarchiver.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+static const char* const ARCHIVE = "mountbench.bfs";
+static const char* const INDEX_CACHE = "mountbench.bfs.idx";
+
+/// @return Seconds to mount, open a file and unmount, best of several runs
+static double mount( const std::string& path, bool& ok )
+{
+  return bestOf( 10, [ & ]()
+  {
+    ok &= PHYSFS_mount( ARCHIVE, "/", 1 ) != 0;
+    PHYSFS_File* file = PHYSFS_openRead( path.c_str() );
+    ok &= file != nullptr;
+    if( file ) PHYSFS_close( file );
+    PHYSFS_unmount( ARCHIVE );
+  } );
+}
+
+int main( int argc, char** argv )
+{
+  const std::size_t fileCount = argc > 1 ? std::atoi( argv[ 1 ] ) : 50000;
+  BFSWriter writer;
+  std::mt19937 random( 3 );
+  std::string path;
+  for( std::size_t i = 0; i < fileCount; ++i )
+  {
+    path = "data/" + std::string( i % 3 ? "cars" : "tracks" ) + "/group_" + std::to_string( random() % 40 ) + "/file_" + std::to_string( i ) + ".dds";
+    writer.add( path, makeTestData( random, random() % 64 ), 0 );
+  }
+  std::remove( INDEX_CACHE );
+  if( !writer.write( ARCHIVE ) )
+  {
+    std::fprintf( stderr, "could not write %s\n", ARCHIVE );
+    return 1;
+  }
+
+  PHYSFS_init( argv[ 0 ] );
+  registerBfsArchiver();
+  bool ok = true;
+  const double parse = mount( path, ok );
+
+  setBfsMountMode( BFS_MOUNT_HASH_TABLE );
+  const double hashTable = mount( path, ok );
+  setBfsMountMode( BFS_MOUNT_INDEX );
+
+  setBfsIndexCache( 1, nullptr );
+  // The first mount writes the cache file
+  ok &= PHYSFS_mount( ARCHIVE, "/", 1 ) != 0;
+  PHYSFS_unmount( ARCHIVE );
+  const double cached = mount( path, ok );
+  setBfsIndexCache( 0, nullptr );
+
+  std::printf( "%zu files%s\n", fileCount, ok ? "" : ", FAILED" );
+  std::printf( "%-24s %9.2f ms\n", "parse and index", parse * 1e3 );
+  std::printf( "%-24s %9.2f ms  %.1fx\n", "hash table", hashTable * 1e3, parse / hashTable );
+  std::printf( "%-24s %9.2f ms  %.1fx\n", "cached index", cached * 1e3, parse / cached );
+
+  PHYSFS_deinit();
+  std::remove( ARCHIVE );
+  std::remove( INDEX_CACHE );
+  return ok ? 0 : 1;
+}
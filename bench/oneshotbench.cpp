@@ -0,0 +1,81 @@
+/*
+Opening many small compressed files and reading each whole: in one read, which decompresses the file in one shot, against
+the same bytes in two reads, which stream them through the decompression state of an open file.
+Usage: oneshotbench [files per size, default 2000]
+*/
+
+#include "testsupport.hpp"
+
+#include <physfs.h>
+#include "bfsarchiver.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+static const char* const ARCHIVE = "oneshotbench.bfs";
+
+/// @return Seconds to open, read and close every file, best of several runs
+static double readAll( const std::vector< std::pair< std::string, std::string > >& files, bool whole, bool& ok )
+{
+  std::string buffer;
+  return bestOf( 5, [ & ]()
+  {
+    for( const auto& file : files )
+    {
+      PHYSFS_File* handle = PHYSFS_openRead( file.first.c_str() );
+      if( !handle )
+      {
+        ok = false;
+        continue;
+      }
+      buffer.resize( file.second.size() );
+      const PHYSFS_sint64 size = PHYSFS_sint64( buffer.size() );
+      const PHYSFS_sint64 first = whole ? size : 1;
+      ok &= PHYSFS_readBytes( handle, &buffer[ 0 ], first ) == first
+        && ( whole || PHYSFS_readBytes( handle, &buffer[ 1 ], size - 1 ) == size - 1 ) && buffer == file.second;
+      PHYSFS_close( handle );
+    }
+  } );
+}
+
+int main( int argc, char** argv )
+{
+  const std::size_t filesPerSize = argc > 1 ? std::atoi( argv[ 1 ] ) : 2000;
+  const std::size_t sizes[] = { 2 * 1024, 16 * 1024, 64 * 1024 };
+  std::mt19937 random( 11 );
+  BFSWriter writer;
+  std::vector< std::vector< std::pair< std::string, std::string > > > files;
+  for( std::size_t size : sizes )
+  {
+    files.emplace_back();
+    for( std::size_t i = 0; i < filesPerSize; ++i )
+    {
+      // Names differ between directories too: mounting takes at most as many files as there are strings in the pool
+      const std::string path = "shaders/" + std::to_string( size ) + "/shader_" + std::to_string( size ) + "_" + std::to_string( i ) + ".fx";
+      files.back().push_back( { path, makeTestData( random, size ) } );
+      writer.add( path, files.back().back().second, 9 );
+    }
+  }
+  if( !writer.write( ARCHIVE ) )
+  {
+    std::fprintf( stderr, "could not write %s\n", ARCHIVE );
+    return 1;
+  }
+
+  PHYSFS_init( argv[ 0 ] );
+  registerBfsArchiver();
+  bool ok = PHYSFS_mount( ARCHIVE, "/", 1 ) != 0;
+  std::printf( "%zu files of each size, opened and read whole\n%-10s %14s %14s\n", filesPerSize, "size", "two reads", "one read" );
+  for( std::size_t i = 0; i < files.size(); ++i )
+  {
+    const double streaming = readAll( files[ i ], false, ok );
+    const double oneShot = readAll( files[ i ], true, ok );
+    std::printf( "%7zu KB %11.2f us %11.2f us  %.2fx\n", sizes[ i ] / 1024, streaming / filesPerSize * 1e6, oneShot / filesPerSize * 1e6, streaming / oneShot );
+  }
+  if( !ok ) std::printf( "FAILED\n" );
+  PHYSFS_unmount( ARCHIVE );
+
+  PHYSFS_deinit();
+  std::remove( ARCHIVE );
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,82 @@
+/*
+Reading large compressed files whole, decompressed on the reading thread alone and split at their access points across threads.
+Usage: parallelbench [threads per file, default one per core] [MB per file, default 32]
+*/
+
+#include "testsupport.hpp"
+
+#include <physfs.h>
+#include "bfsarchiver.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+static const char* const ARCHIVE = "parallelbench.bfs";
+static const char* const SIDECAR = "parallelbench.bfs.acc";
+static const std::size_t FILE_COUNT = 4;
+
+/// @return Seconds to read every file whole, best of several runs
+static double readAll( const std::map< std::string, std::string >& files, bool& ok )
+{
+  std::string contents;
+  return bestOf( 5, [ & ]()
+  {
+    for( const auto& file : files )
+    {
+      PHYSFS_File* handle = PHYSFS_openRead( file.first.c_str() );
+      contents.resize( file.second.size() );
+      ok &= handle && PHYSFS_readBytes( handle, &contents[ 0 ], contents.size() ) == PHYSFS_sint64( contents.size() ) && contents == file.second;
+      if( handle ) PHYSFS_close( handle );
+    }
+  } );
+}
+
+int main( int argc, char** argv )
+{
+  const unsigned int threads = argc > 1 ? std::atoi( argv[ 1 ] ) : 0;
+  const std::size_t fileSize = std::size_t( argc > 2 ? std::atoi( argv[ 2 ] ) : 32 ) << 20;
+  std::map< std::string, std::string > files;
+  BFSWriter writer;
+  std::mt19937 random( 23 );
+  for( std::size_t i = 0; i < FILE_COUNT; ++i )
+  {
+    const std::string path = "data/file" + std::to_string( i ) + ".bin";
+    files[ path ] = makeTestData( random, fileSize );
+    writer.add( path, files[ path ], 6 );
+  }
+  std::remove( SIDECAR );
+  if( !writer.write( ARCHIVE ) )
+  {
+    std::fprintf( stderr, "could not write %s\n", ARCHIVE );
+    return 1;
+  }
+  const double totalSize = double( fileSize ) * FILE_COUNT;
+
+  PHYSFS_init( argv[ 0 ] );
+  registerBfsArchiver();
+  bool ok = true;
+
+  PHYSFS_mount( ARCHIVE, "/", 1 );
+  const double serial = readAll( files, ok );
+  PHYSFS_unmount( ARCHIVE );
+
+  setBfsParallelInflate( 1, threads );
+  PHYSFS_mount( ARCHIVE, "/", 1 );
+  ok &= buildBfsAccessIndex( ARCHIVE, 1 << 20, 1 << 20 ) != 0;
+  const double parallel = readAll( files, ok );
+  BFSArchiveStats stats;
+  ok &= getBfsArchiveStats( ARCHIVE, &stats ) && stats.parallelInflates > 0;
+  PHYSFS_unmount( ARCHIVE );
+
+  std::printf( "%zu files of %.1f MB, %llu access points\n", FILE_COUNT, fileSize / 1e6, stats.accessIndexPoints );
+  std::printf( "%-24s %8.1f MB/s\n", "reading thread only", totalSize / serial / 1e6 );
+  char label[ 32 ];
+  if( threads == 0 ) std::snprintf( label, sizeof( label ), "one thread per core" );
+  else std::snprintf( label, sizeof( label ), "%u thread%s", threads, threads == 1 ? "" : "s" );
+  std::printf( "%-24s %8.1f MB/s  %.2fx%s\n", label, totalSize / parallel / 1e6, serial / parallel, ok ? "" : "  FAILED" );
+
+  PHYSFS_deinit();
+  std::remove( ARCHIVE );
+  std::remove( SIDECAR );
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+/*
+Path lookups in the flat PathIndex against the tree of std::maps archives were indexed with before, copied here as it was.
+Usage: pathbench [files, default 50000]
+*/
+
+#include "testsupport.hpp"
+
+#include "pathindex.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+/// The directory tree BFSArchive used to keep, one std::map of subdirectories and one of files per directory
+struct Directory
+{
+  std::map< std::string, std::unique_ptr< Directory > > dirs;
+  std::map< std::string, BFSFile::Info > files;
+
+  void insert( std::string&& filename, BFSFile::Info&& file )
+  {
+    auto slashPos = filename.find( '/' );
+    if( slashPos == std::string::npos )
+    {
+      files.emplace( std::make_pair( filename, file ) );
+    }
+    else
+    {
+      std::string dirname = filename.substr( 0, slashPos );
+      std::string tail = filename.substr( slashPos + 1 );
+      auto entry = dirs.find( dirname );
+      if( entry == dirs.end() )
+      {
+        entry = dirs.emplace( std::make_pair( std::move( dirname ), std::unique_ptr< Directory >( new Directory() ) ) ).first;
+      }
+      entry->second->insert( std::move( tail ), std::move( file ) );
+    }
+  }
+};
+
+static std::pair< Directory*, BFSFile::Info* > lookup( Directory& root, std::string filename )
+{
+  Directory* targetDir = &root;
+  if( !filename.empty() && filename != "/" ) // root dir
+  {
+    std::string::size_type slashPos;
+    while( ( slashPos = filename.find( '/' ) ) != std::string::npos )
+    {
+      const std::string dir = filename.substr( 0, slashPos );
+      filename.erase( 0, slashPos + 1 );
+      auto entry = targetDir->dirs.find( dir );
+      // missing directory
+      if( entry == targetDir->dirs.end() ) return std::make_pair( nullptr, nullptr );
+      targetDir = entry->second.get();
+    }
+  }
+  if( filename.empty() ) // trailing slash
+  {
+    return std::make_pair( targetDir, nullptr );
+  }
+  std::pair< Directory*, BFSFile::Info* > result{ nullptr, nullptr };
+  // Look for Directory
+  {
+    auto entry = targetDir->dirs.find( filename );
+    if( entry != targetDir->dirs.end( ) )
+    {
+      result.first = entry->second.get( );
+    }
+  }
+  // Look for File
+  {
+    auto entry = targetDir->files.find( filename );
+    if( entry != targetDir->files.end( ) )
+    {
+      result.second = &entry->second;
+    }
+  }
+  return result;
+}
+
+int main( int argc, char** argv )
+{
+  const std::size_t fileCount = argc > 1 ? std::atoi( argv[ 1 ] ) : 50000;
+  // Paths like those of game archives: a few levels of directories, many files each
+  std::mt19937 random( 1 );
+  PathIndex::FileList files;
+  for( std::size_t i = 0; i < fileCount; ++i )
+  {
+    const std::string path = "data/" + std::string( i % 3 ? "cars" : "tracks" ) + "/group_" + std::to_string( random() % 40 )
+      + "/item_" + std::to_string( random() % 200 ) + "/file_" + std::to_string( i ) + ".dds";
+    files.push_back( { path, BFSFile::Info{ PHYSFS_uint32( i ), 100, 200, true } } );
+  }
+  std::vector< std::string > hits;
+  std::vector< std::string > misses;
+  for( std::size_t i = 0; i < 200000; ++i )
+  {
+    const std::string& path = files[ random() % files.size() ].first;
+    hits.push_back( path );
+    misses.push_back( path.substr( 0, path.size() - 4 ) + ".tga" );
+  }
+
+  Directory tree;
+  PathIndex index;
+  // Every hit is found and no miss, by both, in each of 3 runs
+  std::size_t found = 0;
+  const double treeBuild = bestOf( 3, [ & ]()
+  {
+    tree = Directory();
+    for( const auto& file : files ) tree.insert( std::string( file.first ), BFSFile::Info( file.second ) );
+  } );
+  const double indexBuild = bestOf( 3, [ & ]() { index.build( files ); } );
+  const double treeHits = bestOf( 3, [ & ]() { for( const std::string& path : hits ) found += lookup( tree, path ).second != nullptr; } );
+  const double indexHits = bestOf( 3, [ & ]() { for( const std::string& path : hits ) found += index.find( path.c_str() ) != nullptr; } );
+  const double treeMisses = bestOf( 3, [ & ]() { for( const std::string& path : misses ) found += lookup( tree, path ).second != nullptr; } );
+  const double indexMisses = bestOf( 3, [ & ]() { for( const std::string& path : misses ) found += index.find( path.c_str() ) != nullptr; } );
+
+  std::printf( "%zu files, %zu lookups%s\n%-16s %14s %14s\n", files.size(), hits.size(), found == 2 * 3 * hits.size() ? "" : ", MISMATCH",
+    "", "std::map tree", "PathIndex" );
+  std::printf( "%-16s %11.2f ms %11.2f ms\n", "build", treeBuild * 1e3, indexBuild * 1e3 );
+  std::printf( "%-16s %11.1f ns %11.1f ns\n", "lookup", treeHits / hits.size() * 1e9, indexHits / hits.size() * 1e9 );
+  std::printf( "%-16s %11.1f ns %11.1f ns\n", "lookup, missing", treeMisses / misses.size() * 1e9, indexMisses / misses.size() * 1e9 );
+  return 0;
+}
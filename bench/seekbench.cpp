@@ -0,0 +1,82 @@
+/*
+Random seeks within a large compressed file, each followed by a small read: decompressing from the start of the file for every
+backward seek, against resuming from seek checkpoints at several intervals.
+Usage: seekbench [MB of file, default 16] [seeks, default 300]
+*/
+
+#include "testsupport.hpp"
+
+#include <physfs.h>
+#include "bfsarchiver.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+static const char* const ARCHIVE = "seekbench.bfs";
+static const char* const PATH = "data/large.bin";
+/// Bytes read after each seek
+static const std::size_t READ_SIZE = 4096;
+
+int main( int argc, char** argv )
+{
+  const std::size_t fileSize = std::size_t( argc > 1 ? std::atoi( argv[ 1 ] ) : 16 ) << 20;
+  const unsigned int seeks = argc > 2 ? std::atoi( argv[ 2 ] ) : 300;
+  std::mt19937 random( 9 );
+  const std::string contents = makeTestData( random, fileSize );
+  BFSWriter writer;
+  writer.add( PATH, contents, 6 );
+  if( !writer.write( ARCHIVE ) )
+  {
+    std::fprintf( stderr, "could not write %s\n", ARCHIVE );
+    return 1;
+  }
+
+  PHYSFS_init( argv[ 0 ] );
+  registerBfsArchiver();
+  std::printf( "%u seeks within %.1f MB, reading %zu bytes after each\n%-24s %12s\n", seeks, fileSize / 1e6, READ_SIZE, "checkpoints", "per seek" );
+  bool ok = true;
+  const std::pair< unsigned int, const char* > intervals[] = { { 0, "none" }, { 1 << 20, "every 1 MB" }, { 512 * 1024, "every 512 KB" }, { 128 * 1024, "every 128 KB" } };
+  for( const auto& interval : intervals )
+  {
+    // Enough budget for checkpoints all through the file
+    setBfsSeekCheckpoints( interval.first, interval.first ? ( fileSize / interval.first + 1 ) * 48 * 1024 : 0 );
+    if( !PHYSFS_mount( ARCHIVE, "/", 1 ) )
+    {
+      ok = false;
+      continue;
+    }
+    PHYSFS_File* file = PHYSFS_openRead( PATH );
+    if( !file )
+    {
+      ok = false;
+      PHYSFS_unmount( ARCHIVE );
+      continue;
+    }
+    // Read through once in pieces, which records the checkpoints
+    std::string buffer( 64 * 1024, '\0' );
+    for( std::size_t position = 0; position < fileSize; position += buffer.size() )
+    {
+      const std::size_t size = std::min( buffer.size(), fileSize - position );
+      ok &= PHYSFS_readBytes( file, &buffer[ 0 ], size ) == PHYSFS_sint64( size );
+    }
+
+    std::mt19937 positions( 10 );
+    const double seconds = bestOf( 1, [ & ]()
+    {
+      for( unsigned int i = 0; i < seeks; ++i )
+      {
+        const std::size_t position = positions() % ( fileSize - READ_SIZE );
+        ok &= PHYSFS_seek( file, position ) != 0 && PHYSFS_readBytes( file, &buffer[ 0 ], READ_SIZE ) == PHYSFS_sint64( READ_SIZE )
+          && contents.compare( position, READ_SIZE, buffer, 0, READ_SIZE ) == 0;
+      }
+    } );
+    std::printf( "%-24s %9.3f ms\n", interval.second, seconds / seeks * 1e3 );
+    PHYSFS_close( file );
+    PHYSFS_unmount( ARCHIVE );
+  }
+  if( !ok ) std::printf( "FAILED\n" );
+
+  PHYSFS_deinit();
+  std::remove( ARCHIVE );
+  return ok ? 0 : 1;
+}
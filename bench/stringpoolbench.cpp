@@ -0,0 +1,64 @@
+/*
+Decoding all paths of a string pool on 1, 2, 4, ... threads, as mounting does with setBfsStringPoolThreads().
+Usage: stringpoolbench [files, default 200000] [most threads, default one per core but at least 4]
+*/
+
+#include "testsupport.hpp"
+
+#include "bfsformat.hpp"
+#include "stringpool.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+static const char* const ARCHIVE = "stringpoolbench.bfs";
+
+int main( int argc, char** argv )
+{
+  const std::size_t fileCount = argc > 1 ? std::atoi( argv[ 1 ] ) : 200000;
+  const unsigned int maxThreads = argc > 2 ? std::atoi( argv[ 2 ] ) : std::max( 4u, std::thread::hardware_concurrency() );
+  BFSWriter writer;
+  std::mt19937 random( 6 );
+  for( std::size_t i = 0; i < fileCount; ++i )
+  {
+    const std::string path = "data/" + std::string( i % 3 ? "cars" : "tracks" ) + "/group_" + std::to_string( random() % 40 )
+      + "/item_" + std::to_string( random() % 200 ) + "/file_" + std::to_string( i ) + ".dds";
+    writer.add( path, std::string(), 0 );
+  }
+  const bool written = writer.write( ARCHIVE );
+  std::ifstream stream( ARCHIVE, std::ios::binary );
+  const std::string archive( ( std::istreambuf_iterator< char >( stream ) ), std::istreambuf_iterator< char >() );
+  stream.close();
+  std::remove( ARCHIVE );
+  if( !written || archive.size() <= BFSHeader::HEADER_SIZE )
+  {
+    std::fprintf( stderr, "could not write %s\n", ARCHIVE );
+    return 1;
+  }
+  const char* const poolData = archive.data() + BFSHeader::HEADER_SIZE;
+  const std::size_t poolSize = archive.size() - BFSHeader::HEADER_SIZE;
+
+  bool ok = true;
+  StringPool pool;
+  const double load = bestOf( 5, [ & ]() { ok &= pool.load( poolData, poolSize ) > 0; } );
+  std::printf( "%u strings, loading %.2f ms\n%-10s %12s %10s\n", pool.size(), load * 1e3, "threads", "decode all", "speedup" );
+  double single = 0;
+  for( unsigned int threads = 1; threads <= maxThreads; threads *= 2 )
+  {
+    double seconds = 0;
+    for( int run = 0; run < 5; ++run )
+    {
+      // Only strings not decoded yet are decoded, so start over each time
+      ok &= pool.load( poolData, poolSize ) > 0;
+      const double time = bestOf( 1, [ & ]() { ok &= pool.decodeAll( threads ) && pool.decodedCount() == pool.size(); } );
+      seconds = run == 0 ? time : std::min( seconds, time );
+    }
+    if( threads == 1 ) single = seconds;
+    std::printf( "%-10u %9.2f ms %9.2fx\n", threads, seconds * 1e3, single / seconds );
+  }
+  if( !ok ) std::printf( "FAILED\n" );
+  return ok ? 0 : 1;
+}
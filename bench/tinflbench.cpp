@@ -0,0 +1,74 @@
+/*
+Decompression throughput of the bundled tinfl, in one go and streaming through its 32 KB dictionary, next to zlib's uncompress().
+Usage: tinflbench [megabytes of data, default 16]
+*/
+
+#include "testsupport.hpp"
+
+#include <physfs.h>
+#include "physfs_miniz.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+static bool inflateWhole( const std::string& in, std::vector< mz_uint8 >& out )
+{
+  std::unique_ptr< tinfl_decompressor > decompressor( new tinfl_decompressor );
+  tinfl_init( decompressor.get() );
+  std::size_t inSize = in.size();
+  std::size_t outSize = out.size();
+  return tinfl_decompress( decompressor.get(), reinterpret_cast< const mz_uint8* >( in.data() ), &inSize, out.data(), out.data(), &outSize,
+    TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF | TINFL_FLAG_COMPUTE_ADLER32 ) == TINFL_STATUS_DONE;
+}
+
+/// Streams into the wrapping dictionary and copies out of it, like reads of 64 KB would
+static bool inflateStreaming( const std::string& in, std::vector< mz_uint8 >& out )
+{
+  std::unique_ptr< tinfl_decompressor > decompressor( new tinfl_decompressor );
+  tinfl_init( decompressor.get() );
+  std::vector< mz_uint8 > dictionary( TINFL_LZ_DICT_SIZE );
+  std::size_t dictionaryPos = 0, inPos = 0, outPos = 0;
+  while( true )
+  {
+    std::size_t inSize = std::min< std::size_t >( 64 * 1024, in.size() - inPos );
+    const bool moreInput = inPos + inSize < in.size();
+    std::size_t outSize = dictionary.size() - dictionaryPos;
+    const tinfl_status status = tinfl_decompress( decompressor.get(), reinterpret_cast< const mz_uint8* >( in.data() ) + inPos, &inSize,
+      dictionary.data(), dictionary.data() + dictionaryPos, &outSize,
+      TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_COMPUTE_ADLER32 | ( moreInput ? TINFL_FLAG_HAS_MORE_INPUT : 0 ) );
+    inPos += inSize;
+    if( outPos + outSize > out.size() ) return false;
+    std::copy( dictionary.begin() + dictionaryPos, dictionary.begin() + dictionaryPos + outSize, out.begin() + outPos );
+    outPos += outSize;
+    dictionaryPos = ( dictionaryPos + outSize ) & ( TINFL_LZ_DICT_SIZE - 1 );
+    if( status == TINFL_STATUS_DONE ) return outPos == out.size();
+    if( status < 0 || ( status == TINFL_STATUS_NEEDS_MORE_INPUT && !moreInput ) ) return false;
+  }
+}
+
+int main( int argc, char** argv )
+{
+  const std::size_t size = ( argc > 1 ? std::atol( argv[ 1 ] ) : 16 ) * 1024 * 1024;
+  std::mt19937 random( 1 );
+  const std::string data = makeTestData( random, size );
+  std::printf( "%zu MB of data\n%-22s %12s %12s %12s\n", size >> 20, "compression", "tinfl", "streaming", "zlib" );
+  for( int level : { 1, 6, 9 } )
+  {
+    for( int strategy : { STRATEGY_DEFAULT, STRATEGY_HUFFMAN_ONLY } )
+    {
+      const std::string compressed = deflateZlib( data, level, DeflateStrategy( strategy ) );
+      std::vector< mz_uint8 > out( data.size() );
+      bool ok = true;
+      const double whole = bestOf( 5, [ & ]() { ok &= inflateWhole( compressed, out ); } );
+      const double streaming = bestOf( 5, [ & ]() { ok &= inflateStreaming( compressed, out ); } );
+      std::string reference( data.size(), '\0' );
+      const double zlib = bestOf( 5, [ & ]() { ok &= uncompressZlib( compressed, reference ); } );
+      ok &= std::equal( out.begin(), out.end(), data.begin(), []( mz_uint8 lhs, char rhs ) { return lhs == mz_uint8( rhs ); } ) && reference == data;
+      char name[ 32 ];
+      std::snprintf( name, sizeof( name ), "level %d%s", level, strategy == STRATEGY_HUFFMAN_ONLY ? ", huffman only" : "" );
+      std::printf( "%-22s %7.1f MB/s %7.1f MB/s %7.1f MB/s%s\n", name, size / whole / 1e6, size / streaming / 1e6, size / zlib / 1e6, ok ? "" : "  MISMATCH" );
+    }
+  }
+  return 0;
+}
@@ -25,10 +25,276 @@ extern "C"
 #endif
 
   /**
+  @brief Register the BFS archiver with PhysFS.
+  Mounted archives may be used from any number of threads at once: opening, stat()ing, enumerating and reading files
+  needs no external locking. Each open file must only be used by one thread at a time, as usual with PhysFS.
+  The setBfs*() functions and getBfsArchiveStats() are thread-safe as well.
   @return 0 on error, non-0 on success
   **/
   PHYSFS_BFS_API int registerBfsArchiver( );
 
+  typedef struct BFSBatchRead
+  {
+    /// File to read, as passed to PHYSFS_openRead()
+    const char* path;
+    /// Receives up to bufferSize bytes from the start of the file
+    void* buffer;
+    unsigned long long bufferSize;
+    /// Set to the number of bytes read, or -1 on error
+    long long bytesRead;
+    /// Set to the PHYSFS_ErrorCode of the failure, PHYSFS_ERR_OK on success
+    int errorCode;
+  } BFSBatchRead;
+
+  /**
+  @brief Read many files at once.
+  Files in BFS archives are read in the order they're stored in, with files close to each other fetched by a single read,
+  which turns scattered reads into mostly sequential ones. Other files are read through PhysFS as usual.
+  @param reads Files to read; their bytesRead and errorCode are set.
+  @return 0 if any file could not be read, with the error code set to the first failure's; non-0 on success
+  **/
+  PHYSFS_BFS_API int readBfsFiles( BFSBatchRead* reads, unsigned int count );
+
+  enum BFSMountMode
+  {
+    /// Decode all paths and index them when mounting (default)
+    BFS_MOUNT_INDEX,
+    /// Look files up using the archive's hash table; only index paths once directories are enumerated.
+    /// The hash function is reverse engineered from FlatOut 2's archives; archives that don't match it are indexed on mount instead.
+    BFS_MOUNT_HASH_TABLE
+  };
+
+  /**
+  @brief Set how archives mounted from now on are indexed.
+  @param mode One of BFSMountMode
+  @return 0 on error, non-0 on success
+  **/
+  PHYSFS_BFS_API int setBfsMountMode( int mode );
+
+  /**
+  @brief Enable or disable the index cache for archives mounted from now on.
+  The path index of an archive is then stored in a sidecar file "<archive>.idx" and mapped on later mounts, as long as the archive is unchanged.
+  Only applies to archives in the native file system.
+  @param dir Directory to store cache files in; if NULL or empty, they are stored alongside the archives.
+  @return 0 on error, non-0 on success
+  **/
+  PHYSFS_BFS_API int setBfsIndexCache( int enabled, const char* dir );
+
+  /**
+  @brief Set how many threads decode the paths of archives mounted from now on.
+  @param count Number of threads including the mounting one, 0 for one per core; default is 1.
+  @return 0 on error, non-0 on success
+  **/
+  PHYSFS_BFS_API int setBfsStringPoolThreads( unsigned int count );
+
+  /**
+  @brief Configure seek checkpoints of compressed files in archives mounted from now on.
+  While a compressed file is read, its decompression state is recorded every interval bytes of output, so seeking can resume from the closest checkpoint instead of decompressing from the start.
+  Each checkpoint takes roughly 44 KB.
+  @param interval Uncompressed bytes between checkpoints, 0 to disable them; default is 512 KB.
+  @param budget Maximum bytes spent on checkpoints per open file; default is 4 MB.
+  @return 0 on error, non-0 on success
+  **/
+  PHYSFS_BFS_API int setBfsSeekCheckpoints( unsigned int interval, unsigned long long budget );
+
+  /**
+  @brief Configure the cache of decompressed files for archives mounted from now on.
+  Compressed files that are opened repeatedly are kept in memory, so reopening them needs neither i/o nor decompression.
+  @param budget Maximum bytes of decompressed data per archive, 0 to disable the cache (default).
+  @param maxEntrySize Larger files are never cached; default is 256 KB.
+  @param minOpens Files are cached once they have been opened this many times; default is 2.
+  @return 0 on error, non-0 on success
+  **/
+  PHYSFS_BFS_API int setBfsEntryCache( unsigned long long budget, unsigned long long maxEntrySize, unsigned int minOpens );
+
+  /**
+  @brief Configure whether archives mounted from now on are memory mapped.
+  Mapped archives are read directly from memory instead of through PhysFS, which saves a copy of compressed data and a file handle per open file.
+  Archives that are not regular files on disk are always read through PhysFS.
+  The archive file must not be truncated or rewritten while it is mounted: reading a mapped page that no longer exists in the file
+  raises SIGBUS (an access violation on Windows) instead of an error. Disable mapping if the archive may change, e.g. when it's patched in place.
+  @param enabled non-0 to map archives where possible (default), 0 to always read through PhysFS
+  @return 0 on error, non-0 on success
+  **/
+  PHYSFS_BFS_API int setBfsMemoryMap( int enabled );
+
+  /**
+  @brief Configure readahead for archives mounted from now on.
+  Large compressed files, e.g. streamed music, can be decompressed on a background thread ahead of the reader, so sequential reads only copy.
+  Each such open file gets a thread of its own once it's first read from, which is stopped by seeks beyond the data decompressed so far.
+  @param minFileSize Compressed files at least this large use readahead, 0 to disable it (default).
+  @param distance Bytes to decompress ahead of the reader; default is 1 MB.
+  @return 0 on error, non-0 on success
+  **/
+  PHYSFS_BFS_API int setBfsReadahead( unsigned long long minFileSize, unsigned int distance );
+
+  /**
+  @brief Configure recycling of decompression state for archives mounted from now on.
+  Compressed files borrow their decompression state (about 44 KB) and, unless the archive is memory mapped, a 16 KB input buffer from a pool of their archive,
+  and hand them back once closed, so opening many files doesn't allocate and free these each time.
+  @param budget Maximum bytes kept in the pool per archive, 0 to disable it; default is 1 MB.
+  @return 0 on error, non-0 on success
+  **/
+  PHYSFS_BFS_API int setBfsInflaterPool( unsigned long long budget );
+
+  /**
+  @brief Limit the decompression state held by open compressed files of archives mounted from now on.
+  Each open compressed file that has been read from holds about 44 KB of decompression state, plus a 16 KB input buffer unless the archive is memory mapped.
+  Files that haven't been read for a while, or the least recently read ones once all of them together exceed the budget, drop theirs.
+  It is rebuilt on their next read by decompressing again from the closest seek checkpoint (see setBfsSeekCheckpoints()), or from the start of the file.
+  Limits are checked whenever a file of the archive is read from.
+  @param budget Maximum bytes of decompression state per archive, 0 for no limit (default).
+  @param idleTimeout Files not read from for this many milliseconds drop their state, 0 never (default).
+  @return 0 on error, non-0 on success
+  **/
+  PHYSFS_BFS_API int setBfsStreamStateLimit( unsigned long long budget, unsigned int idleTimeout );
+
+  /**
+  @brief Configure parallel decompression of large files for archives mounted from now on.
+  Compressed files indexed by buildBfsAccessIndex() are split at their access points when read whole, and the parts decompressed on several threads at once.
+  The access points are loaded from the sidecar file "<archive>.acc", in the directory set by setBfsIndexCache() if any, as long as the archive is unchanged.
+  Only applies to archives in the native file system.
+  @param enabled non-0 to use access points, 0 to always decompress on the reading thread (default)
+  @param threads Threads per file including the reading one, 0 for one per core (default)
+  @return 0 on error, non-0 on success
+  **/
+  PHYSFS_BFS_API int setBfsParallelInflate( int enabled, unsigned int threads );
+
+  /**
+  @brief Record access points of large compressed files of a mounted archive and store them in its sidecar file, see setBfsParallelInflate().
+  Each such file is decompressed once, which takes a while for large archives; meant for a tool pass after building the archive.
+  The archive must have been mounted with parallel decompression enabled, which then uses the new access points right away.
+  @param archive Archive name as passed to PHYSFS_mount()
+  @param minFileSize Compressed files of at least this many decompressed bytes are indexed
+  @param spacing Minimum decompressed bytes between access points; each takes 32 KB in the sidecar file
+  @return 0 on error, non-0 on success
+  **/
+  PHYSFS_BFS_API int buildBfsAccessIndex( const char* archive, unsigned long long minFileSize, unsigned int spacing );
+
+  enum BFSCompressionType
+  {
+    /// Stored as is
+    BFS_COMPRESSION_NONE = 4,
+    /// Stored as a zlib stream (RFC 1950)
+    BFS_COMPRESSION_ZLIB = 5
+  };
+
+  typedef struct BFSRawEntry
+  {
+    /// How the file is stored, one of BFSCompressionType
+    int compressionType;
+    /// Bytes stored in the archive
+    unsigned long long compressedSize;
+    /// Size of the file once decompressed
+    unsigned long long uncompressedSize;
+    /// The stored bytes within the memory mapped archive, valid until it's unmounted; NULL if the archive is not mapped, see setBfsMemoryMap()
+    const void* data;
+  } BFSRawEntry;
+
+  /**
+  @brief Look up how a file is stored in its BFS archive, to pass its data on without decompressing and recompressing it.
+  If the archive is memory mapped, the stored data can be used in place; otherwise read it with readBfsRawEntry().
+  @param path File as passed to PHYSFS_openRead()
+  @return 0 on error, e.g. PHYSFS_ERR_NOT_FOUND if the file is not in a BFS archive; non-0 on success
+  **/
+  PHYSFS_BFS_API int statBfsRawEntry( const char* path, BFSRawEntry* entry );
+
+  /**
+  @brief Read a file's data as stored in its BFS archive, i.e. still compressed if it is, see statBfsRawEntry().
+  @param path File as passed to PHYSFS_openRead()
+  @param offset Position within the stored data to start at, so large files can be passed on in chunks
+  @param buffer Receives up to bufferSize bytes of the stored data
+  @return Bytes read, which is less than bufferSize only at the end of the stored data, 0 at or past it; -1 on error
+  **/
+  PHYSFS_BFS_API long long readBfsRawEntry( const char* path, unsigned long long offset, void* buffer, unsigned long long bufferSize );
+
+  /**
+  @brief Write a file's contents to a file descriptor, e.g. to copy it out of the archive onto disk.
+  Files stored uncompressed in a memory mapped archive are copied within the kernel where possible, via copy_file_range() or sendfile() on Linux.
+  Compressed files are decompressed in 1 MB chunks, written as each is done. Files not in a BFS archive are read through PhysFS the same way.
+  @param path File as passed to PHYSFS_openRead()
+  @param fd Open for writing, which starts at its current position; on Windows, as returned by _open()
+  @return Bytes written, -1 on error; part of the file may have been written then
+  **/
+  PHYSFS_BFS_API long long exportBfsFile( const char* path, int fd );
+
+  typedef struct BFSArchiveStats
+  {
+    /// Paths in the archive's string pool; 0 if its index was loaded from cache
+    unsigned int stringCount;
+    /// Paths decoded so far; in BFS_MOUNT_HASH_TABLE mode only those needed for lookups are decoded, once each
+    unsigned int decodedStringCount;
+    /// Opens of compressed files answered from the cache of decompressed files
+    unsigned long long entryCacheHits;
+    /// Opens of compressed files that were not cached
+    unsigned long long entryCacheMisses;
+    /// Files dropped from the cache to stay within budget
+    unsigned long long entryCacheEvictions;
+    /// Bytes currently cached
+    unsigned long long entryCacheSize;
+    /// Files waiting to be prefetched
+    unsigned long long prefetchQueued;
+    /// Files loaded by prefetching
+    unsigned long long prefetchLoaded;
+    /// Prefetches cancelled before they started
+    unsigned long long prefetchCancelled;
+    /// Prefetched files that were opened afterwards
+    unsigned long long prefetchUsed;
+    /// Prefetched files dropped from the cache before they were opened
+    unsigned long long prefetchWasted;
+    /// Decompression states and input buffers reused from the pool
+    unsigned long long inflaterPoolHits;
+    /// Decompression states and input buffers that had to be allocated
+    unsigned long long inflaterPoolMisses;
+    /// Bytes currently kept in the pool
+    unsigned long long inflaterPoolSize;
+    /// Open files currently holding decompression state; only counted if limited by setBfsStreamStateLimit()
+    unsigned long long streamStateFiles;
+    /// Bytes of decompression state they hold
+    unsigned long long streamStateSize;
+    /// Decompression states dropped to stay within the limits
+    unsigned long long streamStateEvictions;
+    /// Decompression states rebuilt after being dropped
+    unsigned long long streamStateRebuilds;
+    /// Files with access points; only loaded with setBfsParallelInflate()
+    unsigned long long accessIndexFiles;
+    /// Access points in those files
+    unsigned long long accessIndexPoints;
+    /// Files decompressed in parallel at their access points
+    unsigned long long parallelInflates;
+  } BFSArchiveStats;
+
+  /**
+  @brief Retrieve statistics of a mounted archive.
+  @param archive Archive name as passed to PHYSFS_mount()
+  @return 0 on error, non-0 on success
+  **/
+  PHYSFS_BFS_API int getBfsArchiveStats( const char* archive, BFSArchiveStats* stats );
+
+  /**
+  @brief Set how many background threads prefetch files of archives mounted from now on.
+  @param count Number of threads, default is 1
+  @return 0 on error, non-0 on success
+  **/
+  PHYSFS_BFS_API int setBfsPrefetchThreads( unsigned int count );
+
+  /**
+  @brief Decompress files into the cache of decompressed files on background threads, so opening them later is served from memory.
+  Requires the cache to be enabled via setBfsEntryCache(); its budget bounds the memory used. Prefetched files bypass its size and open count limits.
+  Files that are not compressed, already cached or not in a BFS archive are skipped.
+  @param paths Files as passed to PHYSFS_openRead()
+  @param priority Files of higher priority are loaded first; files queued again keep the higher of both priorities
+  @return 0 on error, e.g. if a file does not exist in its BFS archive; the others are queued nonetheless. Non-0 on success
+  **/
+  PHYSFS_BFS_API int prefetchBfsFiles( const char* const* paths, unsigned int count, int priority );
+
+  /**
+  @brief Remove files from the prefetch queue; files being loaded already are finished.
+  @param paths Files as passed to prefetchBfsFiles(), or NULL to cancel all prefetching in all archives
+  @return 0 on error, non-0 on success
+  **/
+  PHYSFS_BFS_API int cancelBfsPrefetch( const char* const* paths, unsigned int count );
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,251 @@
+#include "accessindex.hpp"
+#include "inflater.hpp"
+#include "mappedfile.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <system_error>
+
+enum : std::uint32_t
+{
+  /// Distance deflate may refer back
+  WINDOW_SIZE = 32 * 1024,
+};
+
+struct AccessIndexHeader
+{
+  enum : std::uint32_t
+  {
+    VERSION = 1,
+    BYTE_ORDER_MARK = 0x01020304,
+  };
+
+  char magic[ 8 ]; // "BFSACCES"
+  std::uint32_t version;
+  std::uint32_t byteOrderMark;
+  std::uint32_t entryCount;
+  std::uint32_t pointCount;
+  std::uint64_t windowsSize;
+  std::uint64_t archiveSize;
+  std::int64_t archiveModTime;
+  std::uint64_t contentHash;
+};
+
+static const char MAGIC[ 8 ] = { 'B', 'F', 'S', 'A', 'C', 'C', 'E', 'S' };
+
+static AccessIndexHeader makeHeader( const IndexCache::Key& key, std::uint32_t entryCount, std::uint32_t pointCount, std::uint64_t windowsSize )
+{
+  AccessIndexHeader header;
+  std::memcpy( header.magic, MAGIC, sizeof( MAGIC ) );
+  header.version = AccessIndexHeader::VERSION;
+  header.byteOrderMark = AccessIndexHeader::BYTE_ORDER_MARK;
+  header.entryCount = entryCount;
+  header.pointCount = pointCount;
+  header.windowsSize = windowsSize;
+  header.archiveSize = key.archiveSize;
+  header.archiveModTime = key.archiveModTime;
+  header.contentHash = key.contentHash;
+  return header;
+}
+
+/// Adler-32 of two pieces of data back to back, given the checksum of each and the size of the second, like zlib's adler32_combine()
+static std::uint32_t adler32Combine( std::uint32_t adler1, std::uint32_t adler2, std::uint64_t size2 )
+{
+  const std::uint64_t BASE = 65521;
+  const std::uint64_t remainder = size2 % BASE;
+  std::uint64_t sum1 = adler1 & 0xffff;
+  std::uint64_t sum2 = ( remainder * sum1 ) % BASE;
+  sum1 += ( adler2 & 0xffff ) + BASE - 1;
+  sum2 += ( adler1 >> 16 ) + ( adler2 >> 16 ) + BASE - remainder;
+  return std::uint32_t( ( sum2 % BASE ) << 16 | ( sum1 % BASE ) );
+}
+
+bool AccessIndex::add( std::uint32_t offset, const char* in, std::size_t inSize, char* out, std::size_t outSize, std::size_t spacing )
+{
+  assert( m_entries.empty() || m_entries.back().offset < offset );
+  spacing = std::max< std::size_t >( spacing, 1 );
+  const std::size_t firstPoint = m_points.size();
+  const std::size_t firstWindow = m_windows.size();
+  const bool success = inflateWholeIndexed( in, inSize, out, outSize, [ & ]( std::size_t outPos, std::uint64_t inBitPos )
+  {
+    // The first point is the start of the file, later ones are spread out; nothing's left to split off at the end
+    if( outPos >= outSize ) return;
+    if( m_points.size() == firstPoint ? outPos != 0 : outPos - m_points.back().outPos < spacing ) return;
+    // Everything up to outPos has been decompressed already
+    const std::size_t windowSize = std::min< std::size_t >( outPos, WINDOW_SIZE );
+    m_points.push_back( { outPos, inBitPos, m_windows.size(), std::uint32_t( windowSize ), 0 } );
+    m_windows.insert( m_windows.end(), out + outPos - windowSize, out + outPos );
+  } );
+  // Files without a second point can't be split up, so aren't worth recording
+  const std::size_t pointCount = m_points.size() - firstPoint;
+  if( success && pointCount > 1 )
+  {
+    m_entries.push_back( { offset, std::uint32_t( firstPoint ), std::uint32_t( pointCount ), 0 } );
+  }
+  else
+  {
+    m_points.resize( firstPoint );
+    m_windows.resize( firstWindow );
+  }
+  return success;
+}
+
+bool AccessIndex::load( const std::string& filename, const IndexCache::Key& key )
+{
+  MappedFile file;
+  if( !file.open( filename.c_str() ) || file.size() < sizeof( AccessIndexHeader ) ) return false;
+  AccessIndexHeader header;
+  std::memcpy( &header, file.data(), sizeof( header ) );
+  const AccessIndexHeader expected = makeHeader( key, header.entryCount, header.pointCount, header.windowsSize );
+  if( std::memcmp( &header, &expected, sizeof( header ) ) != 0 ) return false;
+  const std::uint64_t expectedSize = sizeof( AccessIndexHeader )
+    + std::uint64_t( header.entryCount ) * sizeof( Entry )
+    + std::uint64_t( header.pointCount ) * sizeof( Point )
+    + header.windowsSize;
+  if( expectedSize != file.size() ) return false;
+
+  AccessIndex loaded;
+  const char* data = file.data() + sizeof( AccessIndexHeader );
+  loaded.m_entries.resize( header.entryCount );
+  std::memcpy( loaded.m_entries.data(), data, loaded.m_entries.size() * sizeof( Entry ) );
+  data += loaded.m_entries.size() * sizeof( Entry );
+  loaded.m_points.resize( header.pointCount );
+  std::memcpy( loaded.m_points.data(), data, loaded.m_points.size() * sizeof( Point ) );
+  data += loaded.m_points.size() * sizeof( Point );
+  loaded.m_windows.assign( data, data + header.windowsSize );
+  if( !loaded.validate() ) return false;
+  *this = std::move( loaded );
+  return true;
+}
+
+bool AccessIndex::validate() const
+{
+  for( std::size_t i = 0; i < m_entries.size(); ++i )
+  {
+    const Entry& entry = m_entries[ i ];
+    if( ( i > 0 && entry.offset <= m_entries[ i - 1 ].offset ) || entry.pointCount < 2
+      || std::uint64_t( entry.firstPoint ) + entry.pointCount > m_points.size() )
+    {
+      return false;
+    }
+    const Point* points = m_points.data() + entry.firstPoint;
+    if( points[ 0 ].outPos != 0 ) return false;
+    for( std::uint32_t j = 0; j < entry.pointCount; ++j )
+    {
+      const Point& point = points[ j ];
+      if( ( j > 0 && point.outPos <= points[ j - 1 ].outPos ) || point.windowSize > WINDOW_SIZE || point.windowSize > point.outPos
+        || point.windowOffset > m_windows.size() || point.windowSize > m_windows.size() - point.windowOffset )
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool AccessIndex::store( const std::string& filename, const IndexCache::Key& key ) const
+{
+  // Write to a temporary file first so concurrent mounts never see a partial index
+  const std::string tempName = filename + ".tmp";
+  std::FILE* file = std::fopen( tempName.c_str(), "wb" );
+  if( !file ) return false;
+  const AccessIndexHeader header = makeHeader( key, m_entries.size(), m_points.size(), m_windows.size() );
+  const bool written = std::fwrite( &header, sizeof( header ), 1, file ) == 1
+    && std::fwrite( m_entries.data(), sizeof( Entry ), m_entries.size(), file ) == m_entries.size()
+    && std::fwrite( m_points.data(), sizeof( Point ), m_points.size(), file ) == m_points.size()
+    && std::fwrite( m_windows.data(), 1, m_windows.size(), file ) == m_windows.size();
+  if( std::fclose( file ) != 0 || !written )
+  {
+    std::remove( tempName.c_str() );
+    return false;
+  }
+#ifdef _WIN32
+  // rename() does not replace existing files on Windows
+  std::remove( filename.c_str() );
+#endif
+  if( std::rename( tempName.c_str(), filename.c_str() ) != 0 )
+  {
+    std::remove( tempName.c_str() );
+    return false;
+  }
+  return true;
+}
+
+const AccessIndex::Entry* AccessIndex::find( std::uint32_t offset ) const
+{
+  auto it = std::lower_bound( m_entries.begin(), m_entries.end(), offset, []( const Entry& entry, std::uint32_t offset ) { return entry.offset < offset; } );
+  return it != m_entries.end() && it->offset == offset ? &*it : nullptr;
+}
+
+bool AccessIndex::inflateWhole( std::uint32_t offset, const char* in, std::size_t inSize, char* out, std::size_t outSize, unsigned int threadCount ) const
+{
+  const Entry* entry = find( offset );
+  // The data ends in the Adler-32 checksum of the output
+  if( !entry || inSize < 4 ) return false;
+  const Point* points = m_points.data() + entry->firstPoint;
+  const std::uint32_t count = entry->pointCount;
+  for( std::uint32_t i = 0; i < count; ++i )
+  {
+    if( points[ i ].outPos >= outSize || points[ i ].inBitPos / 8 >= inSize ) return false;
+  }
+  auto segmentSize = [ points, count, outSize ]( std::uint32_t i )
+  {
+    return std::size_t( ( i + 1 < count ? points[ i + 1 ].outPos : outSize ) - points[ i ].outPos );
+  };
+
+  // Each segment runs from its point to the next, and decompresses independently given the window preceding it
+  std::vector< std::uint32_t > checksums( count );
+  std::atomic< std::uint32_t > nextSegment( 0 );
+  std::atomic< bool > failed( false );
+  auto work = [ this, in, inSize, out, points, count, &segmentSize, &checksums, &nextSegment, &failed ]()
+  {
+    try
+    {
+      std::uint32_t i;
+      while( !failed && ( i = nextSegment++ ) < count )
+      {
+        const Point& point = points[ i ];
+        const std::size_t inStart = point.inBitPos / 8;
+        if( !inflatePart( in + inStart, inSize - inStart, point.inBitPos % 8, m_windows.data() + point.windowOffset, point.windowSize,
+          out + point.outPos, segmentSize( i ), checksums[ i ] ) )
+        {
+          failed = true;
+        }
+      }
+    }
+    catch( ... )
+    {
+      failed = true;
+    }
+  };
+
+  if( threadCount == 0 ) threadCount = std::max( 1u, std::thread::hardware_concurrency() );
+  threadCount = std::min( threadCount, count );
+  std::vector< std::thread > threads;
+  for( unsigned int i = 1; i < threadCount; ++i )
+  {
+    try
+    {
+      threads.emplace_back( work );
+    }
+    catch( std::system_error& )
+    {
+      // Continue with the threads we have
+      break;
+    }
+  }
+  work();
+  for( auto& thread : threads ) thread.join();
+  if( failed ) return false;
+
+  // Only the whole output's checksum is known, so piece it together
+  std::uint32_t adler32 = 1;
+  for( std::uint32_t i = 0; i < count; ++i ) adler32 = adler32Combine( adler32, checksums[ i ], segmentSize( i ) );
+  const unsigned char* trailer = reinterpret_cast< const unsigned char* >( in + inSize - 4 );
+  const std::uint32_t expected = std::uint32_t( trailer[ 0 ] ) << 24 | std::uint32_t( trailer[ 1 ] ) << 16 | std::uint32_t( trailer[ 2 ] ) << 8 | trailer[ 3 ];
+  return adler32 == expected;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "indexcache.hpp"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+@brief Points within large compressed files where decompression can start, so their parts can be decompressed in parallel.
+
+Each access point is the start of a deflate block, stored with up to 32 KB of the output preceding it, which the block may refer back to.
+Files are identified by the offset of their data in the archive. The index is built once by a tool pass and stored in a sidecar file,
+keyed like the IndexCache. Immutable once built or loaded, so it may be used from any number of threads.
+**/
+class AccessIndex
+{
+public:
+  struct Point
+  {
+    /// Position in the decompressed file
+    std::uint64_t outPos;
+    /// Position of the deflate block in the compressed data, in bits
+    std::uint64_t inBitPos;
+    /// Where the output preceding outPos is stored among all windows
+    std::uint64_t windowOffset;
+    std::uint32_t windowSize;
+    std::uint32_t padding;
+  };
+
+public:
+  /**
+  @brief Decompress a file and record its access points, at least spacing bytes of output apart.
+  Files must be added in order of their offset.
+  @param out Receives the decompressed file
+  @return false if the file is corrupt, in which case nothing is recorded
+  **/
+  bool add( std::uint32_t offset, const char* in, std::size_t inSize, char* out, std::size_t outSize, std::size_t spacing );
+
+  /**
+  @return false if there is no valid index file for the given key; the index is unchanged in that case.
+  **/
+  bool load( const std::string& filename, const IndexCache::Key& key );
+  /// @return false if the file could not be written
+  bool store( const std::string& filename, const IndexCache::Key& key ) const;
+
+  /// Whether the file with data at the given offset has more than one access point, i.e. can be split up
+  bool contains( std::uint32_t offset ) const { return find( offset ) != nullptr; }
+  /**
+  @brief Decompress a whole file, split at its access points across threads, and verify it against the checksum at the end of the data.
+  @param threadCount Threads to use including the calling one, 0 for one per core
+  @return false if the file has no access points or fails to decompress; out may have been written to nonetheless
+  **/
+  bool inflateWhole( std::uint32_t offset, const char* in, std::size_t inSize, char* out, std::size_t outSize, unsigned int threadCount ) const;
+
+  std::size_t fileCount() const { return m_entries.size(); }
+  std::size_t pointCount() const { return m_points.size(); }
+
+private:
+  struct Entry
+  {
+    std::uint32_t offset;
+    std::uint32_t firstPoint;
+    std::uint32_t pointCount;
+    std::uint32_t padding;
+  };
+
+private:
+  const Entry* find( std::uint32_t offset ) const;
+  /// Checks entries and points refer to nothing outside the index
+  bool validate() const;
+
+private:
+  /// Sorted by offset
+  std::vector< Entry > m_entries;
+  std::vector< Point > m_points;
+  std::vector< char > m_windows;
+};
@@ -1,20 +1,21 @@
 #include "bfsarchive.hpp"
-#include "bfsformat.hpp"
-#include "stringpool.hpp"
 #include "bfsfilecompressed.hpp"
+#include "bfsfilememory.hpp"
+#include "bfsfilereadahead.hpp"
+#include "fdcopy.hpp"
 
 #include <vector>
 #include <cassert>
+#include <cstring>
 #include <memory>
 #include <algorithm>
 #include <iostream>
 
-static BFSHeader readHeader( PHYSFS_Io& io )
+static BFSHeader readHeader( const char* data )
 {
-  io.seek( &io, 0 );
   BFSHeader header;
-  if( io.read( &io, &header, sizeof( header ) ) != sizeof( header )
-    || std::string( header.fileId, 4 ) != std::string( "bfs1", 4 ) )
+  std::memcpy( &header, data, sizeof( header ) );
+  if( std::string( header.fileId, 4 ) != std::string( "bfs1", 4 ) )
   {
     throw PHYSFS_ERR_CORRUPT;
   }
@@ -26,175 +27,741 @@ static BFSHeader readHeader( PHYSFS_Io& io )
   return header;
 }
 
-BFSArchive::BFSArchive( PHYSFS_Io& io )
+/**
+@brief Reads all metadata: header, hash table, string pool and file info table, which are stored back to back at the start of the archive.
+Guesses the size for the first read and only issues a second one for the remainder if that was too small.
+**/
+static std::vector< char > readMetadata( PHYSFS_Io& io, BFSHeader& out_header )
+{
+  enum { INITIAL_READ_SIZE = 256 * 1024 };
+  std::vector< char > metadata( INITIAL_READ_SIZE );
+  if( !io.seek( &io, 0 ) ) throw PHYSFS_ERR_IO;
+  const PHYSFS_sint64 initialSize = io.read( &io, metadata.data(), metadata.size() );
+  if( initialSize < PHYSFS_sint64( BFSHeader::HEADER_SIZE + sizeof( BFSStringPoolHeader ) ) )
+  {
+    throw PHYSFS_ERR_CORRUPT;
+  }
+  out_header = readHeader( metadata.data() );
+
+  std::uint32_t stringPoolSize;
+  std::memcpy( &stringPoolSize, metadata.data() + BFSHeader::HEADER_SIZE, sizeof( stringPoolSize ) );
+  stringPoolSize = PHYSFS_swapULE32( stringPoolSize );
+  // Files can't outnumber the strings in the pool, each of which takes at least 2 bytes for its size; this bounds corrupt file counts
+  const std::uint64_t fileCount = std::min< std::uint64_t >( out_header.fileCount, stringPoolSize / 2 );
+  const std::uint64_t size = BFSHeader::HEADER_SIZE + std::uint64_t( stringPoolSize ) + fileCount * sizeof( BFSFileInfo );
+
+  if( size > std::uint64_t( initialSize ) )
+  {
+    if( initialSize < INITIAL_READ_SIZE ) throw PHYSFS_ERR_CORRUPT;
+    metadata.resize( size );
+    const PHYSFS_uint64 remainder = size - initialSize;
+    if( io.read( &io, metadata.data() + initialSize, remainder ) != PHYSFS_sint64( remainder ) )
+    {
+      throw PHYSFS_ERR_CORRUPT;
+    }
+  }
+  metadata.resize( size );
+  return metadata;
+}
+
+/// Reads the hash table following the header
+static std::vector< BFSHashEntry > readHashTable( const char* data )
+{
+  std::vector< BFSHashEntry > table( BFSHeader::HASH_SIZE );
+  std::memcpy( table.data(), data, table.size() * sizeof( BFSHashEntry ) );
+  for( auto& entry : table )
+  {
+    entry.firstFileIndex = PHYSFS_swapULE32( entry.firstFileIndex );
+    entry.fileCount = PHYSFS_swapULE32( entry.fileCount );
+  }
+  return table;
+}
+
+/// Reads a whole file from its current position, nullptr on failure
+static std::shared_ptr< std::vector< char > > readAll( BFSFile& file )
+{
+  std::shared_ptr< std::vector< char > > contents = std::make_shared< std::vector< char > >( file.size() );
+  if( file.read( contents->data(), contents->size() ) != PHYSFS_sint64( contents->size() ) ) return nullptr;
+  return contents;
+}
+
+BFSArchive::BFSArchive( PHYSFS_Io& io, const char* name, const Options& options )
 : m_io( io )
+, m_options( options )
+, m_parallelInflates( 0 )
 {
+  if( options.inflaterPoolBudget > 0 ) m_inflaterPool.reset( new InflaterPool( options.inflaterPoolBudget ) );
+  if( options.streamStateBudget > 0 || options.streamIdleTimeout > 0 )
+  {
+    m_streamTracker.reset( new StreamTracker( options.streamStateBudget, std::chrono::milliseconds( options.streamIdleTimeout ) ) );
+  }
+  if( options.entryCacheBudget > 0 )
+  {
+    m_entryCache.reset( new EntryCache( options.entryCacheBudget, options.entryCacheMaxEntrySize, options.entryCacheMinOpens ) );
+    m_prefetcher.reset( new Prefetcher( options.prefetchThreads, [ this ]( const BFSFile::Info& info ) { prefetchLoad( info ); } ) );
+  }
+
   // Read Header
-  BFSHeader header = readHeader( io );
+  BFSHeader header;
+  const std::vector< char > metadata = readMetadata( io, header );
   if( header.hashSize != BFSHeader::HASH_SIZE )
   {
     std::cerr << "Invalid Hash Size" << std::endl;
     throw PHYSFS_ERR_CORRUPT;
   }
+  if( options.useMemoryMap && name ) mapArchive( name, metadata );
+  if( !m_mapping.isOpen() && name ) openArchiveFile( name, metadata );
+  if( options.useAccessIndex && name ) loadAccessIndex( name, metadata, options );
+  if( options.useIndexCache && name && loadIndexCache( name, metadata, options ) ) return;
+  if( options.useHashTable ) m_hashTable = readHashTable( metadata.data() + sizeof( BFSHeader ) );
 
-  StringPool stringPool;
-  unsigned int stringPoolEnd = stringPool.read( io, BFSHeader::HEADER_SIZE );
-  if( stringPoolEnd == -1 )
+  const char * const stringPoolData = metadata.data() + BFSHeader::HEADER_SIZE;
+  const int stringPoolSize = m_stringPool.load( stringPoolData, metadata.size() - BFSHeader::HEADER_SIZE );
+  if( stringPoolSize == -1 )
   {
     std::cerr << "Error: Failed to read string pool!" << std::endl;
     throw PHYSFS_ERR_CORRUPT;
   }
 
-  unsigned int fileCount = std::min( header.fileCount, stringPool.size() );
-  if( !io.seek( &io, stringPoolEnd ) )
-  {
-    std::cerr << "Error: Failed to seek File Info" << std::endl;
-    throw PHYSFS_ERR_CORRUPT;
-  }
-
-  std::vector< BFSFileInfo > fileInfos( fileCount );
-  if( io.read( &io, fileInfos.data(), fileCount * sizeof( BFSFileInfo ) ) != fileCount * sizeof( BFSFileInfo ) )
+  unsigned int fileCount = std::min( header.fileCount, m_stringPool.size() );
+  const char * const fileInfoData = stringPoolData + stringPoolSize;
+  if( std::uint64_t( fileCount ) * sizeof( BFSFileInfo ) > std::uint64_t( metadata.data() + metadata.size() - fileInfoData ) )
   {
     std::cerr << "Error: Failed to read File Info" << std::endl;
     throw PHYSFS_ERR_CORRUPT;
   }
 
-  for( const auto& fileInfo : fileInfos )
+  m_files.reserve( fileCount );
+  for( unsigned int fileIndex = 0; fileIndex < fileCount; ++fileIndex )
   {
-    const auto compressedSize = PHYSFS_swapULE32( fileInfo.compressedSize );
-    const auto uncompressedSize = PHYSFS_swapULE32( fileInfo.uncompressedSize );
-    const auto offset = PHYSFS_swapULE32( fileInfo.offset );
+    BFSFileInfo fileInfo;
+    std::memcpy( &fileInfo, fileInfoData + fileIndex * sizeof( BFSFileInfo ), sizeof( fileInfo ) );
     const auto compressionType = PHYSFS_swapULE32( fileInfo.compressionType );
     const bool compressed = compressionType == 5;
-    const auto dir = PHYSFS_swapULE16( fileInfo.dirStringIndex );
-    const auto file = PHYSFS_swapULE16( fileInfo.fileStringIndex );
-    std::string filename = stringPool.at( dir ) + '/' + stringPool.at( file );
+    m_files.push_back( {
+      {
+        PHYSFS_swapULE32( fileInfo.offset ),
+        PHYSFS_swapULE32( fileInfo.compressedSize ),
+        PHYSFS_swapULE32( fileInfo.uncompressedSize ),
+        compressed
+      },
+      PHYSFS_swapULE16( fileInfo.dirStringIndex ),
+      PHYSFS_swapULE16( fileInfo.fileStringIndex ),
+      compressionType
+    } );
+  }
+
+  if( !m_hashTable.empty() && !hashTableMatches() )
+  {
+    std::cerr << "Warning: Hash table does not match archive contents, indexing all paths instead." << std::endl;
+    m_hashTable.clear();
+  }
+  if( m_hashTable.empty() ) index();
+}
+
+BFSArchive::~BFSArchive()
+{
+  // Prefetching threads still use the archive
+  m_prefetcher.reset();
+  m_io.destroy( &m_io );
+}
+
+void BFSArchive::mapArchive( const char* name, const std::vector< char >& metadata )
+{
+  // Keep the descriptor for exporting files within the kernel
+  if( !m_mapping.open( name, true ) ) return;
+  // The name need not refer to a file on disk (e.g. for archives within archives), so make sure it's the same one.
+  const PHYSFS_sint64 length = m_io.length( &m_io );
+  if( length < 0 || std::uint64_t( length ) != m_mapping.size() || m_mapping.size() < metadata.size()
+    || std::memcmp( m_mapping.data(), metadata.data(), metadata.size() ) != 0 )
+  {
+    m_mapping.close();
+  }
+}
+
+void BFSArchive::openArchiveFile( const char* name, const std::vector< char >& metadata )
+{
+  if( !m_file.open( name ) ) return;
+  // Same check as for the mapping: the name may refer to some other file
+  const PHYSFS_sint64 length = m_io.length( &m_io );
+  std::vector< char > start( metadata.size() );
+  if( length < 0 || std::uint64_t( length ) != m_file.size()
+    || m_file.readAt( 0, start.data(), start.size() ) != std::int64_t( start.size() ) || start != metadata )
+  {
+    m_file.close();
+  }
+}
+
+PHYSFS_sint64 BFSArchive::readAt( PHYSFS_uint64 offset, char buf[], PHYSFS_uint64 len )
+{
+  if( m_mapping.isOpen() )
+  {
+    if( offset >= m_mapping.size() ) return 0;
+    const PHYSFS_uint64 bytesRead = std::min< PHYSFS_uint64 >( m_mapping.size() - offset, len );
+    std::memcpy( buf, m_mapping.data() + offset, bytesRead );
+    return bytesRead;
+  }
+  if( m_file.isOpen() ) return m_file.readAt( offset, buf, len );
+  // PHYSFS_Io has no positional reads, so emulate them; only for archives that aren't files of their own, e.g. within other archives
+  std::lock_guard< std::mutex > lock( m_ioMutex );
+  if( !m_io.seek( &m_io, offset ) ) return -1;
+  return m_io.read( &m_io, buf, len );
+}
+
+bool BFSArchive::loadIndexCache( const char* name, const std::vector< char >& metadata, const Options& options )
+{
+  // Key on all metadata: header including hash table, string pool and file info
+  m_indexCache.reset( new IndexCache( options.indexCacheDir, name ) );
+  if( !m_indexCache->getKey( metadata.data(), metadata.size(), m_indexCacheKey ) )
+  {
+    m_indexCache.reset();
+    return false;
+  }
+  if( !m_indexCache->load( m_indexCacheKey, m_index ) ) return false;
+  m_indexBuilt = true;
+  return true;
+}
+
+void BFSArchive::loadAccessIndex( const char* name, const std::vector< char >& metadata, const Options& options )
+{
+  // Keyed like the index cache, so it's rebuilt whenever the archive changes
+  if( !IndexCache::getKey( name, metadata.data(), metadata.size(), m_accessIndexKey ) ) return;
+  m_accessIndexName = IndexCache::sidecarName( options.indexCacheDir, name, ".acc" );
+  std::shared_ptr< AccessIndex > accessIndex = std::make_shared< AccessIndex >();
+  if( accessIndex->load( m_accessIndexName, m_accessIndexKey ) ) m_accessIndex = std::move( accessIndex );
+}
 
-    if( !compressed && compressionType != 4 )
+/// Collects the compressed files of at least minSize decompressed bytes below dir
+static void collectLargeFiles( const PathIndex& index, const PathIndex::Entry& dir, std::uint64_t minSize, std::vector< const BFSFile::Info* >& out_files )
+{
+  for( std::uint32_t i = 0; i < dir.childCount; ++i )
+  {
+    const PathIndex::Entry& child = index.child( dir, i );
+    if( child.type == PathIndex::TYPE_DIRECTORY )
     {
-      std::cerr << "Warning: Ignoring file '" << filename << "' with unsupported compression type " << fileInfo.compressionType << "!" << std::endl;
-      continue;
+      collectLargeFiles( index, child, minSize, out_files );
+    }
+    else if( child.info.compressed && child.info.uncompressedSize >= minSize )
+    {
+      out_files.push_back( &child.info );
     }
+  }
+}
 
-    if( !compressed ) std::cout << filename << " is uncompressed." << std::endl;
+void BFSArchive::buildAccessIndex( std::uint64_t minSize, std::uint32_t spacing )
+{
+  if( m_accessIndexName.empty() ) throw PHYSFS_ERR_UNSUPPORTED;
+  const PathIndex& pathIndex = index();
+  std::vector< const BFSFile::Info* > files;
+  collectLargeFiles( pathIndex, pathIndex.root(), minSize, files );
+  // Files are added in order of offset, each only once even if listed under several paths
+  std::sort( files.begin(), files.end(), []( const BFSFile::Info* lhs, const BFSFile::Info* rhs ) { return lhs->offset < rhs->offset; } );
+  files.erase( std::unique( files.begin(), files.end(), []( const BFSFile::Info* lhs, const BFSFile::Info* rhs ) { return lhs->offset == rhs->offset; } ), files.end() );
 
-    m_root.insert( std::move( filename ), {
-      offset,
-      compressedSize,
-      uncompressedSize,
-      compressed
-    } );
+  std::shared_ptr< AccessIndex > accessIndex = std::make_shared< AccessIndex >();
+  std::vector< char > input;
+  std::vector< char > output;
+  for( const BFSFile::Info* info : files )
+  {
+    const char* data;
+    if( m_mapping.isOpen() )
+    {
+      if( std::uint64_t( info->offset ) + info->compressedSize > m_mapping.size() ) continue;
+      data = m_mapping.data() + info->offset;
+    }
+    else
+    {
+      input.resize( info->compressedSize );
+      if( readAt( info->offset, input.data(), input.size() ) != PHYSFS_sint64( input.size() ) ) continue;
+      data = input.data();
+    }
+    output.resize( info->uncompressedSize );
+    // Corrupt files are left out; reading them fails as usual
+    accessIndex->add( info->offset, data, info->compressedSize, output.data(), output.size(), spacing );
   }
+
+  {
+    std::lock_guard< std::mutex > lock( m_accessIndexMutex );
+    m_accessIndex = accessIndex;
+  }
+  if( !accessIndex->store( m_accessIndexName, m_accessIndexKey ) ) throw PHYSFS_ERR_IO;
 }
 
-void BFSArchive::Directory::insert( std::string&& filename, BFSFile::Info&& file )
+bool BFSArchive::inflateWhole( const BFSFile::Info& info, const char* data, char* out )
 {
-  auto slashPos = filename.find( '/' );
-  if( slashPos == std::string::npos )
+  std::shared_ptr< const AccessIndex > accessIndex;
   {
-    files.emplace( std::make_pair( filename, file ) );
+    std::lock_guard< std::mutex > lock( m_accessIndexMutex );
+    accessIndex = m_accessIndex;
   }
-  else
+  if( accessIndex && accessIndex->contains( info.offset ) )
   {
-    std::string dirname = filename.substr( 0, slashPos );
-    std::string tail = filename.substr( slashPos + 1 );
-    auto entry = dirs.find( dirname );
-    if( entry == dirs.end() )
+    if( accessIndex->inflateWhole( info.offset, data, info.compressedSize, out, info.uncompressedSize, m_options.parallelInflateThreads ) )
     {
-      entry = dirs.emplace( std::make_pair( std::move( dirname ), std::unique_ptr< Directory >( new Directory() ) ) ).first;
+      ++m_parallelInflates;
+      return true;
     }
-    entry->second->insert( std::move( tail ), std::move( file ) );
+    // Stale or damaged access points? The checksum at the end settles whether the data itself is corrupt.
   }
+  return ZipStream::inflateWhole( data, info.compressedSize, out, info.uncompressedSize );
 }
 
-BFSArchive::~BFSArchive()
+bool BFSArchive::hashTableMatches()
 {
-  m_io.destroy( &m_io );
+  // Buckets must exactly cover the file info table
+  std::uint64_t total = 0;
+  for( const auto& bucket : m_hashTable )
+  {
+    if( std::uint64_t( bucket.firstFileIndex ) + bucket.fileCount > m_files.size() ) return false;
+    total += bucket.fileCount;
+  }
+  if( total != m_files.size() ) return false;
+
+  // Check the hash function on the first and last file of every bucket. That's at most two paths per bucket to decode
+  // whatever the size of the archive, and enough to catch archives hashed differently, which would need every path checked to rule out.
+  std::string filename;
+  for( std::uint32_t index = 0; index < m_hashTable.size(); ++index )
+  {
+    const BFSHashEntry& bucket = m_hashTable[ index ];
+    if( bucket.fileCount == 0 ) continue;
+    for( std::uint32_t fileIndex : { bucket.firstFileIndex, bucket.firstFileIndex + bucket.fileCount - 1 } )
+    {
+      const FileEntry& file = m_files[ fileIndex ];
+      const char* dir = m_stringPool.get( file.dirStringIndex );
+      const char* name = m_stringPool.get( file.fileStringIndex );
+      if( !dir || !name ) return false;
+      filename.assign( dir, m_stringPool.length( file.dirStringIndex ) );
+      filename += '/';
+      filename.append( name, m_stringPool.length( file.fileStringIndex ) );
+      if( BFSHeader::bucket( filename.data(), filename.size() ) != index ) return false;
+    }
+  }
+  return true;
 }
 
-void BFSArchive::enumerateFiles( std::string dirname, PHYSFS_EnumFilesCallback cb, const char* origdir, void* callbackdata )
+bool BFSArchive::isDirectory( const char* path )
 {
-  Directory* dir = lookup( dirname ).first;
-  if( !dir ) return;
-  for( auto& entry : dir->dirs )
+  std::call_once( m_directoriesOnce, [ this ]()
+  {
+    // Only the directory strings are needed, which are far fewer than the file names
+    std::vector< bool > seen( m_stringPool.size(), false );
+    m_directories.insert( std::string() );
+    for( const FileEntry& file : m_files )
+    {
+      if( !file.supported() || file.dirStringIndex >= seen.size() || seen[ file.dirStringIndex ] ) continue;
+      seen[ file.dirStringIndex ] = true;
+      const char* dir = m_stringPool.get( file.dirStringIndex );
+      if( !dir )
+      {
+        std::cerr << "Error: Invalid string index in File Info!" << std::endl;
+        throw PHYSFS_ERR_CORRUPT;
+      }
+      // Parent directories exist implicitly
+      std::string directory( dir, m_stringPool.length( file.dirStringIndex ) );
+      while( m_directories.insert( directory ).second )
+      {
+        const std::size_t slash = directory.rfind( '/' );
+        directory.resize( slash == std::string::npos ? 0 : slash );
+      }
+    }
+  } );
+  std::size_t len = std::strlen( path );
+  // Like the path index, accept a trailing slash
+  if( len > 0 && path[ len - 1 ] == '/' ) --len;
+  return m_directories.count( std::string( path, len ) ) != 0;
+}
+
+const BFSFile::Info* BFSArchive::findInHashTable( const char* filename )
+{
+  const std::size_t len = std::strlen( filename );
+  const BFSHashEntry& bucket = m_hashTable[ BFSHeader::bucket( filename, len ) ];
+  for( std::uint32_t index = bucket.firstFileIndex; index < bucket.firstFileIndex + bucket.fileCount; ++index )
+  {
+    const FileEntry& file = m_files[ index ];
+    if( !file.supported() ) continue;
+    // Compare lengths before decoding anything
+    const std::size_t dirLength = m_stringPool.length( file.dirStringIndex );
+    const std::size_t fileLength = m_stringPool.length( file.fileStringIndex );
+    if( dirLength + 1 + fileLength != len || filename[ dirLength ] != '/' ) continue;
+    const char* dir = m_stringPool.get( file.dirStringIndex );
+    if( !dir || std::memcmp( filename, dir, dirLength ) != 0 ) continue;
+    const char* name = m_stringPool.get( file.fileStringIndex );
+    if( !name || std::memcmp( filename + dirLength + 1, name, fileLength ) != 0 ) continue;
+    return &file.info;
+  }
+  return nullptr;
+}
+
+const PathIndex& BFSArchive::index()
+{
+  // Once built, the index is never modified again, so lookups need no further synchronization
+  std::call_once( m_indexOnce, [ this ]()
+  {
+    if( !m_indexBuilt ) buildIndex();
+  } );
+  return m_index;
+}
+
+void BFSArchive::buildIndex()
+{
+  if( !m_stringPool.decodeAll( m_options.stringPoolThreads ) )
+  {
+    std::cerr << "Error: Failed to decode string pool!" << std::endl;
+    throw PHYSFS_ERR_CORRUPT;
+  }
+
+  PathIndex::FileList files;
+  files.reserve( m_files.size() );
+  for( const auto& file : m_files )
+  {
+    const char* dir = m_stringPool.get( file.dirStringIndex );
+    const char* name = m_stringPool.get( file.fileStringIndex );
+    if( !dir || !name )
+    {
+      std::cerr << "Error: Invalid string index in File Info!" << std::endl;
+      throw PHYSFS_ERR_CORRUPT;
+    }
+    std::string filename( dir, m_stringPool.length( file.dirStringIndex ) );
+    filename += '/';
+    filename.append( name, m_stringPool.length( file.fileStringIndex ) );
+
+    if( !file.supported() )
+    {
+      std::cerr << "Warning: Ignoring file '" << filename << "' with unsupported compression type " << file.compressionType << "!" << std::endl;
+      continue;
+    }
+
+    if( !file.info.compressed ) std::cout << filename << " is uncompressed." << std::endl;
+
+    files.emplace_back( std::move( filename ), file.info );
+  }
+  m_index.build( files );
+  m_indexBuilt = true;
+  if( m_indexCache ) m_indexCache->store( m_indexCacheKey, m_index );
+}
+
+const BFSFile::Info* BFSArchive::findRaw( const char* filename, const char*& out_data )
+{
+  const BFSFile::Info* info = find( filename );
+  out_data = nullptr;
+  if( !info || !m_mapping.isOpen() ) return info;
+  if( std::uint64_t( info->offset ) + info->compressedSize > m_mapping.size() ) throw PHYSFS_ERR_PAST_EOF;
+  out_data = m_mapping.data() + info->offset;
+  return info;
+}
+
+PHYSFS_uint64 BFSArchive::readRaw( const char* filename, PHYSFS_uint64 offset, char buf[], PHYSFS_uint64 size )
+{
+  const BFSFile::Info* info = find( filename );
+  if( !info ) throw PHYSFS_ERR_NOT_FOUND;
+  if( offset >= info->compressedSize ) return 0;
+  size = std::min< PHYSFS_uint64 >( size, info->compressedSize - offset );
+  const PHYSFS_sint64 bytesRead = readAt( info->offset + offset, buf, size );
+  if( bytesRead < 0 ) throw PHYSFS_ERR_IO;
+  if( PHYSFS_uint64( bytesRead ) < size ) throw PHYSFS_ERR_PAST_EOF;
+  return size;
+}
+
+PHYSFS_uint64 BFSArchive::exportFile( const char* filename, int fd )
+{
+  const BFSFile::Info* info = find( filename );
+  if( !info ) throw PHYSFS_ERR_NOT_FOUND;
+  if( !info->compressed && m_mapping.isOpen() )
+  {
+    const PHYSFS_uint64 size = std::min( info->compressedSize, info->uncompressedSize );
+    if( std::uint64_t( info->offset ) + size > m_mapping.size() ) throw PHYSFS_ERR_PAST_EOF;
+    if( !copyToFd( m_mapping.descriptor(), info->offset, m_mapping.data() + info->offset, size, fd ) ) throw PHYSFS_ERR_IO;
+    return size;
+  }
+
+  // Read like any open file, through a buffer that's page aligned and large enough to keep the number of writes down
+  enum : std::size_t
   {
-    cb( callbackdata, origdir, entry.first.c_str() );
+    EXPORT_BUFFER_SIZE = 1024 * 1024,
+    EXPORT_BUFFER_ALIGNMENT = 4096,
+  };
+  std::unique_ptr< BFSFile > file( openRead( filename ) );
+  if( !file ) throw PHYSFS_getLastErrorCode();
+  std::vector< char > storage( std::min< std::size_t >( EXPORT_BUFFER_SIZE, file->size() ) + EXPORT_BUFFER_ALIGNMENT );
+  void* aligned = storage.data();
+  std::size_t space = storage.size();
+  char* const buffer = static_cast< char* >( std::align( EXPORT_BUFFER_ALIGNMENT, storage.size() - EXPORT_BUFFER_ALIGNMENT, aligned, space ) );
+  PHYSFS_uint64 total = 0;
+  while( total < PHYSFS_uint64( file->size() ) )
+  {
+    const PHYSFS_uint64 chunkSize = std::min< PHYSFS_uint64 >( EXPORT_BUFFER_SIZE, file->size() - total );
+    const PHYSFS_sint64 bytesRead = file->read( buffer, chunkSize );
+    if( bytesRead < 0 ) throw PHYSFS_getLastErrorCode();
+    if( !writeToFd( fd, buffer, bytesRead ) ) throw PHYSFS_ERR_IO;
+    total += bytesRead;
+    // Uncompressed files may store less than their size
+    if( PHYSFS_uint64( bytesRead ) < chunkSize ) break;
   }
-  for( auto& entry : dir->files )
+  return total;
+}
+
+BFSArchive::Stats BFSArchive::getStats() const
+{
+  Stats stats;
+  stats.stringCount = m_stringPool.size();
+  stats.decodedStringCount = m_stringPool.decodedCount();
+  stats.entryCache = m_entryCache ? m_entryCache->getStats() : EntryCache::Stats{};
+  stats.prefetch = m_prefetcher ? m_prefetcher->getStats() : Prefetcher::Stats{};
+  stats.inflaterPool = m_inflaterPool ? m_inflaterPool->getStats() : InflaterPool::Stats{};
+  stats.streamStates = m_streamTracker ? m_streamTracker->getStats() : StreamTracker::Stats{};
   {
-    cb( callbackdata, origdir, entry.first.c_str() );
+    std::lock_guard< std::mutex > lock( m_accessIndexMutex );
+    stats.accessIndexFiles = m_accessIndex ? m_accessIndex->fileCount() : 0;
+    stats.accessIndexPoints = m_accessIndex ? m_accessIndex->pointCount() : 0;
   }
+  stats.parallelInflates = m_parallelInflates;
+  return stats;
 }
 
-BFSFile* BFSArchive::openRead( const std::string& filename )
+void BFSArchive::enumerateFiles( const char* dirname, PHYSFS_EnumFilesCallback cb, const char* origdir, void* callbackdata )
 {
-  BFSFile::Info* info = lookup( filename ).second;
+  static const PathIndex::Type directory = PathIndex::TYPE_DIRECTORY;
+  const PathIndex& pathIndex = index();
+  const PathIndex::Entry* dir = pathIndex.find( dirname, &directory );
+  if( !dir ) return;
+  for( std::uint32_t i = 0; i < dir->childCount; ++i )
+  {
+    cb( callbackdata, origdir, pathIndex.baseName( pathIndex.child( *dir, i ) ) );
+  }
+}
+
+const BFSFile::Info* BFSArchive::find( const char* filename )
+{
+  if( !m_hashTable.empty() ) return findInHashTable( filename );
+  static const PathIndex::Type file = PathIndex::TYPE_FILE;
+  const PathIndex::Entry* entry = m_index.find( filename, &file );
+  return entry ? &entry->info : nullptr;
+}
+
+BFSFile* BFSArchive::openRead( const char* filename )
+{
+  const BFSFile::Info* info = find( filename );
   if( !info )
   {
     PHYSFS_setErrorCode( PHYSFS_ERR_NOT_FOUND );
     return nullptr;
   }
-  return info->compressed ? new BFSFileCompressed( *this, info ) : new BFSFile( *this, info );
+  if( !info->compressed ) return new BFSFile( *this, info );
+  if( m_entryCache ) return openCached( info );
+  return openCompressed( info );
 }
 
-bool BFSArchive::stat( const std::string& filename, PHYSFS_Stat& stat )
+BFSFile* BFSArchive::openCompressed( const BFSFile::Info* info )
 {
-  stat.modtime = -1;
-  stat.createtime = -1;
-  stat.accesstime = -1;
-  stat.readonly = 1;
-  auto entry = lookup( filename );
-  if( entry.first )
+  if( m_options.readaheadMinSize > 0 && info->uncompressedSize >= m_options.readaheadMinSize )
   {
-    stat.filesize = -1;
-    stat.filetype = PHYSFS_FILETYPE_DIRECTORY;
-    return true;
+    return new BFSFileReadahead( *this, info, m_options.readaheadDistance );
   }
-  if( entry.second )
+  return new BFSFileCompressed( *this, info );
+}
+
+BFSFile* BFSArchive::openCached( const BFSFile::Info* info )
+{
+  bool admit;
+  EntryCache::Data data = m_entryCache->find( info->offset, info->uncompressedSize, admit );
+  if( data ) return new BFSFileMemory( info, std::move( data ) );
+
+  if( !admit ) return openCompressed( info );
+  std::unique_ptr< BFSFileCompressed > file( new BFSFileCompressed( *this, info ) );
+
+  // Decompress it all right away, so the cache and this handle can share the result
+  std::shared_ptr< std::vector< char > > contents = readAll( *file );
+  if( !contents )
   {
-    stat.filesize = entry.second->uncompressedSize;
-    stat.filetype = PHYSFS_FILETYPE_REGULAR;
-    return true;
+    // Leave the error to reads of the file
+    if( !file->seek( 0 ) ) return nullptr;
+    return file.release();
   }
-  return false;
+  m_entryCache->insert( info->offset, contents );
+  return new BFSFileMemory( info, std::move( contents ) );
+}
+
+bool BFSArchive::prefetch( const char* filename, int priority )
+{
+  if( !m_entryCache ) throw PHYSFS_ERR_UNSUPPORTED;
+  const BFSFile::Info* info = find( filename );
+  if( !info ) return false;
+  if( !info->compressed || m_entryCache->contains( info->offset ) ) return true;
+  m_prefetcher->enqueue( info, priority );
+  return true;
 }
 
-std::pair< BFSArchive::Directory*, BFSFile::Info* > BFSArchive::lookup( std::string filename )
+void BFSArchive::cancelPrefetch( const char* filename )
 {
-  Directory* targetDir = &m_root;
-  if( !filename.empty() && filename != "/" ) // root dir
+  if( !m_prefetcher ) return;
+  if( !filename )
   {
-    std::string::size_type slashPos;
-    while( ( slashPos = filename.find( '/' ) ) != std::string::npos )
-    {
-      const std::string dir = filename.substr( 0, slashPos );
-      filename.erase( 0, slashPos + 1 );
-      auto entry = targetDir->dirs.find( dir );
-      // missing directory
-      if( entry == targetDir->dirs.end() ) return std::make_pair( nullptr, nullptr );
-      targetDir = entry->second.get();
-    }
+    m_prefetcher->cancelAll();
+    return;
   }
-  if( filename.empty() ) // trailing slash
+  const BFSFile::Info* info = find( filename );
+  if( info ) m_prefetcher->cancel( info );
+}
+
+void BFSArchive::prefetchLoad( const BFSFile::Info& info )
+{
+  if( m_entryCache->contains( info.offset ) ) return;
+  try
   {
-    return std::make_pair( targetDir, nullptr );
+    // Decompress the same way opened files do
+    BFSFileCompressed file( *this, &info );
+    std::shared_ptr< std::vector< char > > contents = readAll( file );
+    // Failures are left for opening the file to report
+    if( contents ) m_entryCache->insert( info.offset, std::move( contents ), true );
   }
-  std::pair< Directory*, BFSFile::Info* > result{ nullptr, nullptr };
-  // Look for Directory
+  catch( ... )
+  {
+  }
+}
+
+void BFSArchive::readBatch( BatchRead* reads, std::size_t count )
+{
+  // Files less than MAX_GAP apart are read together, up to MAX_READ_SIZE bytes at once
+  enum { MAX_GAP = 64 * 1024, MAX_READ_SIZE = 4 * 1024 * 1024 };
+
+  struct Pending
   {
-    auto entry = targetDir->dirs.find( filename );
-    if( entry != targetDir->dirs.end( ) )
+    const BFSFile::Info* info;
+    BatchRead* read;
+    bool admitToCache;
+  };
+  std::vector< Pending > pending;
+  pending.reserve( count );
+  for( std::size_t i = 0; i < count; ++i )
+  {
+    BatchRead& read = reads[ i ];
+    const BFSFile::Info* info = find( read.path );
+    if( !info )
     {
-      result.first = entry->second.get( );
+      read.result = -1;
+      read.error = PHYSFS_ERR_NOT_FOUND;
+      continue;
     }
+    bool admit = false;
+    if( m_entryCache && info->compressed )
+    {
+      EntryCache::Data data = m_entryCache->find( info->offset, info->uncompressedSize, admit );
+      if( data )
+      {
+        read.result = std::min< PHYSFS_uint64 >( read.size, data->size() );
+        if( read.result > 0 ) std::memcpy( read.buffer, data->data(), read.result );
+        read.error = PHYSFS_ERR_OK;
+        continue;
+      }
+    }
+    pending.push_back( { info, &read, admit } );
   }
-  // Look for File
+  std::sort( pending.begin(), pending.end(), []( const Pending& lhs, const Pending& rhs ) { return lhs.info->offset < rhs.info->offset; } );
+
+  std::vector< char > buffer;
+  for( std::size_t begin = 0, end; begin < pending.size(); begin = end )
   {
-    auto entry = targetDir->files.find( filename );
-    if( entry != targetDir->files.end( ) )
+    const PHYSFS_uint64 start = pending[ begin ].info->offset;
+    PHYSFS_uint64 stop = start + pending[ begin ].info->compressedSize;
+    for( end = begin + 1; end < pending.size(); ++end )
     {
-      result.second = &entry->second;
+      const BFSFile::Info& next = *pending[ end ].info;
+      const PHYSFS_uint64 nextStop = std::max< PHYSFS_uint64 >( stop, next.offset + PHYSFS_uint64( next.compressedSize ) );
+      if( next.offset > stop + MAX_GAP || nextStop - start > MAX_READ_SIZE ) break;
+      stop = nextStop;
     }
+
+    const char* data;
+    PHYSFS_sint64 available;
+    if( m_mapping.isOpen() )
+    {
+      data = m_mapping.data() + std::min< PHYSFS_uint64 >( start, m_mapping.size() );
+      available = start < m_mapping.size() ? std::min< PHYSFS_uint64 >( stop, m_mapping.size() ) - start : 0;
+    }
+    else
+    {
+      buffer.resize( stop - start );
+      available = readAt( start, buffer.data(), buffer.size() );
+      data = buffer.data();
+    }
+    for( std::size_t i = begin; i < end; ++i )
+    {
+      const Pending& file = pending[ i ];
+      if( available < 0 || file.info->offset + PHYSFS_uint64( file.info->compressedSize ) > start + available )
+      {
+        file.read->result = -1;
+        file.read->error = available < 0 ? PHYSFS_ERR_IO : PHYSFS_ERR_PAST_EOF;
+        continue;
+      }
+      extract( *file.info, data + ( file.info->offset - start ), *file.read, file.admitToCache );
+    }
+  }
+}
+
+void BFSArchive::extract( const BFSFile::Info& info, const char* data, BatchRead& read, bool admitToCache )
+{
+  read.error = PHYSFS_ERR_OK;
+  if( !info.compressed )
+  {
+    read.result = std::min< PHYSFS_uint64 >( read.size, std::min( info.compressedSize, info.uncompressedSize ) );
+    if( read.result > 0 ) std::memcpy( read.buffer, data, read.result );
+    return;
+  }
+
+  // Decompress straight into the destination if it takes the whole file
+  std::shared_ptr< std::vector< char > > contents;
+  char* out = read.buffer;
+  if( read.size < info.uncompressedSize || admitToCache )
+  {
+    contents = std::make_shared< std::vector< char > >( info.uncompressedSize );
+    out = contents->data();
+  }
+  if( !inflateWhole( info, data, out ) )
+  {
+    read.result = -1;
+    read.error = PHYSFS_ERR_CORRUPT;
+    return;
+  }
+  read.result = std::min< PHYSFS_uint64 >( read.size, info.uncompressedSize );
+  if( contents )
+  {
+    if( read.result > 0 ) std::memcpy( read.buffer, contents->data(), read.result );
+    if( admitToCache ) m_entryCache->insert( info.offset, std::move( contents ) );
+  }
+}
+
+bool BFSArchive::stat( const char* filename, PHYSFS_Stat& stat )
+{
+  stat.modtime = -1;
+  stat.createtime = -1;
+  stat.accesstime = -1;
+  stat.readonly = 1;
+  if( !m_hashTable.empty() )
+  {
+    const BFSFile::Info* info = findInHashTable( filename );
+    if( info )
+    {
+      stat.filesize = info->uncompressedSize;
+      stat.filetype = PHYSFS_FILETYPE_REGULAR;
+      return true;
+    }
+    // Either a directory or nothing, which doesn't take the whole path index to tell
+    if( !isDirectory( filename ) ) return false;
+    stat.filesize = -1;
+    stat.filetype = PHYSFS_FILETYPE_DIRECTORY;
+    return true;
+  }
+  const PathIndex::Entry* entry = index().find( filename );
+  if( !entry ) return false;
+  if( entry->type == PathIndex::TYPE_DIRECTORY )
+  {
+    stat.filesize = -1;
+    stat.filetype = PHYSFS_FILETYPE_DIRECTORY;
+  }
+  else
+  {
+    stat.filesize = entry->info.uncompressedSize;
+    stat.filetype = PHYSFS_FILETYPE_REGULAR;
   }
-  return result;
+  return true;
 }
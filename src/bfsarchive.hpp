@@ -3,45 +3,268 @@
 #include <physfs.h>
 
 #include <string>
-#include <map>
-#include <cstdint>
+#include <vector>
 #include <memory>
-#include <utility>
+#include <mutex>
+#include <unordered_set>
+#include <atomic>
+#include <cstdint>
 
 #include "bfsfile.hpp"
+#include "bfsformat.hpp"
+#include "pathindex.hpp"
+#include "stringpool.hpp"
+#include "indexcache.hpp"
+#include "accessindex.hpp"
+#include "entrycache.hpp"
+#include "mappedfile.hpp"
+#include "positionalfile.hpp"
+#include "prefetcher.hpp"
+#include "inflaterpool.hpp"
+#include "streamtracker.hpp"
 
 class BFSFile;
 
+/**
+@brief A mounted BFS archive
+
+All public methods may be called concurrently: after mounting, lookups only read immutable data, except for
+the lazily built path index (built once, guarded by std::call_once), the memoized string pool and the entry cache,
+which synchronize internally. Archive i/o goes through readAt(), which reads the mapping or the archive file at a position,
+and only locks if the archive is not a file of its own.
+Each open BFSFile must only be used by one thread at a time, like any PHYSFS_File.
+**/
 class BFSArchive
 {
 public:
-  BFSArchive( PHYSFS_Io& io );
+  struct Options
+  {
+    /**
+    Answer openRead() and stat() of files through the hash table in the archive header instead of indexing all paths when mounting.
+    The path index is then only built once it's needed, i.e. for enumerateFiles(); stat() of anything that's not a file only decodes the directory strings.
+    Falls back to indexing on mount if the hash table does not match the archive's contents, as far as checking one file at each end of every bucket tells.
+    **/
+    bool useHashTable = false;
+    /// Map the path index from a cache file if it is up to date, otherwise write one once the index has been built
+    bool useIndexCache = false;
+    /// Where to store index cache files, alongside the archive if empty
+    std::string indexCacheDir;
+    /// Threads to decode the string pool on, 0 for one per core
+    unsigned int stringPoolThreads = 1;
+    /// Record the decompression state of compressed files every this many output bytes, so seeks can resume from there; 0 disables
+    std::uint32_t checkpointInterval = 512 * 1024;
+    /// Memory each open compressed file may spend on checkpoints
+    std::uint64_t checkpointBudget = 4 * 1024 * 1024;
+    /// Bytes of decompressed files to keep in memory for reopening, 0 disables the cache
+    std::uint64_t entryCacheBudget = 0;
+    /// Larger files are not cached
+    std::uint64_t entryCacheMaxEntrySize = 256 * 1024;
+    /// Files are cached once they have been opened this many times
+    unsigned int entryCacheMinOpens = 2;
+    /// Background threads loading files for prefetch(), started once it's first called
+    unsigned int prefetchThreads = 1;
+    /// Compressed files at least this large are decompressed ahead of the reader on a thread of their own; 0 disables
+    std::uint64_t readaheadMinSize = 0;
+    /// Bytes to decompress ahead of the reader
+    std::uint32_t readaheadDistance = 1024 * 1024;
+    /// Map the archive file into memory and read from there instead of through PhysFS, if it is a regular file.
+    /// The file must then not shrink while mounted, since reading pages beyond its end raises SIGBUS.
+    bool useMemoryMap = true;
+    /// Bytes of decompression state and input buffers to keep for reuse by files opened later, 0 disables the pool
+    std::uint64_t inflaterPoolBudget = 1024 * 1024;
+    /// Bytes of decompression state all open compressed files may hold together; beyond that, the least recently read ones drop theirs. 0 for no limit
+    std::uint64_t streamStateBudget = 0;
+    /// Open compressed files that haven't been read for this many milliseconds drop their decompression state; 0 never
+    std::uint32_t streamIdleTimeout = 0;
+    /// Decompress large files in parallel at the points recorded by buildAccessIndex(), loading them from a sidecar file if it is up to date
+    bool useAccessIndex = false;
+    /// Threads to decompress a single file on, 0 for one per core
+    unsigned int parallelInflateThreads = 0;
+  };
+
+  struct BatchRead
+  {
+    /// File to read, relative to the archive root
+    const char* path;
+    /// Receives up to size bytes from the start of the file
+    char* buffer;
+    PHYSFS_uint64 size;
+    /// Bytes read, or -1 on error
+    PHYSFS_sint64 result;
+    PHYSFS_ErrorCode error;
+  };
+
+  struct Stats
+  {
+    /// Strings in the string pool; 0 if the path index was loaded from cache and the pool never needed
+    unsigned int stringCount;
+    /// Strings decoded so far
+    unsigned int decodedStringCount;
+    EntryCache::Stats entryCache;
+    Prefetcher::Stats prefetch;
+    InflaterPool::Stats inflaterPool;
+    StreamTracker::Stats streamStates;
+    /// Files with access points, and their number
+    std::uint64_t accessIndexFiles;
+    std::uint64_t accessIndexPoints;
+    /// Files decompressed in parallel at their access points
+    std::uint64_t parallelInflates;
+  };
+
+public:
+  /**
+  @param name Filename of the archive, used for locating the index cache; may be nullptr.
+  **/
+  BFSArchive( PHYSFS_Io& io, const char* name, const Options& options );
   ~BFSArchive();
   BFSArchive( const BFSArchive& ) = delete;
   BFSArchive( BFSArchive&& ) = delete;
   BFSArchive& operator=( const BFSArchive& ) = delete;
   BFSArchive& operator=( BFSArchive&& ) = delete;
 
-  void enumerateFiles( std::string dirname, PHYSFS_EnumFilesCallback cb, const char* origdir, void* callbackdata );
-  BFSFile* openRead( const std::string& filename );
-  bool stat( const std::string& filename, PHYSFS_Stat& stat );
+  void enumerateFiles( const char* dirname, PHYSFS_EnumFilesCallback cb, const char* origdir, void* callbackdata );
+  BFSFile* openRead( const char* filename );
+  /**
+  @brief Read many files at once, in the order they're stored in.
+  Files that are close together are read with one read of the archive, and decompressed as each of these arrives.
+  The outcome of each read is stored in its result and error members.
+  **/
+  void readBatch( BatchRead* reads, std::size_t count );
+  /**
+  @brief Decompress a file into the entry cache on a background thread, so opening it later needs no i/o or decompression.
+  Stored files can be read directly and are not prefetched.
+  @param priority Files of higher priority are loaded first
+  @throw PHYSFS_ERR_UNSUPPORTED if the entry cache is disabled
+  @return false if there is no such file
+  **/
+  bool prefetch( const char* filename, int priority );
+  /// Stop a file from being prefetched, unless that's already underway; nullptr cancels all
+  void cancelPrefetch( const char* filename );
+  bool stat( const char* filename, PHYSFS_Stat& stat );
+  /**
+  @brief Look up a file's data as stored in the archive, i.e. still compressed if it is, for passing it on without decompressing.
+  @param out_data Set to the stored data within the mapped archive, which stays valid as long as the archive; nullptr if not mapped
+  @throw PHYSFS_ERR_PAST_EOF if the data extends past the end of the mapped archive
+  @return nullptr if there is no such file
+  **/
+  const BFSFile::Info* findRaw( const char* filename, const char*& out_data );
+  /**
+  @brief Copy up to size bytes of a file's data as stored in the archive, starting offset bytes in, into buf.
+  @throw PHYSFS_ERR_NOT_FOUND if there is no such file
+  @throw PHYSFS_ERR_IO or PHYSFS_ERR_PAST_EOF if the data could not be read
+  @return Bytes read, the lesser of size and what's stored beyond offset
+  **/
+  PHYSFS_uint64 readRaw( const char* filename, PHYSFS_uint64 offset, char buf[], PHYSFS_uint64 size );
+  /**
+  @brief Write a file's contents to a file descriptor at its current position, e.g. to copy it out of the archive.
+  Uncompressed files of mapped archives are copied within the kernel where possible; everything else is read in large chunks.
+  @throw PHYSFS_ERR_NOT_FOUND if there is no such file
+  @throw PHYSFS_ERR_IO if writing failed, or the error of reading the file
+  @return Bytes written, the size of the file
+  **/
+  PHYSFS_uint64 exportFile( const char* filename, int fd );
+  /**
+  @brief Record access points of large compressed files and store them in the access index sidecar file, then decompress those files in parallel.
+  Decompresses each such file once; may be called while files are being read.
+  @param minSize Compressed files of at least this many decompressed bytes are indexed
+  @param spacing Minimum decompressed bytes between access points
+  @throw PHYSFS_ERR_UNSUPPORTED if the access index is disabled or the archive is not a file in the native file system
+  @throw PHYSFS_ERR_IO if the sidecar file could not be written; the index is used nonetheless
+  **/
+  void buildAccessIndex( std::uint64_t minSize, std::uint32_t spacing );
+  /**
+  @brief Decompress a whole file from its compressed data, in parallel if it has access points.
+  @return false if the data is corrupt
+  **/
+  bool inflateWhole( const BFSFile::Info& info, const char* data, char* out );
 
-  PHYSFS_Io& getIO() { return m_io; }
+  /**
+  @brief Read from the archive at the given absolute position; safe to call concurrently.
+  @return Bytes read, which is less than len at the end of the archive, or -1 on error.
+  **/
+  PHYSFS_sint64 readAt( PHYSFS_uint64 offset, char buf[], PHYSFS_uint64 len );
+  /// Whole archive file, if mapped; otherwise nullptr
+  const char* getMapping() const { return m_mapping.data(); }
+  std::size_t getMappingSize() const { return m_mapping.size(); }
+  const Options& getOptions() const { return m_options; }
+  /// Where compressed files borrow their decompression state from; nullptr if disabled
+  InflaterPool* getInflaterPool() const { return m_inflaterPool.get(); }
+  /// Where compressed files report the size of their decompression state; nullptr if not limited
+  StreamTracker* getStreamTracker() const { return m_streamTracker.get(); }
+  Stats getStats() const;
 
 private:
-
-  struct Directory
+  struct FileEntry
   {
-    std::map< std::string, std::unique_ptr< Directory > > dirs;
-    std::map< std::string, BFSFile::Info > files;
+    BFSFile::Info info;
+    std::uint16_t dirStringIndex;
+    std::uint16_t fileStringIndex;
+    std::uint32_t compressionType;
 
-    void insert( std::string&& filename, BFSFile::Info&& file );
+    bool supported() const { return compressionType == 4 || compressionType == 5; }
   };
 
 private:
-  std::pair< Directory*, BFSFile::Info* > lookup( std::string filename );
+  bool loadIndexCache( const char* name, const std::vector< char >& metadata, const Options& options );
+  void loadAccessIndex( const char* name, const std::vector< char >& metadata, const Options& options );
+  /// Maps the archive file if it's the one we've been reading the metadata from
+  void mapArchive( const char* name, const std::vector< char >& metadata );
+  /// Opens the archive file for positional reads if it's the one we've been reading the metadata from
+  void openArchiveFile( const char* name, const std::vector< char >& metadata );
+  bool hashTableMatches();
+  const BFSFile::Info* findInHashTable( const char* filename );
+  /// Whether path is a directory, by the directory strings of the files only; for stat() in hash table mode
+  bool isDirectory( const char* path );
+  /// Looks up a file via hash table or path index, whichever is used for lookups
+  const BFSFile::Info* find( const char* filename );
+  /// Reads a file from the given copy of its data in the archive for readBatch()
+  void extract( const BFSFile::Info& info, const char* data, BatchRead& read, bool admitToCache );
+  /// openRead() of a compressed file through the entry cache
+  BFSFile* openCached( const BFSFile::Info* info );
+  /// openRead() of a compressed file that's not cached, with readahead if enabled for its size
+  BFSFile* openCompressed( const BFSFile::Info* info );
+  /// Loads a file into the entry cache for the prefetcher
+  void prefetchLoad( const BFSFile::Info& info );
+  /// Builds the path index, unless already done
+  const PathIndex& index();
+  void buildIndex();
 
 private:
   PHYSFS_Io& m_io;
-  Directory m_root;
+  /// Guards the position of m_io, which all open files read through unless the archive is mapped or opened as m_file
+  std::mutex m_ioMutex;
+  /// The archive file, if mapped
+  MappedFile m_mapping;
+  /// The archive file, if not mapped but a file of its own
+  PositionalFile m_file;
+  StringPool m_stringPool;
+  std::vector< FileEntry > m_files;
+  /// Header hash table, empty unless used for lookups
+  std::vector< BFSHashEntry > m_hashTable;
+  const Options m_options;
+  /// Whether the index was built or loaded from cache; set while mounting or within index()
+  bool m_indexBuilt = false;
+  std::once_flag m_indexOnce;
+  /// Paths of all directories, built by isDirectory() on first use
+  std::once_flag m_directoriesOnce;
+  std::unordered_set< std::string > m_directories;
+  PathIndex m_index;
+  /// Where to store the index once built, if enabled
+  std::unique_ptr< IndexCache > m_indexCache;
+  IndexCache::Key m_indexCacheKey;
+  /// Sidecar file of the access index, empty unless enabled for an archive in the native file system
+  std::string m_accessIndexName;
+  IndexCache::Key m_accessIndexKey;
+  /// Guards m_accessIndex, which buildAccessIndex() replaces while files may be using the old one
+  mutable std::mutex m_accessIndexMutex;
+  std::shared_ptr< const AccessIndex > m_accessIndex;
+  std::atomic< std::uint64_t > m_parallelInflates;
+  /// Recycled decompression state, if enabled; outlives the files using it
+  std::unique_ptr< InflaterPool > m_inflaterPool;
+  /// Limits the decompression state of open files, if enabled; outlives the files using it
+  std::unique_ptr< StreamTracker > m_streamTracker;
+  /// Decompressed files, if enabled
+  std::unique_ptr< EntryCache > m_entryCache;
+  /// Fills the entry cache on request, if there is one
+  std::unique_ptr< Prefetcher > m_prefetcher;
 };
@@ -2,16 +2,44 @@
 #include "bfsarchiver.h"
 #include "bfsarchive.hpp"
 #include "bfsfile.hpp"
+#include "fdcopy.hpp"
 
 #include <physfs.h>
 
-extern "C" static void* openArchive( PHYSFS_Io* io, const char* name, int forWrite )
+#include <mutex>
+#include <map>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+/// Options for archives mounted from now on
+static BFSArchive::Options s_options;
+static std::mutex s_optionsMutex;
+
+static BFSArchive::Options currentOptions()
+{
+  std::lock_guard< std::mutex > lock( s_optionsMutex );
+  return s_options;
+}
+
+/// Open archives by the name they were mounted with, for the per-archive API; batch reads keep them alive until done
+static std::map< std::string, std::shared_ptr< BFSArchive > > s_archives;
+static std::mutex s_archivesMutex;
+
+static void* openArchive( PHYSFS_Io* io, const char* name, int forWrite )
 {
-  ( void )name;
   if( forWrite ) return nullptr;
   try
   {
-    BFSArchive* archive = new BFSArchive( *io );
+    BFSArchive* archive = new BFSArchive( *io, name, currentOptions() );
+    if( name )
+    {
+      std::lock_guard< std::mutex > lock( s_archivesMutex );
+      auto inserted = s_archives.emplace( name, nullptr );
+      if( inserted.second ) inserted.first->second.reset( archive );
+    }
     return archive;
   }
   catch( PHYSFS_ErrorCode code )
@@ -21,12 +49,26 @@ extern "C" static void* openArchive( PHYSFS_Io* io, const char* name, int forWri
   }
 }
 
-extern "C" static void closeArchive( void* opaque )
+static void closeArchive( void* opaque )
 {
   try
   {
     BFSArchive* archive = reinterpret_cast< BFSArchive* >( opaque );
-    delete archive;
+    std::shared_ptr< BFSArchive > registered;
+    {
+      std::lock_guard< std::mutex > lock( s_archivesMutex );
+      for( auto it = s_archives.begin(); it != s_archives.end(); ++it )
+      {
+        if( it->second.get() == archive )
+        {
+          registered = std::move( it->second );
+          s_archives.erase( it );
+          break;
+        }
+      }
+    }
+    // Registered archives are deleted with the last reference, which may be held by a batch read
+    if( !registered ) delete archive;
   }
   catch( PHYSFS_ErrorCode code )
   {
@@ -34,7 +76,7 @@ extern "C" static void closeArchive( void* opaque )
   }
 }
 
-extern "C" static void enumerateFiles( void* opaque, const char* dirname, PHYSFS_EnumFilesCallback cb, const char* origdir, void* callbackdata )
+static void enumerateFiles( void* opaque, const char* dirname, PHYSFS_EnumFilesCallback cb, const char* origdir, void* callbackdata )
 {
   try
   {
@@ -47,7 +89,7 @@ extern "C" static void enumerateFiles( void* opaque, const char* dirname, PHYSFS
   }
 }
 
-extern "C" static PHYSFS_Io* openRead( void* opaque, const char* filename )
+static PHYSFS_Io* openRead( void* opaque, const char* filename )
 {
   try
   {
@@ -63,7 +105,7 @@ extern "C" static PHYSFS_Io* openRead( void* opaque, const char* filename )
 }
 
 // openWrite/openAppend are unsupported
-extern "C" static PHYSFS_Io* unsupportedOpen( void* opaque, const char* filename )
+static PHYSFS_Io* unsupportedOpen( void* opaque, const char* filename )
 {
   ( void )opaque;
   ( void )filename;
@@ -72,7 +114,7 @@ extern "C" static PHYSFS_Io* unsupportedOpen( void* opaque, const char* filename
 }
 
 // mkdir/remove are unsupported
-extern "C" static int unsupportedOperation( void* opaque, const char* filename )
+static int unsupportedOperation( void* opaque, const char* filename )
 {
   ( void )opaque;
   ( void )filename;
@@ -80,7 +122,7 @@ extern "C" static int unsupportedOperation( void* opaque, const char* filename )
   return -1;
 }
 
-extern "C" static int stat( void* opaque, const char* filename, PHYSFS_Stat* stat )
+static int stat( void* opaque, const char* filename, PHYSFS_Stat* stat )
 {
   try
   {
@@ -119,3 +161,430 @@ extern "C" int registerBfsArchiver()
 {
   return PHYSFS_registerArchiver( &s_bfsArchiver );
 }
+
+extern "C" int setBfsMountMode( int mode )
+{
+  if( mode != BFS_MOUNT_INDEX && mode != BFS_MOUNT_HASH_TABLE )
+  {
+    PHYSFS_setErrorCode( PHYSFS_ERR_INVALID_ARGUMENT );
+    return 0;
+  }
+  std::lock_guard< std::mutex > lock( s_optionsMutex );
+  s_options.useHashTable = mode == BFS_MOUNT_HASH_TABLE;
+  return 1;
+}
+
+extern "C" int setBfsIndexCache( int enabled, const char* dir )
+{
+  std::lock_guard< std::mutex > lock( s_optionsMutex );
+  s_options.useIndexCache = enabled != 0;
+  s_options.indexCacheDir = dir ? dir : "";
+  return 1;
+}
+
+extern "C" int setBfsStringPoolThreads( unsigned int count )
+{
+  std::lock_guard< std::mutex > lock( s_optionsMutex );
+  s_options.stringPoolThreads = count;
+  return 1;
+}
+
+extern "C" int getBfsArchiveStats( const char* archive, BFSArchiveStats* stats )
+{
+  if( !archive || !stats )
+  {
+    PHYSFS_setErrorCode( PHYSFS_ERR_INVALID_ARGUMENT );
+    return 0;
+  }
+  std::lock_guard< std::mutex > lock( s_archivesMutex );
+  auto it = s_archives.find( archive );
+  if( it == s_archives.end() )
+  {
+    PHYSFS_setErrorCode( PHYSFS_ERR_NOT_MOUNTED );
+    return 0;
+  }
+  const BFSArchive::Stats archiveStats = it->second->getStats();
+  stats->stringCount = archiveStats.stringCount;
+  stats->decodedStringCount = archiveStats.decodedStringCount;
+  stats->entryCacheHits = archiveStats.entryCache.hits;
+  stats->entryCacheMisses = archiveStats.entryCache.misses;
+  stats->entryCacheEvictions = archiveStats.entryCache.evictions;
+  stats->entryCacheSize = archiveStats.entryCache.size;
+  stats->prefetchQueued = archiveStats.prefetch.queued;
+  stats->prefetchLoaded = archiveStats.prefetch.loaded;
+  stats->prefetchCancelled = archiveStats.prefetch.cancelled;
+  stats->prefetchUsed = archiveStats.entryCache.prefetchesUsed;
+  stats->prefetchWasted = archiveStats.entryCache.prefetchesWasted;
+  stats->inflaterPoolHits = archiveStats.inflaterPool.hits;
+  stats->inflaterPoolMisses = archiveStats.inflaterPool.misses;
+  stats->inflaterPoolSize = archiveStats.inflaterPool.size;
+  stats->streamStateFiles = archiveStats.streamStates.files;
+  stats->streamStateSize = archiveStats.streamStates.size;
+  stats->streamStateEvictions = archiveStats.streamStates.evictions;
+  stats->streamStateRebuilds = archiveStats.streamStates.rebuilds;
+  stats->accessIndexFiles = archiveStats.accessIndexFiles;
+  stats->accessIndexPoints = archiveStats.accessIndexPoints;
+  stats->parallelInflates = archiveStats.parallelInflates;
+  return 1;
+}
+
+extern "C" int setBfsSeekCheckpoints( unsigned int interval, unsigned long long budget )
+{
+  std::lock_guard< std::mutex > lock( s_optionsMutex );
+  s_options.checkpointInterval = interval;
+  s_options.checkpointBudget = budget;
+  return 1;
+}
+
+extern "C" int setBfsEntryCache( unsigned long long budget, unsigned long long maxEntrySize, unsigned int minOpens )
+{
+  std::lock_guard< std::mutex > lock( s_optionsMutex );
+  s_options.entryCacheBudget = budget;
+  s_options.entryCacheMaxEntrySize = maxEntrySize;
+  s_options.entryCacheMinOpens = minOpens;
+  return 1;
+}
+
+extern "C" int setBfsMemoryMap( int enabled )
+{
+  std::lock_guard< std::mutex > lock( s_optionsMutex );
+  s_options.useMemoryMap = enabled != 0;
+  return 1;
+}
+
+extern "C" int setBfsReadahead( unsigned long long minFileSize, unsigned int distance )
+{
+  if( distance == 0 )
+  {
+    PHYSFS_setErrorCode( PHYSFS_ERR_INVALID_ARGUMENT );
+    return 0;
+  }
+  std::lock_guard< std::mutex > lock( s_optionsMutex );
+  s_options.readaheadMinSize = minFileSize;
+  s_options.readaheadDistance = distance;
+  return 1;
+}
+
+extern "C" int setBfsInflaterPool( unsigned long long budget )
+{
+  std::lock_guard< std::mutex > lock( s_optionsMutex );
+  s_options.inflaterPoolBudget = budget;
+  return 1;
+}
+
+extern "C" int setBfsStreamStateLimit( unsigned long long budget, unsigned int idleTimeout )
+{
+  std::lock_guard< std::mutex > lock( s_optionsMutex );
+  s_options.streamStateBudget = budget;
+  s_options.streamIdleTimeout = idleTimeout;
+  return 1;
+}
+
+extern "C" int setBfsParallelInflate( int enabled, unsigned int threads )
+{
+  std::lock_guard< std::mutex > lock( s_optionsMutex );
+  s_options.useAccessIndex = enabled != 0;
+  s_options.parallelInflateThreads = threads;
+  return 1;
+}
+
+extern "C" int buildBfsAccessIndex( const char* archive, unsigned long long minFileSize, unsigned int spacing )
+{
+  if( !archive )
+  {
+    PHYSFS_setErrorCode( PHYSFS_ERR_INVALID_ARGUMENT );
+    return 0;
+  }
+  std::shared_ptr< BFSArchive > bfsArchive;
+  {
+    std::lock_guard< std::mutex > lock( s_archivesMutex );
+    auto it = s_archives.find( archive );
+    if( it == s_archives.end() )
+    {
+      PHYSFS_setErrorCode( PHYSFS_ERR_NOT_MOUNTED );
+      return 0;
+    }
+    bfsArchive = it->second;
+  }
+  // Takes a while, so don't hold up other archives
+  try
+  {
+    bfsArchive->buildAccessIndex( minFileSize, spacing );
+  }
+  catch( PHYSFS_ErrorCode code )
+  {
+    PHYSFS_setErrorCode( code );
+    return 0;
+  }
+  return 1;
+}
+
+/// Finds the mounted BFS archive a file would be read from and the file's path within it
+static std::shared_ptr< BFSArchive > findArchive( const char* path, std::string& out_archivePath )
+{
+  const char* realDir = PHYSFS_getRealDir( path );
+  if( !realDir ) return nullptr;
+  std::shared_ptr< BFSArchive > archive;
+  {
+    std::lock_guard< std::mutex > lock( s_archivesMutex );
+    auto it = s_archives.find( realDir );
+    if( it == s_archives.end() ) return nullptr;
+    archive = it->second;
+  }
+  // Strip the mount point, which is of the form "/" or "/dir/"
+  const char* mountPoint = PHYSFS_getMountPoint( realDir );
+  if( !mountPoint ) return nullptr;
+  while( *path == '/' ) ++path;
+  while( *mountPoint == '/' ) ++mountPoint;
+  const std::size_t mountPointLength = std::strlen( mountPoint );
+  if( std::strncmp( path, mountPoint, mountPointLength ) != 0 ) return nullptr;
+  out_archivePath = path + mountPointLength;
+  return archive;
+}
+
+/// Reads a file that's not in a BFS archive the usual way
+static void readFile( BFSBatchRead& read )
+{
+  PHYSFS_File* file = PHYSFS_openRead( read.path );
+  if( !file )
+  {
+    read.bytesRead = -1;
+    read.errorCode = PHYSFS_getLastErrorCode();
+    return;
+  }
+  read.bytesRead = PHYSFS_readBytes( file, read.buffer, read.bufferSize );
+  read.errorCode = read.bytesRead < 0 ? PHYSFS_getLastErrorCode() : PHYSFS_ERR_OK;
+  PHYSFS_close( file );
+}
+
+extern "C" int readBfsFiles( BFSBatchRead* reads, unsigned int count )
+{
+  if( !reads && count > 0 )
+  {
+    PHYSFS_setErrorCode( PHYSFS_ERR_INVALID_ARGUMENT );
+    return 0;
+  }
+  struct Batch
+  {
+    std::shared_ptr< BFSArchive > archive;
+    std::vector< std::string > paths;
+    std::vector< BFSArchive::BatchRead > reads;
+    std::vector< BFSBatchRead* > targets;
+  };
+  std::vector< Batch > batches;
+  std::vector< BFSBatchRead* > others;
+  std::string archivePath;
+  for( unsigned int i = 0; i < count; ++i )
+  {
+    BFSBatchRead& read = reads[ i ];
+    std::shared_ptr< BFSArchive > archive = read.path ? findArchive( read.path, archivePath ) : nullptr;
+    if( !archive )
+    {
+      others.push_back( &read );
+      continue;
+    }
+    auto batch = std::find_if( batches.begin(), batches.end(), [ &archive ]( const Batch& batch ) { return batch.archive == archive; } );
+    if( batch == batches.end() )
+    {
+      batches.push_back( Batch{ archive, {}, {}, {} } );
+      batch = batches.end() - 1;
+    }
+    batch->paths.push_back( archivePath );
+    batch->reads.push_back( { nullptr, static_cast< char* >( read.buffer ), read.bufferSize, -1, PHYSFS_ERR_OK } );
+    batch->targets.push_back( &read );
+  }
+
+  bool success = true;
+  for( Batch& batch : batches )
+  {
+    // Paths are only set now that they no longer move
+    for( std::size_t i = 0; i < batch.reads.size(); ++i ) batch.reads[ i ].path = batch.paths[ i ].c_str();
+    try
+    {
+      batch.archive->readBatch( batch.reads.data(), batch.reads.size() );
+    }
+    catch( PHYSFS_ErrorCode code )
+    {
+      for( auto& read : batch.reads )
+      {
+        read.result = -1;
+        read.error = code;
+      }
+    }
+    for( std::size_t i = 0; i < batch.reads.size(); ++i )
+    {
+      batch.targets[ i ]->bytesRead = batch.reads[ i ].result;
+      batch.targets[ i ]->errorCode = batch.reads[ i ].error;
+    }
+  }
+  for( BFSBatchRead* read : others ) readFile( *read );
+
+  for( unsigned int i = 0; i < count; ++i )
+  {
+    if( reads[ i ].bytesRead < 0 )
+    {
+      if( success ) PHYSFS_setErrorCode( static_cast< PHYSFS_ErrorCode >( reads[ i ].errorCode ) );
+      success = false;
+    }
+  }
+  return success;
+}
+
+extern "C" int statBfsRawEntry( const char* path, BFSRawEntry* entry )
+{
+  if( !path || !entry )
+  {
+    PHYSFS_setErrorCode( PHYSFS_ERR_INVALID_ARGUMENT );
+    return 0;
+  }
+  std::string archivePath;
+  std::shared_ptr< BFSArchive > archive = findArchive( path, archivePath );
+  if( !archive )
+  {
+    PHYSFS_setErrorCode( PHYSFS_ERR_NOT_FOUND );
+    return 0;
+  }
+  try
+  {
+    const char* data;
+    const BFSFile::Info* info = archive->findRaw( archivePath.c_str(), data );
+    if( !info )
+    {
+      PHYSFS_setErrorCode( PHYSFS_ERR_NOT_FOUND );
+      return 0;
+    }
+    entry->compressionType = info->compressed ? BFS_COMPRESSION_ZLIB : BFS_COMPRESSION_NONE;
+    entry->compressedSize = info->compressedSize;
+    entry->uncompressedSize = info->uncompressedSize;
+    entry->data = data;
+  }
+  catch( PHYSFS_ErrorCode code )
+  {
+    PHYSFS_setErrorCode( code );
+    return 0;
+  }
+  return 1;
+}
+
+extern "C" long long readBfsRawEntry( const char* path, unsigned long long offset, void* buffer, unsigned long long bufferSize )
+{
+  if( !path || ( !buffer && bufferSize > 0 ) )
+  {
+    PHYSFS_setErrorCode( PHYSFS_ERR_INVALID_ARGUMENT );
+    return -1;
+  }
+  std::string archivePath;
+  std::shared_ptr< BFSArchive > archive = findArchive( path, archivePath );
+  if( !archive )
+  {
+    PHYSFS_setErrorCode( PHYSFS_ERR_NOT_FOUND );
+    return -1;
+  }
+  try
+  {
+    return archive->readRaw( archivePath.c_str(), offset, static_cast< char* >( buffer ), bufferSize );
+  }
+  catch( PHYSFS_ErrorCode code )
+  {
+    PHYSFS_setErrorCode( code );
+    return -1;
+  }
+}
+
+/// Writes a file that's not in a BFS archive to fd, reading it the usual way
+static long long exportFile( const char* path, int fd )
+{
+  PHYSFS_File* file = PHYSFS_openRead( path );
+  if( !file ) return -1;
+  std::vector< char > buffer( 1024 * 1024 );
+  long long total = 0;
+  PHYSFS_sint64 bytesRead;
+  while( ( bytesRead = PHYSFS_readBytes( file, buffer.data(), buffer.size() ) ) > 0 )
+  {
+    if( !writeToFd( fd, buffer.data(), bytesRead ) )
+    {
+      PHYSFS_close( file );
+      PHYSFS_setErrorCode( PHYSFS_ERR_IO );
+      return -1;
+    }
+    total += bytesRead;
+  }
+  PHYSFS_close( file );
+  return bytesRead < 0 ? -1 : total;
+}
+
+extern "C" long long exportBfsFile( const char* path, int fd )
+{
+  if( !path || fd < 0 )
+  {
+    PHYSFS_setErrorCode( PHYSFS_ERR_INVALID_ARGUMENT );
+    return -1;
+  }
+  std::string archivePath;
+  std::shared_ptr< BFSArchive > archive = findArchive( path, archivePath );
+  if( !archive ) return exportFile( path, fd );
+  try
+  {
+    return archive->exportFile( archivePath.c_str(), fd );
+  }
+  catch( PHYSFS_ErrorCode code )
+  {
+    PHYSFS_setErrorCode( code );
+    return -1;
+  }
+}
+
+extern "C" int setBfsPrefetchThreads( unsigned int count )
+{
+  if( count == 0 )
+  {
+    PHYSFS_setErrorCode( PHYSFS_ERR_INVALID_ARGUMENT );
+    return 0;
+  }
+  std::lock_guard< std::mutex > lock( s_optionsMutex );
+  s_options.prefetchThreads = count;
+  return 1;
+}
+
+extern "C" int prefetchBfsFiles( const char* const* paths, unsigned int count, int priority )
+{
+  if( !paths && count > 0 )
+  {
+    PHYSFS_setErrorCode( PHYSFS_ERR_INVALID_ARGUMENT );
+    return 0;
+  }
+  PHYSFS_ErrorCode error = PHYSFS_ERR_OK;
+  std::string archivePath;
+  for( unsigned int i = 0; i < count; ++i )
+  {
+    std::shared_ptr< BFSArchive > archive = paths[ i ] ? findArchive( paths[ i ], archivePath ) : nullptr;
+    if( !archive ) continue;
+    try
+    {
+      if( !archive->prefetch( archivePath.c_str(), priority ) && !error ) error = PHYSFS_ERR_NOT_FOUND;
+    }
+    catch( PHYSFS_ErrorCode code )
+    {
+      if( !error ) error = code;
+    }
+  }
+  if( error ) PHYSFS_setErrorCode( error );
+  return !error;
+}
+
+extern "C" int cancelBfsPrefetch( const char* const* paths, unsigned int count )
+{
+  if( !paths )
+  {
+    std::lock_guard< std::mutex > lock( s_archivesMutex );
+    for( auto& archive : s_archives ) archive.second->cancelPrefetch( nullptr );
+    return 1;
+  }
+  std::string archivePath;
+  for( unsigned int i = 0; i < count; ++i )
+  {
+    std::shared_ptr< BFSArchive > archive = paths[ i ] ? findArchive( paths[ i ], archivePath ) : nullptr;
+    if( archive ) archive->cancelPrefetch( archivePath.c_str() );
+  }
+  return 1;
+}
@@ -1,13 +1,14 @@
 #include "bfsfile.hpp"
 #include "bfsarchive.hpp"
 
-#include <utility>
 #include <cassert>
 #include <algorithm>
+#include <cstring>
+#include <cstdint>
 
 //    PhysFS Callbacks
 
-extern "C" static PHYSFS_sint64 read( PHYSFS_Io* io, void *buf, PHYSFS_uint64 len )
+static PHYSFS_sint64 read( PHYSFS_Io* io, void *buf, PHYSFS_uint64 len )
 {
   try
   {
@@ -21,7 +22,7 @@ extern "C" static PHYSFS_sint64 read( PHYSFS_Io* io, void *buf, PHYSFS_uint64 le
   }
 }
 
-extern "C" static int seek( PHYSFS_Io* io, PHYSFS_uint64 position )
+static int seek( PHYSFS_Io* io, PHYSFS_uint64 position )
 {
   try
   {
@@ -36,7 +37,7 @@ extern "C" static int seek( PHYSFS_Io* io, PHYSFS_uint64 position )
   }
 }
 
-extern "C" static PHYSFS_sint64 tell( PHYSFS_Io* io )
+static PHYSFS_sint64 tell( PHYSFS_Io* io )
 {
   try
   {
@@ -50,7 +51,7 @@ extern "C" static PHYSFS_sint64 tell( PHYSFS_Io* io )
   }
 }
 
-extern "C" static PHYSFS_sint64 length( PHYSFS_Io* io )
+static PHYSFS_sint64 length( PHYSFS_Io* io )
 {
   try
   {
@@ -65,7 +66,7 @@ extern "C" static PHYSFS_sint64 length( PHYSFS_Io* io )
   }
 }
 
-extern "C" static PHYSFS_Io* duplicate( PHYSFS_Io* io )
+static PHYSFS_Io* duplicate( PHYSFS_Io* io )
 {
   try
   {
@@ -79,7 +80,7 @@ extern "C" static PHYSFS_Io* duplicate( PHYSFS_Io* io )
   }
 }
 
-extern "C" static void destroy( PHYSFS_Io* io )
+static void destroy( PHYSFS_Io* io )
 {
   try
   {
@@ -111,115 +112,70 @@ static inline PHYSFS_Io initFileIO( BFSFile* self )
 
 //    BFSFile Class Implementation
 
-BFSFile::BFSFile( BFSArchive& archive, Info* info )
+/// Where the given file's data starts in the archive's mapping, if it's mapped and contains the whole file
+static const char* mappedData( const BFSArchive& archive, const BFSFile::Info& info )
+{
+  if( !archive.getMapping() || std::uint64_t( info.offset ) + info.compressedSize > archive.getMappingSize() ) return nullptr;
+  return archive.getMapping() + info.offset;
+}
+
+BFSFile::BFSFile( BFSArchive& archive, const Info* info )
 : m_ioInterface( initFileIO( this ) )
-, m_archive( archive.getIO().duplicate( &archive.getIO() ) )
+, m_archive( &archive )
+, m_mappedData( mappedData( archive, *info ) )
 , m_info( info )
+, m_phyiscalPos( 0 )
 {
-  // duplicate returned nullptr?
-  if( !m_archive )
-  {
-    // As presumably set by duplicate()
-    throw( PHYSFS_getLastErrorCode() );
-  }
-  // Bail without changing error code on failure
-  if( !seek( 0 ) ) throw PHYSFS_ERR_OK;
 }
 
-BFSFile::~BFSFile()
+BFSFile::BFSFile( const Info* info )
+: m_ioInterface( initFileIO( this ) )
+, m_archive( nullptr )
+, m_mappedData( nullptr )
+, m_info( info )
+, m_phyiscalPos( 0 )
 {
-  if( m_archive ) m_archive->destroy( m_archive );
 }
 
-BFSFile::BFSFile( const BFSFile& rhs )
-: m_ioInterface( initFileIO( this ) )
-, m_archive( rhs.m_archive ? rhs.m_archive->duplicate( rhs.m_archive ) : nullptr )
-, m_info( rhs.m_info )
-, m_phyiscalPos( rhs.m_phyiscalPos )
+BFSFile::~BFSFile()
 {
-  // duplicate returned nullptr?
-  if( !m_archive && !rhs.m_archive )
-  {
-    // As presumably set by duplicate()
-    throw( PHYSFS_getLastErrorCode() );
-  }
 }
 
-BFSFile::BFSFile( BFSFile&& rhs )
+BFSFile::BFSFile( const BFSFile& rhs )
 : m_ioInterface( initFileIO( this ) )
 , m_archive( rhs.m_archive )
+, m_mappedData( rhs.m_mappedData )
 , m_info( rhs.m_info )
 , m_phyiscalPos( rhs.m_phyiscalPos )
 {
-  rhs.m_archive = nullptr;
 }
 
 BFSFile& BFSFile::operator=( const BFSFile& rhs )
 {
-  if( this == &rhs ) return *this;
-
-  // Copy Archive IO
-  if( m_archive ) m_archive->destroy( m_archive );
-  if( rhs.m_archive )
-  {
-    m_archive = rhs.m_archive->duplicate( rhs.m_archive );
-    if( !m_archive )
-    {
-      // As presumably set by duplicate()
-      throw( PHYSFS_getLastErrorCode() );
-    }
-  }
-  else
-  {
-    m_archive = nullptr;
-  }
-
-  m_info = rhs.m_info;
-  m_phyiscalPos = rhs.m_phyiscalPos;
-
-  return *this;
-}
-
-BFSFile& BFSFile::operator=( BFSFile&& rhs )
-{
-  if( this == &rhs ) return *this;
-
-  // Move Archive IO
-  if( m_archive ) m_archive->destroy( m_archive );
   m_archive = rhs.m_archive;
-  rhs.m_archive = nullptr;
-
+  m_mappedData = rhs.m_mappedData;
   m_info = rhs.m_info;
   m_phyiscalPos = rhs.m_phyiscalPos;
-
   return *this;
 }
 
 PHYSFS_sint64 BFSFile::read( char buf[], const PHYSFS_uint64 len )
 {
-  if( !m_archive ) return -1;
-
-  auto bytesRead = readImpl( buf, std::min< PHYSFS_uint64 >( m_info->uncompressedSize - m_phyiscalPos, len ) );
-  if( bytesRead > 0 ) m_phyiscalPos += bytesRead;
-  return bytesRead;
+  return readImpl( buf, std::min< PHYSFS_uint64 >( size() - tell(), len ) );
 }
 
 PHYSFS_sint64 BFSFile::readImpl( char buf[], const PHYSFS_uint64 len )
 {
-  return m_archive->read( m_archive, buf, len );
+  if( !m_archive ) return -1;
+  // Stay within this file's data
+  auto bytesRead = m_archive->readAt( m_info->offset + PHYSFS_uint64( m_phyiscalPos ), buf, std::min< PHYSFS_uint64 >( m_info->compressedSize - m_phyiscalPos, len ) );
+  if( bytesRead > 0 ) m_phyiscalPos += bytesRead;
+  return bytesRead;
 }
 
 int BFSFile::seek( PHYSFS_uint64 position )
 {
-  if( position >= m_info->compressedSize ) throw PHYSFS_ERR_PAST_EOF;
-  if( m_archive->seek( m_archive, m_info->offset + position ) )
-  {
-    m_phyiscalPos = position;
-    return true;
-  }
-  else
-  {
-    m_phyiscalPos = m_archive->tell( m_archive );
-    return false;
-  }
+  if( position > m_info->compressedSize ) throw PHYSFS_ERR_PAST_EOF;
+  m_phyiscalPos = position;
+  return true;
 }
@@ -21,12 +21,10 @@ public:
   };
 
 public:
-  BFSFile( BFSArchive& archive, Info* info );
+  BFSFile( BFSArchive& archive, const Info* info );
   virtual ~BFSFile();
   BFSFile( const BFSFile& rhs );
-  BFSFile( BFSFile&& rhs );
   BFSFile& operator=( const BFSFile& rhs );
-  BFSFile& operator=( BFSFile&& rhs );
 
   PHYSFS_Io* getPhysFSInterface() { return &m_ioInterface; }
 
@@ -38,16 +36,22 @@ public:
   virtual BFSFile* clone() const { return new BFSFile( *this ); }
 
 protected:
+  /// For files not read from the archive; derived classes must override readImpl() and seek()
+  explicit BFSFile( const Info* info );
+
+  /// Read up to len bytes at the current position, which is advanced accordingly
   virtual PHYSFS_sint64 readImpl( char buf[], const PHYSFS_uint64 len );
 
 private:
   /// PhysFS Interface to this File
   PHYSFS_Io m_ioInterface;
 protected:
-  /// IO of the Archive this file is part of (duplicate owned by us)
-  PHYSFS_Io* m_archive;
+  /// Archive this file is part of, if any; read from at absolute offsets, so any number of files can share its i/o
+  BFSArchive* m_archive;
+  /// Start of this file's data in the mapped archive, if any
+  const char* m_mappedData;
   /// I/o position in archive where this file starts
-  Info* m_info;
-  /// Physical position in file
+  const Info* m_info;
+  /// Physical position in file, i.e. within the compressed data of compressed files
   PHYSFS_sint64 m_phyiscalPos;
 };
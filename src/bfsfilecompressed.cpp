@@ -1,67 +1,182 @@
 #include "bfsfilecompressed.hpp"
+#include "bfsarchive.hpp"
+#include "streamtracker.hpp"
 
 #include <cassert>
 #include <algorithm>
+#include <limits>
 
-BFSFileCompressed::BFSFileCompressed( BFSArchive& archive, Info* info )
+BFSFileCompressed::BFSFileCompressed( BFSArchive& archive, const Info* info )
 : BFSFile( archive, info )
 , m_logicalPos( 0 )
+, m_tracker( archive.getStreamTracker() )
+, m_stream( archive.getInflaterPool() )
+, m_checkpointInterval( archive.getOptions().checkpointInterval )
+, m_maxCheckpoints( archive.getOptions().checkpointBudget / ZipStream::snapshotSize() )
 {
 }
 
 
 BFSFileCompressed::~BFSFileCompressed()
 {
+  if( m_tracker ) m_tracker->remove( *this );
 }
 
-BFSFileCompressed::BFSFileCompressed( BFSFileCompressed&& rhs )
-: BFSFile( std::move( rhs ) )
+BFSFileCompressed::BFSFileCompressed( const BFSFileCompressed& rhs )
+: BFSFile( rhs )
 , m_logicalPos( rhs.m_logicalPos )
-, m_stream( std::move( rhs.m_stream ) )
+, m_tracker( rhs.m_tracker )
+, m_stream( m_archive->getInflaterPool() )
+, m_checkpointInterval( rhs.m_checkpointInterval )
+, m_maxCheckpoints( rhs.m_maxCheckpoints )
+, m_checkpoints( rhs.m_checkpoints )
 {
+  std::lock_guard< std::mutex > lock( rhs.m_streamMutex );
+  m_stream = rhs.m_stream;
+  m_evicted = rhs.m_evicted;
 }
 
-BFSFileCompressed& BFSFileCompressed::operator=( BFSFileCompressed&& rhs )
+void BFSFileCompressed::shareCheckpoints( const BFSFileCompressed& rhs )
 {
-  BFSFile::operator=( std::move( rhs ) );
-  m_logicalPos = rhs.m_logicalPos;
-  m_stream = std::move( rhs.m_stream );
-  return *this;
+  std::lock_guard< std::mutex > lock( rhs.m_streamMutex );
+  m_checkpoints = rhs.m_checkpoints;
+}
+
+bool BFSFileCompressed::evictState()
+{
+  std::unique_lock< std::mutex > lock( m_streamMutex, std::try_to_lock );
+  if( !lock.owns_lock() ) return false;
+  m_stream = ZipStream( m_archive->getInflaterPool() );
+  m_evicted = true;
+  return true;
+}
+
+PHYSFS_uint64 BFSFileCompressed::nextCheckpoint() const
+{
+  if( m_checkpointInterval == 0 || m_checkpoints.size() >= m_maxCheckpoints ) return 0;
+  const PHYSFS_uint64 position = ( m_checkpoints.size() + 1 ) * m_checkpointInterval;
+  return position < m_info->uncompressedSize ? position : 0;
 }
 
 PHYSFS_sint64 BFSFileCompressed::readImpl( char buf[], const PHYSFS_uint64 len )
 {
-  auto read = m_stream.read( buf, len,
-    [ this ]( char buf[], const PHYSFS_uint64 len )
+  std::lock_guard< std::mutex > lock( m_streamMutex );
+  if( m_evicted && !rebuild( m_logicalPos ) ) return -1;
+  const PHYSFS_sint64 result = readStream( buf, len );
+  if( m_tracker ) m_tracker->touch( *this, m_stream.memoryUsage() );
+  return result;
+}
+
+PHYSFS_sint64 BFSFileCompressed::readStream( char buf[], const PHYSFS_uint64 len )
+{
+  // Reading the whole file at once? Then skip the streaming machinery.
+  if( len > 0 && len == m_info->uncompressedSize && m_logicalPos == 0 && m_stream.totalIn() == 0 )
+  {
+    return readWhole( buf );
+  }
+
+  auto readInput = [ this ]( char buf[], const PHYSFS_uint64 len )
   {
     return BFSFile::readImpl( buf, len );
-  } );
-  m_logicalPos += read;
-  return read;
+  };
+  // Mapped archives are decompressed in place, handing out all remaining input at once
+  auto getInput = [ this ]( const char*& out_data )
+  {
+    const PHYSFS_uint64 size = std::min< PHYSFS_uint64 >( m_info->compressedSize - m_phyiscalPos, std::numeric_limits< unsigned int >::max() );
+    out_data = m_mappedData + m_phyiscalPos;
+    m_phyiscalPos += size;
+    return PHYSFS_sint64( size );
+  };
+  PHYSFS_sint64 total = 0;
+  while( PHYSFS_uint64( total ) < len )
+  {
+    // Stop exactly at the next checkpoint to record it. Checkpoints are recorded in order and we can only get past one by decompressing, so it's never behind us.
+    PHYSFS_uint64 toRead = len - total;
+    const PHYSFS_uint64 checkpoint = nextCheckpoint();
+    assert( checkpoint == 0 || checkpoint >= m_logicalPos );
+    if( checkpoint > m_logicalPos ) toRead = std::min( toRead, checkpoint - m_logicalPos );
+
+    auto read = m_mappedData ? m_stream.readDirect( buf + total, toRead, getInput ) : m_stream.read( buf + total, toRead, readInput );
+    if( read < 0 ) return total > 0 ? total : -1;
+    m_logicalPos += read;
+    total += read;
+    if( m_logicalPos == checkpoint ) m_checkpoints.emplace_back( std::make_shared< const ZipStream >( m_stream.snapshot() ) );
+    if( PHYSFS_uint64( read ) < toRead ) break;
+  }
+  return total;
+}
+
+PHYSFS_sint64 BFSFileCompressed::readWhole( char buf[] )
+{
+  std::vector< char > input;
+  const char* inputData = m_mappedData;
+  if( !inputData )
+  {
+    input.resize( m_info->compressedSize );
+    if( BFSFile::readImpl( input.data(), input.size() ) != PHYSFS_sint64( input.size() ) )
+    {
+      PHYSFS_setErrorCode( PHYSFS_ERR_PAST_EOF );
+      return -1;
+    }
+    inputData = input.data();
+  }
+  if( !m_archive->inflateWhole( *m_info, inputData, buf ) )
+  {
+    PHYSFS_setErrorCode( PHYSFS_ERR_CORRUPT );
+    return -1;
+  }
+  m_logicalPos = m_info->uncompressedSize;
+  return m_info->uncompressedSize;
+}
+
+bool BFSFileCompressed::restore( const ZipStream& state )
+{
+  m_stream = state;
+  if( !BFSFile::seek( m_stream.totalIn() ) ) return false;
+  m_logicalPos = m_stream.totalOut();
+  return true;
+}
+
+bool BFSFileCompressed::rebuild( PHYSFS_uint64 position )
+{
+  m_evicted = false;
+  m_logicalPos = 0;
+  if( m_tracker && position > 0 ) m_tracker->countRebuild();
+  return BFSFile::seek( 0 ) && seekStream( position );
 }
 
 int BFSFileCompressed::seek( PHYSFS_uint64 position )
 {
-  if( position >= m_info->uncompressedSize ) throw PHYSFS_ERR_PAST_EOF;
+  if( position > m_info->uncompressedSize ) throw PHYSFS_ERR_PAST_EOF;
+  std::lock_guard< std::mutex > lock( m_streamMutex );
+  const bool result = m_evicted ? rebuild( position ) : seekStream( position );
+  if( m_tracker ) m_tracker->touch( *this, m_stream.memoryUsage() );
+  return result;
+}
+
+bool BFSFileCompressed::seekStream( PHYSFS_uint64 position )
+{
 
+  // Resume from the last checkpoint before the target, if that's closer than the current position
+  const std::size_t checkpointIndex = m_checkpointInterval ? std::min< PHYSFS_uint64 >( position / m_checkpointInterval, m_checkpoints.size() ) : 0;
+  const PHYSFS_uint64 checkpointPos = checkpointIndex * m_checkpointInterval;
+  if( checkpointIndex > 0 && ( position < m_logicalPos || checkpointPos > m_logicalPos ) )
+  {
+    if( !restore( *m_checkpoints[ checkpointIndex - 1 ] ) ) return false;
+  }
   // need to go back? then start over.
-  if( position < m_logicalPos )
+  else if( position < m_logicalPos )
   {
-    m_stream = ZipStream();
-    if( !BFSFile::seek( 0 ) )
-    {
-      // FIXME (how?): we are now probably in a broken state
-      return false;
-    }
-    m_logicalPos = 0;
+    if( !restore( ZipStream() ) ) return false;
   }
+
+  if( m_logicalPos == position ) return true;
+  std::vector< char > buffer( std::min< PHYSFS_uint64 >( 32 * 1024, position - m_logicalPos ) );
   while( m_logicalPos < position )
   {
-    char buffer[ 512 ];
-    PHYSFS_uint64 toRead{ std::min< PHYSFS_uint64 >( sizeof( buffer ), position - m_logicalPos ) };
-    auto read = BFSFileCompressed::readImpl( buffer, toRead );
+    PHYSFS_uint64 toRead{ std::min< PHYSFS_uint64 >( buffer.size(), position - m_logicalPos ) };
+    auto read = readStream( buffer.data(), toRead );
     if( read <= 0 ) return false;
-    m_logicalPos += read;
   }
   return true;
-}
\ No newline at end of file
+}
@@ -2,25 +2,63 @@
 #include "bfsfile.hpp"
 #include "zipstream.hpp"
 
+#include <vector>
+#include <memory>
+#include <mutex>
+
+class StreamTracker;
+
 class BFSFileCompressed : public BFSFile
 {
 public:
-  BFSFileCompressed( BFSArchive& archive, Info* info );
+  BFSFileCompressed( BFSArchive& archive, const Info* info );
   virtual ~BFSFileCompressed();
-  BFSFileCompressed( const BFSFileCompressed& rhs ) = default;
-  BFSFileCompressed& operator=( const BFSFileCompressed& rhs ) = default;
-  BFSFileCompressed( BFSFileCompressed&& rhs );
-  BFSFileCompressed& operator=( BFSFileCompressed&& rhs );
+  BFSFileCompressed( const BFSFileCompressed& rhs );
+  BFSFileCompressed& operator=( const BFSFileCompressed& rhs ) = delete;
 
   virtual BFSFileCompressed* clone() const override { return new BFSFileCompressed( *this ); }
 
   virtual PHYSFS_sint64 tell() const override { return m_logicalPos; }
   virtual int seek( PHYSFS_uint64 position ) override;
 
+  /**
+  @brief Drop the decompression state to save memory, unless the file is being read from right now.
+  The next read or seek rebuilds it from the closest checkpoint. May be called from any thread.
+  @return Whether the state was dropped
+  **/
+  bool evictState();
+
 protected:
   virtual PHYSFS_sint64 readImpl( char buf[], const PHYSFS_uint64 len ) override;
+  /// Take over the checkpoints rhs recorded so far, which may still be decompressing on another thread
+  void shareCheckpoints( const BFSFileCompressed& rhs );
+
+private:
+  /// Uncompressed position at which the next checkpoint is due, or 0 if no more are recorded
+  PHYSFS_uint64 nextCheckpoint() const;
+  /// Decompress the entire file into buf in one go; only valid at the start of the file
+  PHYSFS_sint64 readWhole( char buf[] );
+  /// Continue decompressing from the given state
+  bool restore( const ZipStream& state );
+  /// readImpl() with m_streamMutex held
+  PHYSFS_sint64 readStream( char buf[], const PHYSFS_uint64 len );
+  /// seek() with m_streamMutex held
+  bool seekStream( PHYSFS_uint64 position );
+  /// Start over after evictState() and decompress up to position; called with m_streamMutex held
+  bool rebuild( PHYSFS_uint64 position );
 
 private:
   PHYSFS_uint64 m_logicalPos;
+  /// Where to report the size of our decompression state, if limited
+  StreamTracker* const m_tracker;
+  /// Guards m_stream and m_evicted against evictState() on other threads
+  mutable std::mutex m_streamMutex;
   ZipStream m_stream;
+  /// m_stream was dropped by evictState() and no longer matches m_logicalPos
+  bool m_evicted = false;
+  /// Uncompressed bytes between checkpoints, 0 if disabled
+  PHYSFS_uint64 m_checkpointInterval;
+  std::size_t m_maxCheckpoints;
+  /// Decompression state at every m_checkpointInterval bytes of output so far; immutable, so copies can share them
+  std::vector< std::shared_ptr< const ZipStream > > m_checkpoints;
 };
@@ -0,0 +1,29 @@
+#include "bfsfilememory.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+BFSFileMemory::BFSFileMemory( const Info* info, Data data )
+: BFSFile( info )
+, m_data( std::move( data ) )
+{
+}
+
+BFSFileMemory::~BFSFileMemory()
+{
+}
+
+PHYSFS_sint64 BFSFileMemory::readImpl( char buf[], const PHYSFS_uint64 len )
+{
+  const PHYSFS_uint64 toRead = std::min< PHYSFS_uint64 >( m_data->size() - m_phyiscalPos, len );
+  if( toRead > 0 ) std::memcpy( buf, m_data->data() + m_phyiscalPos, toRead );
+  m_phyiscalPos += toRead;
+  return toRead;
+}
+
+int BFSFileMemory::seek( PHYSFS_uint64 position )
+{
+  if( position > m_data->size() ) throw PHYSFS_ERR_PAST_EOF;
+  m_phyiscalPos = position;
+  return true;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "bfsfile.hpp"
+
+#include <vector>
+#include <memory>
+
+/**
+@brief Access to a file whose contents are already in memory, e.g. from the decompressed entry cache
+**/
+class BFSFileMemory : public BFSFile
+{
+public:
+  typedef std::shared_ptr< const std::vector< char > > Data;
+
+public:
+  BFSFileMemory( const Info* info, Data data );
+  virtual ~BFSFileMemory();
+  BFSFileMemory( const BFSFileMemory& rhs ) = default;
+  BFSFileMemory& operator=( const BFSFileMemory& rhs ) = default;
+
+  virtual BFSFileMemory* clone() const override { return new BFSFileMemory( *this ); }
+
+  virtual int seek( PHYSFS_uint64 position ) override;
+
+protected:
+  virtual PHYSFS_sint64 readImpl( char buf[], const PHYSFS_uint64 len ) override;
+
+private:
+  /// Uncompressed contents, shared with the cache and other handles
+  Data m_data;
+};
@@ -0,0 +1,155 @@
+#include "bfsfilereadahead.hpp"
+#include "bfsarchive.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <system_error>
+
+BFSFileReadahead::BFSFileReadahead( BFSArchive& archive, const Info* info, std::size_t distance )
+: BFSFileCompressed( archive, info )
+, m_ring( std::max< std::size_t >( distance, 1 ) )
+, m_chunkSize( std::min< std::size_t >( 64 * 1024, ( m_ring.size() + 3 ) / 4 ) )
+{
+}
+
+BFSFileReadahead::~BFSFileReadahead()
+{
+  stop();
+}
+
+BFSFileReadahead* BFSFileReadahead::clone() const
+{
+  // Our decompression state belongs to the thread, so start over from the checkpoints it recorded so far
+  std::unique_ptr< BFSFileReadahead > result( new BFSFileReadahead( *m_archive, m_info, m_ring.size() ) );
+  result->shareCheckpoints( *this );
+  if( !result->seek( m_readPos ) )
+  {
+    const PHYSFS_ErrorCode code = PHYSFS_getLastErrorCode();
+    throw code ? code : PHYSFS_ERR_CORRUPT;
+  }
+  return result.release();
+}
+
+void BFSFileReadahead::start()
+{
+  m_stopping = false;
+  m_done = false;
+  m_error = PHYSFS_ERR_OK;
+  try
+  {
+    m_thread = std::thread( &BFSFileReadahead::work, this );
+  }
+  catch( std::system_error& )
+  {
+    throw PHYSFS_ERR_OS_ERROR;
+  }
+}
+
+void BFSFileReadahead::stop()
+{
+  if( !m_thread.joinable() ) return;
+  {
+    std::lock_guard< std::mutex > lock( m_mutex );
+    m_stopping = true;
+  }
+  m_changed.notify_all();
+  m_thread.join();
+  m_begin = 0;
+  m_fill = 0;
+}
+
+void BFSFileReadahead::work()
+{
+  std::unique_lock< std::mutex > lock( m_mutex );
+  while( true )
+  {
+    m_changed.wait( lock, [ this ]() { return m_stopping || m_ring.size() - m_fill >= m_chunkSize; } );
+    if( m_stopping ) return;
+    // Fill a chunk of the free space, which the reader never touches
+    const std::size_t end = ( m_begin + m_fill ) % m_ring.size();
+    const std::size_t size = std::min( m_chunkSize, end < m_begin ? m_begin - end : m_ring.size() - end );
+    lock.unlock();
+
+    PHYSFS_sint64 read;
+    PHYSFS_ErrorCode error = PHYSFS_ERR_OK;
+    try
+    {
+      read = BFSFileCompressed::readImpl( &m_ring[ end ], std::min< PHYSFS_uint64 >( size, m_info->uncompressedSize - BFSFileCompressed::tell() ) );
+      // Errors are thread-local in PhysFS, so hand them over to the reader
+      if( read < 0 ) error = PHYSFS_getLastErrorCode();
+    }
+    catch( PHYSFS_ErrorCode code )
+    {
+      read = -1;
+      error = code;
+    }
+
+    lock.lock();
+    if( read > 0 ) m_fill += read;
+    if( read <= 0 || PHYSFS_uint64( BFSFileCompressed::tell() ) == m_info->uncompressedSize )
+    {
+      m_done = true;
+      m_error = read < 0 ? ( error ? error : PHYSFS_ERR_IO ) : PHYSFS_ERR_OK;
+      m_changed.notify_all();
+      return;
+    }
+    m_changed.notify_all();
+  }
+}
+
+void BFSFileReadahead::consume( std::size_t size )
+{
+  const bool wasFull = m_ring.size() - m_fill < m_chunkSize;
+  m_begin = ( m_begin + size ) % m_ring.size();
+  m_fill -= size;
+  m_readPos += size;
+  // Only wake the thread once there's room for another chunk
+  if( wasFull && m_ring.size() - m_fill >= m_chunkSize ) m_changed.notify_all();
+}
+
+PHYSFS_sint64 BFSFileReadahead::readImpl( char buf[], const PHYSFS_uint64 len )
+{
+  if( len == 0 ) return 0;
+  if( !m_thread.joinable() ) start();
+
+  PHYSFS_uint64 total = 0;
+  std::unique_lock< std::mutex > lock( m_mutex );
+  while( total < len )
+  {
+    m_changed.wait( lock, [ this ]() { return m_fill > 0 || m_done; } );
+    if( m_fill == 0 )
+    {
+      // Thread is done; report errors unless there's data to return first
+      if( total > 0 ) break;
+      if( m_error ) PHYSFS_setErrorCode( m_error );
+      return m_error ? -1 : 0;
+    }
+    // Copy the contiguous part, the rest (if any) on the next iteration
+    const std::size_t size = std::min< PHYSFS_uint64 >( std::min( m_fill, m_ring.size() - m_begin ), len - total );
+    std::memcpy( buf + total, &m_ring[ m_begin ], size );
+    consume( size );
+    total += size;
+  }
+  return total;
+}
+
+int BFSFileReadahead::seek( PHYSFS_uint64 position )
+{
+  if( position > m_info->uncompressedSize ) throw PHYSFS_ERR_PAST_EOF;
+  if( m_thread.joinable() )
+  {
+    // Short skips forward within the buffered data keep the thread going
+    std::unique_lock< std::mutex > lock( m_mutex );
+    if( position >= m_readPos && position - m_readPos <= m_fill )
+    {
+      consume( position - m_readPos );
+      return true;
+    }
+    lock.unlock();
+    stop();
+  }
+  const int result = BFSFileCompressed::seek( position );
+  m_readPos = BFSFileCompressed::tell();
+  return result;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include "bfsfilecompressed.hpp"
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/**
+@brief Access to a compressed file that's decompressed ahead of the reader on a background thread
+
+Decompressed data is kept in a ring buffer, so sequential reads only copy from there.
+The thread is started on the first read and stopped by seeks that leave the buffered range.
+**/
+class BFSFileReadahead : public BFSFileCompressed
+{
+public:
+  /**
+  @param distance Size of the ring buffer, i.e. how far to decompress ahead of the reader
+  **/
+  BFSFileReadahead( BFSArchive& archive, const Info* info, std::size_t distance );
+  virtual ~BFSFileReadahead();
+  BFSFileReadahead( const BFSFileReadahead& rhs ) = delete;
+  BFSFileReadahead& operator=( const BFSFileReadahead& rhs ) = delete;
+
+  /// A new handle at the same position, with a readahead of its own
+  virtual BFSFileReadahead* clone() const override;
+
+  virtual PHYSFS_sint64 tell() const override { return m_readPos; }
+  virtual int seek( PHYSFS_uint64 position ) override;
+
+protected:
+  virtual PHYSFS_sint64 readImpl( char buf[], const PHYSFS_uint64 len ) override;
+
+private:
+  void start();
+  /// Stops the thread and empties the ring buffer
+  void stop();
+  void work();
+  /// Drop size bytes from the front of the ring buffer, waking the thread if need be; called with m_mutex held
+  void consume( std::size_t size );
+
+private:
+  std::vector< char > m_ring;
+  /// Decompress this much at a time: little enough for the reader to get going soon, enough to be efficient
+  const std::size_t m_chunkSize;
+  /// Uncompressed position of the reader, i.e. of the first byte in the ring buffer
+  PHYSFS_uint64 m_readPos = 0;
+
+  std::thread m_thread;
+  std::mutex m_mutex;
+  /// Signalled when data was added to or removed from the ring buffer, or the thread is to stop
+  std::condition_variable m_changed;
+  /// Ring buffer contents: m_fill bytes starting at index m_begin; guarded by m_mutex
+  std::size_t m_begin = 0;
+  std::size_t m_fill = 0;
+  bool m_stopping = false;
+  /// The thread reached the end of the file or failed with m_error
+  bool m_done = false;
+  PHYSFS_ErrorCode m_error = PHYSFS_ERR_OK;
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdint>
+#include <cstddef>
 
 struct BFSHeader
 {
@@ -18,6 +19,29 @@ struct BFSHeader
 
   bool flag() const { return ( flagAndHeaderSize >> 31 ) & 1 ; }
   std::uint32_t headerSize( ) const { return flagAndHeaderSize & ~( 1 << 31 ); }
+
+  /**
+  @brief Hash table bucket of a full path ("dir/file"), case insensitive.
+  There's no specification of the format; this hash was worked out from the archives FlatOut 2 ships with, so archives from other tools may differ.
+  **/
+  static std::uint32_t bucket( const char* path, std::size_t len )
+  {
+    std::uint32_t hash = 0;
+    for( std::size_t i = 0; i < len; ++i )
+    {
+      unsigned char c = path[ i ];
+      if( c >= 'A' && c <= 'Z' ) c += 'a' - 'A';
+      hash = hash * 31 + c;
+    }
+    return hash % HASH_SIZE;
+  }
+};
+
+// Follows BFSHeader, HASH_SIZE times
+struct BFSHashEntry
+{
+  std::uint32_t firstFileIndex; // files of a bucket are stored consecutively in the file info table
+  std::uint32_t fileCount;
 };
 
 struct BFSStringPoolHeader
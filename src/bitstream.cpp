@@ -2,6 +2,17 @@
 
 #include <utility>
 #include <stdexcept>
+#include <cstring>
+
+static inline std::uint64_t loadLE64( const char* data )
+{
+  std::uint64_t word;
+  std::memcpy( &word, data, sizeof( word ) );
+#if defined( __BYTE_ORDER__ ) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  word = __builtin_bswap64( word );
+#endif
+  return word;
+}
 
 BitStream::BitStream( const char * const begin, const char* const end )
 : m_iterator( begin )
@@ -9,15 +20,33 @@ BitStream::BitStream( const char * const begin, const char* const end )
 {
 }
 
-bool BitStream::read( bool& out_bit )
+void BitStream::refill()
 {
-  if( eof() ) return false;
-  out_bit = ( *m_iterator >> m_curBit ) & 1;
-  ++m_curBit;
-  if( m_curBit == 8 )
+  if( m_end - m_iterator >= 8 )
+  {
+    // Whole word available: one unaligned load, then advance by the bytes that fit
+    m_buffer |= loadLE64( m_iterator ) << m_bufferBits;
+    const unsigned int bytes = ( 63 - m_bufferBits ) / 8;
+    m_iterator += bytes;
+    m_bufferBits += bytes * 8;
+  }
+  else
   {
-    m_curBit = 0;
-    ++m_iterator;
+    // Near the end: byte by byte, so nothing past m_end is read
+    while( m_bufferBits <= 56 && m_iterator != m_end )
+    {
+      m_buffer |= std::uint64_t( static_cast< unsigned char >( *m_iterator++ ) ) << m_bufferBits;
+      m_bufferBits += 8;
+    }
   }
+}
+
+bool BitStream::read( bool& out_bit )
+{
+  if( m_bufferBits == 0 ) refill();
+  if( m_bufferBits == 0 ) return false;
+  out_bit = m_buffer & 1;
+  m_buffer >>= 1;
+  --m_bufferBits;
   return true;
 }
@@ -1,9 +1,21 @@
 #pragma once
 
 #include <vector>
+#include <cstdint>
+#include <cstddef>
 
+/**
+@brief Reads bits least significant first, buffering up to 64 of them at a time.
+**/
 class BitStream
 {
+public:
+  enum
+  {
+    /// Maximum number of bits that can be peeked or consumed at once
+    MAX_BITS = 56,
+  };
+
 public:
   BitStream( const char * const begin, const char* const end );
   ~BitStream() = default;
@@ -15,10 +27,45 @@ public:
   @return if already eof(), thus no reading possible
   **/
   bool read( bool& out_bit );
-  bool eof() const { return m_iterator == m_end; }
+  bool eof() const { return bitsLeft() == 0; }
+
+  /**
+  @brief Look at upcoming bits without consuming them.
+  @param count Number of bits, at most MAX_BITS
+  @return Next count bits, first bit in least significant position; bits past the end read as 0.
+  **/
+  std::uint64_t peek( unsigned int count )
+  {
+    if( m_bufferBits < count ) refill();
+    return m_buffer & ( ( std::uint64_t( 1 ) << count ) - 1 );
+  }
+  /**
+  @brief Skip bits, e.g. after peek().
+  @param count Number of bits, at most MAX_BITS
+  @return false if fewer than count bits are left, in which case nothing is consumed
+  **/
+  bool consume( unsigned int count )
+  {
+    if( m_bufferBits < count )
+    {
+      refill();
+      if( m_bufferBits < count ) return false;
+    }
+    m_buffer >>= count;
+    m_bufferBits -= count;
+    return true;
+  }
+  std::size_t bitsLeft() const { return ( m_end - m_iterator ) * 8 + m_bufferBits; }
+
+private:
+  /// Load as many whole bytes into the buffer as fit
+  void refill();
 
 private:
+  /// Next byte not yet in the buffer
   const char * m_iterator;
   const char * const m_end;
-  unsigned char m_curBit = 0;
+  /// Upcoming bits; may contain further bits past m_bufferBits, which are copies of the ones at m_iterator
+  std::uint64_t m_buffer = 0;
+  unsigned int m_bufferBits = 0;
 };
@@ -0,0 +1,79 @@
+#include "entrycache.hpp"
+
+EntryCache::EntryCache( std::uint64_t budget, std::uint64_t maxEntrySize, unsigned int minRequests )
+: m_budget( budget )
+, m_maxEntrySize( maxEntrySize < budget ? maxEntrySize : budget )
+, m_minRequests( minRequests )
+, m_stats{}
+{
+}
+
+EntryCache::Data EntryCache::find( std::uint32_t key, std::uint64_t size, bool& out_admit )
+{
+  std::lock_guard< std::mutex > lock( m_mutex );
+  auto it = m_lookup.find( key );
+  if( it != m_lookup.end() )
+  {
+    ++m_stats.hits;
+    if( it->second->prefetched )
+    {
+      ++m_stats.prefetchesUsed;
+      it->second->prefetched = false;
+    }
+    m_entries.splice( m_entries.begin(), m_entries, it->second );
+    out_admit = false;
+    return it->second->data;
+  }
+
+  ++m_stats.misses;
+  out_admit = false;
+  if( size > m_maxEntrySize ) return nullptr;
+  enum { MAX_TRACKED_REQUESTS = 4096 };
+  if( m_requests.size() >= MAX_TRACKED_REQUESTS )
+  {
+    for( auto request = m_requests.begin(); request != m_requests.end(); )
+    {
+      request->second /= 2;
+      if( request->second == 0 ) request = m_requests.erase( request );
+      else ++request;
+    }
+  }
+  out_admit = ++m_requests[ key ] >= m_minRequests;
+  return nullptr;
+}
+
+void EntryCache::insert( std::uint32_t key, Data data, bool prefetched )
+{
+  const std::uint64_t size = data->size();
+  if( size > ( prefetched ? m_budget : m_maxEntrySize ) ) return;
+
+  std::lock_guard< std::mutex > lock( m_mutex );
+  // Another thread may have been faster
+  if( m_lookup.count( key ) ) return;
+  m_requests.erase( key );
+  while( m_stats.size + size > m_budget && !m_entries.empty() )
+  {
+    const Entry& victim = m_entries.back();
+    if( victim.prefetched ) ++m_stats.prefetchesWasted;
+    m_stats.size -= victim.data->size();
+    m_lookup.erase( victim.key );
+    m_entries.pop_back();
+    ++m_stats.evictions;
+  }
+  m_entries.push_front( { key, std::move( data ), prefetched } );
+  m_lookup.emplace( key, m_entries.begin() );
+  m_stats.size += size;
+  if( prefetched ) ++m_stats.prefetched;
+}
+
+bool EntryCache::contains( std::uint32_t key ) const
+{
+  std::lock_guard< std::mutex > lock( m_mutex );
+  return m_lookup.count( key ) != 0;
+}
+
+EntryCache::Stats EntryCache::getStats() const
+{
+  std::lock_guard< std::mutex > lock( m_mutex );
+  return m_stats;
+}
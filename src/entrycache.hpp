@@ -0,0 +1,87 @@
+#pragma once
+
+#include <list>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <cstdint>
+
+/**
+@brief LRU cache of decompressed archive entries with a memory budget
+
+Entries are only admitted once they have been requested a given number of times and if they are small enough,
+so one-off reads of large files don't flush frequently used small ones. All methods are thread-safe.
+**/
+class EntryCache
+{
+public:
+  typedef std::shared_ptr< const std::vector< char > > Data;
+
+  struct Stats
+  {
+    std::uint64_t hits;
+    std::uint64_t misses;
+    std::uint64_t evictions;
+    /// Bytes of cached data
+    std::uint64_t size;
+    /// Entries inserted by prefetching
+    std::uint64_t prefetched;
+    /// Prefetched entries that were found afterwards
+    std::uint64_t prefetchesUsed;
+    /// Prefetched entries evicted before anyone found them
+    std::uint64_t prefetchesWasted;
+  };
+
+public:
+  /**
+  @param budget Maximum bytes of cached data
+  @param maxEntrySize Larger entries are never cached
+  @param minRequests Number of find() calls for an entry before it is admitted
+  **/
+  EntryCache( std::uint64_t budget, std::uint64_t maxEntrySize, unsigned int minRequests );
+  EntryCache( const EntryCache& ) = delete;
+  EntryCache& operator=( const EntryCache& ) = delete;
+
+  /**
+  @brief Look up an entry, counting the request towards its admission.
+  @param key Identifies the entry, e.g. its offset in the archive
+  @param size Uncompressed size of the entry
+  @param out_admit On a miss, whether the entry should now be insert()ed
+  @return Cached data or nullptr
+  **/
+  Data find( std::uint32_t key, std::uint64_t size, bool& out_admit );
+
+  /**
+  @brief Add an entry, evicting the least recently used ones as necessary
+  @param prefetched Whether the entry was requested ahead of time; such entries bypass the maximum entry size.
+  **/
+  void insert( std::uint32_t key, Data data, bool prefetched = false );
+
+  /// Whether an entry is cached, without counting this as a request
+  bool contains( std::uint32_t key ) const;
+
+  Stats getStats() const;
+
+private:
+  struct Entry
+  {
+    std::uint32_t key;
+    Data data;
+    /// Prefetched and not found since
+    bool prefetched;
+  };
+
+private:
+  const std::uint64_t m_budget;
+  const std::uint64_t m_maxEntrySize;
+  const unsigned int m_minRequests;
+
+  mutable std::mutex m_mutex;
+  /// Most recently used first
+  std::list< Entry > m_entries;
+  std::unordered_map< std::uint32_t, std::list< Entry >::iterator > m_lookup;
+  /// Requests of entries not in the cache, aged by halving once too many are tracked
+  std::unordered_map< std::uint32_t, unsigned int > m_requests;
+  Stats m_stats;
+};
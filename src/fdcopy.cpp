@@ -0,0 +1,90 @@
+#include "fdcopy.hpp"
+
+#include <cerrno>
+#include <algorithm>
+
+#ifdef _WIN32
+# include <io.h>
+#else
+# include <unistd.h>
+#endif
+#ifdef __linux__
+# include <sys/sendfile.h>
+#endif
+
+/// copy_file_range() has a glibc wrapper since 2.27
+#if defined( __linux__ ) && defined( __GLIBC__ ) && ( __GLIBC__ > 2 || ( __GLIBC__ == 2 && __GLIBC_MINOR__ >= 27 ) )
+# define BFS_HAVE_COPY_FILE_RANGE
+#endif
+
+bool writeToFd( int fd, const char* data, std::size_t size )
+{
+  // Large writes may be cut short anyway, but some platforms reject them outright
+  enum : std::size_t { MAX_WRITE = 1 << 30 };
+  while( size > 0 )
+  {
+#ifdef _WIN32
+    const int written = _write( fd, data, static_cast< unsigned int >( std::min< std::size_t >( size, MAX_WRITE ) ) );
+#else
+    const ssize_t written = ::write( fd, data, std::min< std::size_t >( size, MAX_WRITE ) );
+#endif
+    if( written < 0 )
+    {
+      if( errno == EINTR ) continue;
+      return false;
+    }
+    if( written == 0 )
+    {
+      errno = EIO;
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+#ifdef __linux__
+/// Errors meaning a kernel copy doesn't apply to these descriptors, rather than that the copy failed
+static bool unsupported( int error )
+{
+  return error == EINVAL || error == ENOSYS || error == EXDEV || error == EOPNOTSUPP || error == EBADF || error == ETXTBSY;
+}
+#endif
+
+bool copyToFd( int inFd, std::uint64_t offset, const char* data, std::uint64_t size, int fd )
+{
+  std::uint64_t copied = 0;
+#ifdef __linux__
+  enum : std::size_t { MAX_COPY = 1 << 30 };
+  if( inFd != -1 )
+  {
+    loff_t inOffset = offset;
+# ifdef BFS_HAVE_COPY_FILE_RANGE
+    // Between regular files, may even share the data instead of copying it
+    while( copied < size )
+    {
+      const ssize_t result = copy_file_range( inFd, &inOffset, fd, nullptr, std::min< std::uint64_t >( size - copied, MAX_COPY ), 0 );
+      if( result < 0 && errno == EINTR ) continue;
+      if( result < 0 && !unsupported( errno ) ) return false;
+      if( result <= 0 ) break;
+      copied += result;
+    }
+# endif
+    // To anything, e.g. pipes and sockets
+    off_t sendOffset = offset + copied;
+    while( copied < size )
+    {
+      const ssize_t result = sendfile( fd, inFd, &sendOffset, std::min< std::uint64_t >( size - copied, MAX_COPY ) );
+      if( result < 0 && errno == EINTR ) continue;
+      if( result < 0 && !unsupported( errno ) ) return false;
+      if( result <= 0 ) break;
+      copied += result;
+    }
+  }
+#else
+  (void)inFd;
+  (void)offset;
+#endif
+  return writeToFd( fd, data + copied, static_cast< std::size_t >( size - copied ) );
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+@brief Write all of data to the file descriptor fd at its current position, continuing after partial writes.
+@return false on error, with errno set
+**/
+bool writeToFd( int fd, const char* data, std::size_t size );
+
+/**
+@brief Copy part of a file to the file descriptor fd at its current position, within the kernel where the platform allows.
+Uses copy_file_range() or sendfile() on Linux, and falls back to writing the same bytes from memory where these don't apply to fd.
+@param inFd Descriptor of the file to copy from, -1 to always write from memory
+@param offset Where to copy from within that file
+@param data The same size bytes in memory, e.g. mapped from the file
+@return false on error, with errno set
+**/
+bool copyToFd( int inFd, std::uint64_t offset, const char* data, std::uint64_t size, int fd );
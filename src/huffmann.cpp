@@ -2,6 +2,8 @@
 #include "bitstream.hpp"
 
 #include <iostream>
+#include <algorithm>
+#include <utility>
 
 #include <cassert>
 
@@ -43,3 +45,94 @@ bool Huffmann::decode( BitStream& stream, char& out_result ) const
 
   return ( bit ? m_child1 : m_child0 )->decode( stream, out_result );
 }
+
+HuffmannTable::HuffmannTable( const Huffmann& tree )
+{
+  if( !tree.m_child0 )
+  {
+    m_singleSymbol = true;
+    m_symbol = tree.m_leaf;
+    return;
+  }
+  m_entries.resize( 1 << LOOKUP_BITS );
+  buildTable( tree, tree, 0, LOOKUP_BITS, true );
+}
+
+void HuffmannTable::buildTable( const Huffmann& root, const Huffmann& start, std::uint32_t offset, unsigned int bits, bool multipleSymbols )
+{
+  for( std::uint32_t index = 0; index < ( 1u << bits ); ++index )
+  {
+    Entry entry = {};
+    const Huffmann* node = &start;
+    unsigned int consumed = 0;
+    while( true )
+    {
+      if( !node->m_child0 )
+      {
+        entry.symbols[ entry.symbolCount ] = node->m_leaf;
+        entry.length[ entry.symbolCount ] = consumed;
+        ++entry.symbolCount;
+        if( !multipleSymbols || entry.symbolCount == MAX_SYMBOLS ) break;
+        node = &root;
+      }
+      if( consumed == bits ) break;
+      node = ( ( index >> consumed ) & 1 ) ? node->m_child1.get() : node->m_child0.get();
+      ++consumed;
+    }
+
+    if( entry.symbolCount == 0 )
+    {
+      // Code continues past this table's bits, link to a secondary table for the remainder
+      unsigned int remaining = 0;
+      std::vector< std::pair< const Huffmann*, unsigned int > > stack{ { node, 0 } };
+      while( !stack.empty() )
+      {
+        auto cur = stack.back();
+        stack.pop_back();
+        if( cur.first->m_child0 )
+        {
+          stack.emplace_back( cur.first->m_child0.get(), cur.second + 1 );
+          stack.emplace_back( cur.first->m_child1.get(), cur.second + 1 );
+        }
+        else if( cur.second > remaining )
+        {
+          remaining = cur.second;
+        }
+      }
+      entry.length[ 0 ] = bits;
+      entry.tableBits = std::min< unsigned int >( remaining, LOOKUP_BITS );
+      entry.table = m_entries.size();
+      m_entries.resize( m_entries.size() + ( 1 << entry.tableBits ) );
+      m_entries[ offset + index ] = entry;
+      buildTable( root, *node, entry.table, entry.tableBits, false );
+    }
+    else
+    {
+      m_entries[ offset + index ] = entry;
+    }
+  }
+}
+
+bool HuffmannTable::decode( BitStream& stream, unsigned int count, char* out_result ) const
+{
+  if( m_singleSymbol )
+  {
+    std::fill_n( out_result, count, m_symbol );
+    return true;
+  }
+
+  char * const end = out_result + count;
+  while( out_result != end )
+  {
+    const Entry* entry = &m_entries[ stream.peek( LOOKUP_BITS ) ];
+    while( entry->symbolCount == 0 )
+    {
+      if( !stream.consume( entry->length[ 0 ] ) ) return false;
+      entry = &m_entries[ entry->table + stream.peek( entry->tableBits ) ];
+    }
+    const unsigned int symbolCount = std::min< unsigned int >( entry->symbolCount, end - out_result );
+    if( !stream.consume( entry->length[ symbolCount - 1 ] ) ) return false;
+    out_result = std::copy_n( entry->symbols, symbolCount, out_result );
+  }
+  return true;
+}
@@ -2,6 +2,9 @@
 
 #include <memory>
 #include <stdexcept>
+#include <string>
+#include <vector>
+#include <cstdint>
 
 #include <iostream>
 
@@ -27,6 +30,8 @@ public:
   bool decode( BitStream& stream, char& out_result ) const;
 
 private:
+  friend class HuffmannTable;
+
   Huffmann() = default;
   void deserialize( const char *& cur, const char * const end );
 
@@ -35,3 +40,53 @@ private:
   std::unique_ptr< Huffmann > m_child1;
   char m_leaf;
 };
+
+/**
+@brief Huffmann decoder using lookup tables instead of walking the tree bit by bit
+
+The first LOOKUP_BITS bits of the stream index a table whose entries yield up to MAX_SYMBOLS symbols at once.
+Codes longer than that continue in secondary tables indexed by the following bits.
+**/
+class HuffmannTable
+{
+public:
+  enum
+  {
+    LOOKUP_BITS = 10,
+    MAX_SYMBOLS = 3,
+  };
+
+public:
+  HuffmannTable() = default;
+  explicit HuffmannTable( const Huffmann& tree );
+
+  /**
+  @brief Decode count symbols into out_result, which must have room for them.
+  @return Whether decoding succeeded, i.e. eof was not hit
+  **/
+  bool decode( BitStream& stream, unsigned int count, char* out_result ) const;
+
+private:
+  struct Entry
+  {
+    /// Number of symbols decoded by this entry; 0 for entries linking to a secondary table
+    std::uint8_t symbolCount;
+    /// Total code length up to and including each symbol; for links, bits to consume before looking up the secondary table
+    std::uint8_t length[ MAX_SYMBOLS ];
+    char symbols[ MAX_SYMBOLS ];
+    /// Links only: index bits of the secondary table
+    std::uint8_t tableBits;
+    /// Links only: start of the secondary table
+    std::uint32_t table;
+  };
+
+private:
+  /// Fill the table starting at m_entries[ offset ], which may link to further tables
+  void buildTable( const Huffmann& root, const Huffmann& start, std::uint32_t offset, unsigned int bits, bool multipleSymbols );
+
+private:
+  std::vector< Entry > m_entries;
+  /// Tree consisting of just a leaf: every symbol is this one, decoded from 0 bits
+  bool m_singleSymbol = false;
+  char m_symbol = 0;
+};
@@ -0,0 +1,132 @@
+#include "indexcache.hpp"
+#include "pathindex.hpp"
+#include "mappedfile.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+
+namespace
+{
+  struct CacheHeader
+  {
+    enum : std::uint32_t
+    {
+      VERSION = 1,
+      BYTE_ORDER_MARK = 0x01020304,
+    };
+
+    char magic[ 8 ]; // "BFSINDEX"
+    std::uint32_t version;
+    std::uint32_t byteOrderMark;
+    /// Layout of index entries depends on the build
+    std::uint32_t entrySize;
+    std::uint32_t padding;
+    std::uint64_t archiveSize;
+    std::int64_t archiveModTime;
+    std::uint64_t contentHash;
+    /// Detects corruption of the index data following the header
+    std::uint64_t indexHash;
+  };
+
+  const char MAGIC[ 8 ] = { 'B', 'F', 'S', 'I', 'N', 'D', 'E', 'X' };
+
+  // FNV-1a, 8 bytes at a time
+  std::uint64_t hashBytes( const char* data, std::size_t size )
+  {
+    std::uint64_t hash = 14695981039346656037ull;
+    std::size_t i = 0;
+    for( ; i + sizeof( std::uint64_t ) <= size; i += sizeof( std::uint64_t ) )
+    {
+      std::uint64_t word;
+      std::memcpy( &word, data + i, sizeof( word ) );
+      hash ^= word;
+      hash *= 1099511628211ull;
+    }
+    for( ; i < size; ++i )
+    {
+      hash ^= static_cast< unsigned char >( data[ i ] );
+      hash *= 1099511628211ull;
+    }
+    return hash;
+  }
+
+  CacheHeader makeHeader( const IndexCache::Key& key, std::uint64_t indexHash )
+  {
+    CacheHeader header;
+    std::memcpy( header.magic, MAGIC, sizeof( MAGIC ) );
+    header.version = CacheHeader::VERSION;
+    header.byteOrderMark = CacheHeader::BYTE_ORDER_MARK;
+    header.entrySize = sizeof( PathIndex::Entry );
+    header.padding = 0;
+    header.archiveSize = key.archiveSize;
+    header.archiveModTime = key.archiveModTime;
+    header.contentHash = key.contentHash;
+    header.indexHash = indexHash;
+    return header;
+  }
+}
+
+IndexCache::IndexCache( const std::string& cacheDir, const std::string& archiveName )
+: m_archiveName( archiveName )
+, m_cacheName( sidecarName( cacheDir, archiveName, ".idx" ) )
+{
+}
+
+std::string IndexCache::sidecarName( const std::string& cacheDir, const std::string& archiveName, const char* extension )
+{
+  if( cacheDir.empty() ) return archiveName + extension;
+  const auto slashPos = archiveName.find_last_of( "/\\" );
+  return cacheDir + '/' + ( slashPos == std::string::npos ? archiveName : archiveName.substr( slashPos + 1 ) ) + extension;
+}
+
+bool IndexCache::getKey( const char* metadata, std::size_t metadataSize, Key& out_key ) const
+{
+  return getKey( m_archiveName, metadata, metadataSize, out_key );
+}
+
+bool IndexCache::getKey( const std::string& archiveName, const char* metadata, std::size_t metadataSize, Key& out_key )
+{
+#ifdef _WIN32
+  struct _stat64 info;
+  if( _stat64( archiveName.c_str(), &info ) != 0 || !( info.st_mode & _S_IFREG ) ) return false;
+#else
+  struct stat info;
+  if( ::stat( archiveName.c_str(), &info ) != 0 || !S_ISREG( info.st_mode ) ) return false;
+#endif
+  out_key.archiveSize = info.st_size;
+  out_key.archiveModTime = info.st_mtime;
+
+  out_key.contentHash = hashBytes( metadata, metadataSize );
+  return true;
+}
+
+bool IndexCache::load( const Key& key, PathIndex& index ) const
+{
+  MappedFile file;
+  if( !file.open( m_cacheName.c_str() ) || file.size() < sizeof( CacheHeader ) ) return false;
+  const CacheHeader expected = makeHeader( key, hashBytes( file.data() + sizeof( CacheHeader ), file.size() - sizeof( CacheHeader ) ) );
+  if( std::memcmp( file.data(), &expected, sizeof( CacheHeader ) ) != 0 ) return false;
+  return index.map( std::move( file ), sizeof( CacheHeader ) );
+}
+
+void IndexCache::store( const Key& key, const PathIndex& index ) const
+{
+  // Write to a temporary file first so concurrent mounts never see a partial cache
+  const std::string tempName = m_cacheName + ".tmp";
+  std::FILE* file = std::fopen( tempName.c_str(), "wb" );
+  if( !file ) return;
+  const CacheHeader header = makeHeader( key, hashBytes( index.data(), index.dataSize() ) );
+  const bool written = std::fwrite( &header, sizeof( header ), 1, file ) == 1
+    && std::fwrite( index.data(), index.dataSize(), 1, file ) == 1;
+  if( std::fclose( file ) != 0 || !written )
+  {
+    std::remove( tempName.c_str() );
+    return;
+  }
+#ifdef _WIN32
+  // rename() does not replace existing files on Windows
+  std::remove( m_cacheName.c_str() );
+#endif
+  if( std::rename( tempName.c_str(), m_cacheName.c_str() ) != 0 ) std::remove( tempName.c_str() );
+}
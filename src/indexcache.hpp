@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+class PathIndex;
+
+/**
+@brief Sidecar file storing an archive's PathIndex, so later mounts can map it instead of decoding the string pool.
+
+The cache is keyed on archive size, modification time and a hash of the archive's metadata; any mismatch invalidates it.
+**/
+class IndexCache
+{
+public:
+  struct Key
+  {
+    std::uint64_t archiveSize;
+    std::int64_t archiveModTime;
+    std::uint64_t contentHash;
+  };
+
+public:
+  /**
+  @param cacheDir Directory to store cache files in; if empty, they are stored alongside the archive.
+  @param archiveName Filename of the archive in the native file system.
+  **/
+  IndexCache( const std::string& cacheDir, const std::string& archiveName );
+
+  /**
+  @brief Determine the current key of the archive.
+  @param metadata Data to hash into the key, should include everything the index is derived from.
+  @return false if the archive is not a file in the native file system.
+  **/
+  bool getKey( const char* metadata, std::size_t metadataSize, Key& out_key ) const;
+  static bool getKey( const std::string& archiveName, const char* metadata, std::size_t metadataSize, Key& out_key );
+
+  /// Filename of a sidecar file of the archive with the given extension, in cacheDir or alongside the archive if empty
+  static std::string sidecarName( const std::string& cacheDir, const std::string& archiveName, const char* extension );
+
+  /**
+  @return false if there is no valid cache for the given key; index is unchanged in that case.
+  **/
+  bool load( const Key& key, PathIndex& index ) const;
+
+  /**
+  @brief Try writing the cache; failure is silently ignored since the cache is optional.
+  **/
+  void store( const Key& key, const PathIndex& index ) const;
+
+private:
+  std::string m_archiveName;
+  std::string m_cacheName;
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+/**
+@brief Streaming decompression of zlib data
+
+Implemented by one of several backends chosen at build time via BFS_INFLATE_BACKEND:
+the bundled miniz (default) or zlib. With libdeflate, streaming uses miniz and inflateWhole() uses libdeflate.
+**/
+class Inflater
+{
+public:
+  enum Result
+  {
+    /// Made progress, more to come
+    RESULT_OK,
+    /// Reached the end of the stream
+    RESULT_END,
+    /// Can't make progress without more input
+    RESULT_NEED_INPUT,
+    RESULT_CORRUPT,
+    RESULT_OUT_OF_MEMORY,
+  };
+
+public:
+  /// @throw PHYSFS_ErrorCode on error
+  Inflater();
+  ~Inflater();
+  /// @throw PHYSFS_ErrorCode on error
+  Inflater( const Inflater& rhs );
+  /**
+  @brief Take over the state of rhs, reusing this one's memory where the backend allows
+  @throw PHYSFS_ErrorCode on error
+  **/
+  Inflater& operator=( const Inflater& rhs );
+
+  /// Start over with a new stream, keeping the memory allocated
+  void reset();
+
+  /**
+  @brief Decompress from in to out, advancing both and decreasing their sizes by the bytes consumed and produced
+  **/
+  Result inflate( const unsigned char*& in, std::size_t& inSize, unsigned char*& out, std::size_t& outSize );
+
+  /// Compressed bytes consumed so far
+  std::uint64_t totalIn() const;
+  /// Uncompressed bytes produced so far
+  std::uint64_t totalOut() const;
+
+  /// Approximate memory used by an Inflater
+  static std::size_t stateSize();
+  /// Name of the backend in use
+  static const char* backendName();
+
+private:
+  struct State;
+  State* m_state;
+};
+
+/**
+@brief Decompress a complete zlib stream in one go, without any streaming state.
+@param out Receives the uncompressed data, which must be exactly outSize bytes.
+@return false on error
+**/
+bool inflateWhole( const char* in, std::size_t inSize, char* out, std::size_t outSize );
+
+/**
+@brief Decompress a complete zlib stream like inflateWhole(), reporting where decompression could resume later on.
+@param onBlock Called at the start of each deflate block with the output so far and the block's position in bits from the start of in
+@return false on error
+**/
+bool inflateWholeIndexed( const char* in, std::size_t inSize, char* out, std::size_t outSize, const std::function< void( std::size_t outPos, std::uint64_t inBitPos ) >& onBlock );
+
+/**
+@brief Decompress part of a zlib stream, starting at a deflate block reported by inflateWholeIndexed().
+@param in Compressed data from the byte the block starts in, of which the first skipBits (< 8) belong to the previous block
+@param window Up to 32 KB of output preceding the block, which it may refer back to
+@param out Receives exactly outSize bytes; the stream may continue beyond those
+@param out_adler32 Adler-32 checksum of the output
+@return false on error
+**/
+bool inflatePart( const char* in, std::size_t inSize, unsigned int skipBits, const char* window, std::size_t windowSize, char* out, std::size_t outSize, std::uint32_t& out_adler32 );
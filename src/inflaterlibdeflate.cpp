@@ -0,0 +1,22 @@
+#include "inflater.hpp"
+
+#include <libdeflate.h>
+
+#include <memory>
+
+// libdeflate only decompresses whole buffers, so streaming is left to miniz
+
+struct FreeDecompressor
+{
+  void operator()( libdeflate_decompressor* decompressor ) const { libdeflate_free_decompressor( decompressor ); }
+};
+
+bool inflateWhole( const char* in, std::size_t inSize, char* out, std::size_t outSize )
+{
+  // Decompressors are expensive to set up but can be reused
+  static thread_local std::unique_ptr< libdeflate_decompressor, FreeDecompressor > decompressor( libdeflate_alloc_decompressor() );
+  if( !decompressor ) return false;
+  std::size_t actualSize;
+  return libdeflate_zlib_decompress( decompressor.get(), in, inSize, out, outSize, &actualSize ) == LIBDEFLATE_SUCCESS
+    && actualSize == outSize;
+}
@@ -0,0 +1,254 @@
+#include "inflater.hpp"
+
+#include <physfs.h>
+extern "C"
+{
+#include "physfs_miniz.hpp"
+}
+// Would clash with Inflater::inflate()
+#undef inflate
+
+#include <memory>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+
+// zlib's inflateCopy not supplied by physfs_miniz.hpp
+static int inflateCopy( z_stream* dest, const z_stream* src )
+{
+  if( !dest || !src ) return MZ_PARAM_ERROR;
+  auto prevMsg = dest->msg;
+  std::memcpy( dest, src, sizeof( z_stream ) );
+  dest->msg = prevMsg;
+
+  // copy stream state, if any
+  if( dest->state )
+  {
+    if( !dest->zalloc ) return Z_STREAM_ERROR;
+    inflate_state* state = static_cast< inflate_state* >( dest->zalloc( dest->opaque, 1, sizeof( inflate_state ) ) );
+    if( !state )
+    {
+      dest->state = nullptr;
+      return Z_MEM_ERROR;
+    }
+    std::memcpy( state, src->state, sizeof( inflate_state ) );
+    dest->state = reinterpret_cast< mz_internal_state* >( state );
+  }
+  return Z_OK;
+}
+
+/// Whether inflate can produce more output without further input
+static bool hasPendingOutput( const z_stream& stream )
+{
+  const inflate_state& state = *reinterpret_cast< const inflate_state* >( stream.state );
+  return state.m_dict_avail > 0 || state.m_last_status == TINFL_STATUS_HAS_MORE_OUTPUT;
+}
+
+static void* alloc_func( void *opaque, unsigned int items, unsigned int size )
+{
+  ( void )opaque;
+  return std::malloc( items * size );
+}
+
+static void free_func( void *opaque, void *address )
+{
+  ( void )opaque;
+  std::free( address );
+}
+
+struct Inflater::State
+{
+  z_stream stream;
+};
+
+Inflater::Inflater()
+: m_state( new State{} ) // zero-initialize
+{
+  m_state->stream.zalloc = alloc_func;
+  m_state->stream.zfree = free_func;
+  switch( inflateInit2( &m_state->stream, MAX_WBITS ) )
+  {
+  case Z_OK:
+    break;
+  case Z_MEM_ERROR:
+    delete m_state;
+    throw PHYSFS_ERR_OUT_OF_MEMORY;
+  default:
+    delete m_state;
+    throw PHYSFS_ERR_OTHER_ERROR;
+  }
+}
+
+Inflater::~Inflater()
+{
+  inflateEnd( &m_state->stream );
+  delete m_state;
+}
+
+Inflater::Inflater( const Inflater& rhs )
+: m_state( new State{} )
+{
+  switch( inflateCopy( &m_state->stream, &rhs.m_state->stream ) )
+  {
+  case Z_OK:
+    break;
+  case Z_MEM_ERROR:
+    delete m_state;
+    throw PHYSFS_ERR_OUT_OF_MEMORY;
+  default:
+    delete m_state;
+    throw PHYSFS_ERR_OTHER_ERROR;
+  }
+}
+
+Inflater& Inflater::operator=( const Inflater& rhs )
+{
+  if( this == &rhs ) return *this;
+  // Both states have the same size, so copy into ours instead of allocating another
+  z_stream& stream = m_state->stream;
+  mz_internal_state* const state = stream.state;
+  std::memcpy( &stream, &rhs.m_state->stream, sizeof( z_stream ) );
+  stream.state = state;
+  std::memcpy( state, rhs.m_state->stream.state, sizeof( inflate_state ) );
+  return *this;
+}
+
+void Inflater::reset()
+{
+  inflateReset( &m_state->stream );
+}
+
+Inflater::Result Inflater::inflate( const unsigned char*& in, std::size_t& inSize, unsigned char*& out, std::size_t& outSize )
+{
+  z_stream& stream = m_state->stream;
+  if( inSize == 0 && !hasPendingOutput( stream ) ) return RESULT_NEED_INPUT;
+  stream.next_in = in;
+  stream.avail_in = static_cast< unsigned int >( std::min< std::size_t >( inSize, UINT_MAX ) );
+  stream.next_out = out;
+  stream.avail_out = static_cast< unsigned int >( std::min< std::size_t >( outSize, UINT_MAX ) );
+  const unsigned int availIn = stream.avail_in;
+  const unsigned int availOut = stream.avail_out;
+  const int result = mz_inflate( &stream, Z_SYNC_FLUSH );
+  in += availIn - stream.avail_in;
+  inSize -= availIn - stream.avail_in;
+  out += availOut - stream.avail_out;
+  outSize -= availOut - stream.avail_out;
+  switch( result )
+  {
+  case Z_OK:
+    return RESULT_OK;
+  case Z_STREAM_END:
+    return RESULT_END;
+  case Z_BUF_ERROR:
+    return RESULT_NEED_INPUT;
+  case Z_MEM_ERROR:
+    return RESULT_OUT_OF_MEMORY;
+  default:
+    return RESULT_CORRUPT;
+  }
+}
+
+std::uint64_t Inflater::totalIn() const
+{
+  return m_state->stream.total_in;
+}
+
+std::uint64_t Inflater::totalOut() const
+{
+  return m_state->stream.total_out;
+}
+
+std::size_t Inflater::stateSize()
+{
+  return sizeof( State ) + sizeof( inflate_state );
+}
+
+const char* Inflater::backendName()
+{
+#ifdef BFS_INFLATE_LIBDEFLATE
+  return "miniz+libdeflate";
+#else
+  return "miniz";
+#endif
+}
+
+bool inflateWholeIndexed( const char* in, std::size_t inSize, char* out, std::size_t outSize, const std::function< void( std::size_t outPos, std::uint64_t inBitPos ) >& onBlock )
+{
+  std::unique_ptr< tinfl_decompressor > decompressor( new tinfl_decompressor );
+  tinfl_init( decompressor.get() );
+  std::size_t inPos = 0;
+  std::size_t outPos = 0;
+  while( true )
+  {
+    size_t inBytes = inSize - inPos;
+    size_t outBytes = outSize - outPos;
+    const tinfl_status status = tinfl_decompress( decompressor.get(),
+      reinterpret_cast< const mz_uint8* >( in ) + inPos, &inBytes,
+      reinterpret_cast< mz_uint8* >( out ), reinterpret_cast< mz_uint8* >( out ) + outPos, &outBytes,
+      TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF | TINFL_FLAG_COMPUTE_ADLER32 | TINFL_FLAG_STOP_AT_BLOCKS );
+    inPos += inBytes;
+    outPos += outBytes;
+    if( status != TINFL_STATUS_BLOCK_BOUNDARY ) return status == TINFL_STATUS_DONE && outPos == outSize;
+    // Bits still buffered belong to the next block
+    onBlock( outPos, std::uint64_t( inPos ) * 8 - decompressor->m_num_bits );
+  }
+}
+
+bool inflatePart( const char* in, std::size_t inSize, unsigned int skipBits, const char* window, std::size_t windowSize, char* out, std::size_t outSize, std::uint32_t& out_adler32 )
+{
+  if( skipBits > 7 || ( skipBits > 0 && inSize == 0 ) || windowSize > TINFL_LZ_DICT_SIZE ) return false;
+  std::unique_ptr< tinfl_decompressor > decompressor( new tinfl_decompressor );
+  const mz_uint8* input = reinterpret_cast< const mz_uint8* >( in );
+  if( skipBits > 0 )
+  {
+    tinfl_init_at_block( decompressor.get(), *input >> skipBits, 8 - skipBits );
+    ++input;
+    --inSize;
+  }
+  else
+  {
+    tinfl_init_at_block( decompressor.get(), 0, 0 );
+  }
+  const mz_uint32 flags = TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF | TINFL_FLAG_COMPUTE_ADLER32;
+
+  // Matches only refer back within the output buffer, so start out in one with the window in front
+  const std::size_t headSize = std::min< std::size_t >( outSize, TINFL_LZ_DICT_SIZE );
+  std::unique_ptr< mz_uint8[] > head( new mz_uint8[ windowSize + headSize ] );
+  std::memcpy( head.get(), window, windowSize );
+  size_t inBytes = inSize;
+  size_t outBytes = headSize;
+  tinfl_status status = tinfl_decompress( decompressor.get(), input, &inBytes, head.get(), head.get() + windowSize, &outBytes, flags );
+  if( status < 0 || outBytes != headSize ) return false;
+  std::memcpy( out, head.get() + windowSize, headSize );
+
+  // Then continue in out, which now holds everything matches can refer back to; offsets into the output move with it
+  if( headSize < outSize )
+  {
+    decompressor->m_dist_from_out_buf_start -= windowSize;
+    input += inBytes;
+    inBytes = inSize - inBytes;
+    outBytes = outSize - headSize;
+    status = tinfl_decompress( decompressor.get(), input, &inBytes,
+      reinterpret_cast< mz_uint8* >( out ), reinterpret_cast< mz_uint8* >( out ) + headSize, &outBytes, flags );
+    if( status < 0 || outBytes != outSize - headSize ) return false;
+  }
+  out_adler32 = tinfl_get_adler32( decompressor.get() );
+  return true;
+}
+
+#ifndef BFS_INFLATE_LIBDEFLATE
+bool inflateWhole( const char* in, std::size_t inSize, char* out, std::size_t outSize )
+{
+  // Reused by all calls on this thread instead of allocating one each time
+  static thread_local std::unique_ptr< tinfl_decompressor > decompressor( new tinfl_decompressor );
+  tinfl_init( decompressor.get() );
+  size_t inBytes = inSize;
+  size_t outBytes = outSize;
+  const tinfl_status status = tinfl_decompress( decompressor.get(),
+    reinterpret_cast< const mz_uint8* >( in ), &inBytes,
+    reinterpret_cast< mz_uint8* >( out ), reinterpret_cast< mz_uint8* >( out ), &outBytes,
+    TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF | TINFL_FLAG_COMPUTE_ADLER32 );
+  return status == TINFL_STATUS_DONE && outBytes == outSize;
+}
+#endif
@@ -0,0 +1,74 @@
+#include "inflaterpool.hpp"
+
+#include <utility>
+#include <iterator>
+
+InflaterPool::InflaterPool( std::uint64_t budget )
+: m_budget( budget )
+, m_stats{}
+{
+}
+
+std::unique_ptr< Inflater > InflaterPool::acquireInflater()
+{
+  {
+    std::lock_guard< std::mutex > lock( m_mutex );
+    if( !m_inflaters.empty() )
+    {
+      std::unique_ptr< Inflater > inflater = std::move( m_inflaters.back() );
+      m_inflaters.pop_back();
+      ++m_stats.hits;
+      m_stats.size -= Inflater::stateSize();
+      return inflater;
+    }
+    ++m_stats.misses;
+  }
+  return std::unique_ptr< Inflater >( new Inflater );
+}
+
+void InflaterPool::release( std::unique_ptr< Inflater > inflater )
+{
+  if( !inflater ) return;
+  inflater->reset();
+  std::lock_guard< std::mutex > lock( m_mutex );
+  // Otherwise it's freed along with the parameter, after the lock is released
+  if( reserve( Inflater::stateSize() ) ) m_inflaters.push_back( std::move( inflater ) );
+}
+
+std::vector< unsigned char > InflaterPool::acquireBuffer( std::size_t size )
+{
+  {
+    std::lock_guard< std::mutex > lock( m_mutex );
+    for( auto it = m_buffers.rbegin(); it != m_buffers.rend(); ++it )
+    {
+      if( it->size() != size ) continue;
+      std::vector< unsigned char > buffer = std::move( *it );
+      m_buffers.erase( std::next( it ).base() );
+      ++m_stats.hits;
+      m_stats.size -= size;
+      return buffer;
+    }
+    ++m_stats.misses;
+  }
+  return std::vector< unsigned char >( size );
+}
+
+void InflaterPool::release( std::vector< unsigned char > buffer )
+{
+  if( buffer.empty() ) return;
+  std::lock_guard< std::mutex > lock( m_mutex );
+  if( reserve( buffer.size() ) ) m_buffers.push_back( std::move( buffer ) );
+}
+
+InflaterPool::Stats InflaterPool::getStats() const
+{
+  std::lock_guard< std::mutex > lock( m_mutex );
+  return m_stats;
+}
+
+bool InflaterPool::reserve( std::size_t size )
+{
+  if( m_stats.size + size > m_budget ) return false;
+  m_stats.size += size;
+  return true;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+#include "inflater.hpp"
+
+/**
+@brief Recycles the decompression state and input buffers of compressed files
+
+Opening a compressed file and reading from it would otherwise allocate an Inflater and an input buffer, which are freed again on close.
+Returned Inflaters are reset right away, so they're ready for the next file. The pool only keeps as much as fits its budget
+and frees the rest. All methods are thread-safe.
+**/
+class InflaterPool
+{
+public:
+  struct Stats
+  {
+    /// Inflaters and buffers handed out from the pool
+    std::uint64_t hits;
+    /// Inflaters and buffers that had to be allocated
+    std::uint64_t misses;
+    /// Bytes currently kept
+    std::uint64_t size;
+  };
+
+public:
+  /// @param budget Maximum bytes of Inflaters and buffers to keep
+  explicit InflaterPool( std::uint64_t budget );
+  InflaterPool( const InflaterPool& ) = delete;
+  InflaterPool& operator=( const InflaterPool& ) = delete;
+
+  /**
+  @brief Borrow an Inflater at the start of a stream
+  @throw PHYSFS_ErrorCode on error
+  **/
+  std::unique_ptr< Inflater > acquireInflater();
+  /// Return an Inflater, whether from this pool or not
+  void release( std::unique_ptr< Inflater > inflater );
+
+  /// Borrow a buffer of exactly size bytes, with undefined contents
+  std::vector< unsigned char > acquireBuffer( std::size_t size );
+  /// Return a buffer, whether from this pool or not
+  void release( std::vector< unsigned char > buffer );
+
+  Stats getStats() const;
+
+private:
+  /// Whether another size bytes fit the budget; counts them if so
+  bool reserve( std::size_t size );
+
+private:
+  const std::uint64_t m_budget;
+
+  mutable std::mutex m_mutex;
+  std::vector< std::unique_ptr< Inflater > > m_inflaters;
+  std::vector< std::vector< unsigned char > > m_buffers;
+  Stats m_stats;
+};
@@ -0,0 +1,193 @@
+#include "inflater.hpp"
+
+#include <physfs.h>
+
+#include <climits>
+#include <algorithm>
+
+#include <zlib.h>
+
+struct Inflater::State
+{
+  z_stream stream;
+};
+
+Inflater::Inflater()
+: m_state( new State{} ) // zero-initialize, i.e. use default allocators
+{
+  switch( ::inflateInit2( &m_state->stream, MAX_WBITS ) )
+  {
+  case Z_OK:
+    break;
+  case Z_MEM_ERROR:
+    delete m_state;
+    throw PHYSFS_ERR_OUT_OF_MEMORY;
+  default:
+    delete m_state;
+    throw PHYSFS_ERR_OTHER_ERROR;
+  }
+}
+
+Inflater::~Inflater()
+{
+  ::inflateEnd( &m_state->stream );
+  delete m_state;
+}
+
+Inflater::Inflater( const Inflater& rhs )
+: m_state( new State{} )
+{
+  switch( ::inflateCopy( &m_state->stream, &rhs.m_state->stream ) )
+  {
+  case Z_OK:
+    break;
+  case Z_MEM_ERROR:
+    delete m_state;
+    throw PHYSFS_ERR_OUT_OF_MEMORY;
+  default:
+    delete m_state;
+    throw PHYSFS_ERR_OTHER_ERROR;
+  }
+}
+
+Inflater& Inflater::operator=( const Inflater& rhs )
+{
+  if( this == &rhs ) return *this;
+  // zlib can't copy into an existing state
+  ::inflateEnd( &m_state->stream );
+  m_state->stream = z_stream{};
+  switch( ::inflateCopy( &m_state->stream, &rhs.m_state->stream ) )
+  {
+  case Z_OK:
+    return *this;
+  case Z_MEM_ERROR:
+    throw PHYSFS_ERR_OUT_OF_MEMORY;
+  default:
+    throw PHYSFS_ERR_OTHER_ERROR;
+  }
+}
+
+void Inflater::reset()
+{
+  ::inflateReset( &m_state->stream );
+}
+
+Inflater::Result Inflater::inflate( const unsigned char*& in, std::size_t& inSize, unsigned char*& out, std::size_t& outSize )
+{
+  z_stream& stream = m_state->stream;
+  stream.next_in = const_cast< unsigned char* >( in );
+  stream.avail_in = static_cast< unsigned int >( std::min< std::size_t >( inSize, UINT_MAX ) );
+  stream.next_out = out;
+  stream.avail_out = static_cast< unsigned int >( std::min< std::size_t >( outSize, UINT_MAX ) );
+  const unsigned int availIn = stream.avail_in;
+  const unsigned int availOut = stream.avail_out;
+  const int result = ::inflate( &stream, Z_SYNC_FLUSH );
+  in += availIn - stream.avail_in;
+  inSize -= availIn - stream.avail_in;
+  out += availOut - stream.avail_out;
+  outSize -= availOut - stream.avail_out;
+  switch( result )
+  {
+  case Z_OK:
+    return RESULT_OK;
+  case Z_STREAM_END:
+    return RESULT_END;
+  case Z_BUF_ERROR:
+    return RESULT_NEED_INPUT;
+  case Z_MEM_ERROR:
+    return RESULT_OUT_OF_MEMORY;
+  default:
+    return RESULT_CORRUPT;
+  }
+}
+
+std::uint64_t Inflater::totalIn() const
+{
+  return m_state->stream.total_in;
+}
+
+std::uint64_t Inflater::totalOut() const
+{
+  return m_state->stream.total_out;
+}
+
+std::size_t Inflater::stateSize()
+{
+  // zlib's internal state including its 32 KB window
+  return sizeof( State ) + 7 * 1024 + ( 1 << MAX_WBITS );
+}
+
+const char* Inflater::backendName()
+{
+  return "zlib";
+}
+
+bool inflateWhole( const char* in, std::size_t inSize, char* out, std::size_t outSize )
+{
+  if( inSize > UINT_MAX || outSize > UINT_MAX ) return false;
+  z_stream stream{};
+  if( ::inflateInit2( &stream, MAX_WBITS ) != Z_OK ) return false;
+  stream.next_in = reinterpret_cast< unsigned char* >( const_cast< char* >( in ) );
+  stream.avail_in = static_cast< unsigned int >( inSize );
+  stream.next_out = reinterpret_cast< unsigned char* >( out );
+  stream.avail_out = static_cast< unsigned int >( outSize );
+  const int result = ::inflate( &stream, Z_FINISH );
+  const bool success = result == Z_STREAM_END && stream.total_out == outSize;
+  ::inflateEnd( &stream );
+  return success;
+}
+
+bool inflateWholeIndexed( const char* in, std::size_t inSize, char* out, std::size_t outSize, const std::function< void( std::size_t outPos, std::uint64_t inBitPos ) >& onBlock )
+{
+  if( inSize > UINT_MAX || outSize > UINT_MAX ) return false;
+  z_stream stream{};
+  if( ::inflateInit2( &stream, MAX_WBITS ) != Z_OK ) return false;
+  stream.next_in = reinterpret_cast< unsigned char* >( const_cast< char* >( in ) );
+  stream.avail_in = static_cast< unsigned int >( inSize );
+  stream.next_out = reinterpret_cast< unsigned char* >( out );
+  stream.avail_out = static_cast< unsigned int >( outSize );
+  int result;
+  do
+  {
+    result = ::inflate( &stream, Z_BLOCK );
+    // Stopped after the header or an end of block code, with the given number of bits of the last byte left over
+    if( result == Z_OK && ( stream.data_type & 128 ) && !( stream.data_type & 64 ) )
+    {
+      onBlock( stream.total_out, std::uint64_t( stream.total_in ) * 8 - ( stream.data_type & 7 ) );
+    }
+  } while( result == Z_OK );
+  const bool success = result == Z_STREAM_END && stream.total_out == outSize;
+  ::inflateEnd( &stream );
+  return success;
+}
+
+bool inflatePart( const char* in, std::size_t inSize, unsigned int skipBits, const char* window, std::size_t windowSize, char* out, std::size_t outSize, std::uint32_t& out_adler32 )
+{
+  if( skipBits > 7 || ( skipBits > 0 && inSize == 0 ) || inSize > UINT_MAX || outSize > UINT_MAX || windowSize > 32768 ) return false;
+  z_stream stream{};
+  if( ::inflateInit2( &stream, -MAX_WBITS ) != Z_OK ) return false;
+  const unsigned char* input = reinterpret_cast< const unsigned char* >( in );
+  bool success = true;
+  if( skipBits > 0 )
+  {
+    success = ::inflatePrime( &stream, 8 - skipBits, *input >> skipBits ) == Z_OK;
+    ++input;
+    --inSize;
+  }
+  if( windowSize > 0 )
+  {
+    success = success && ::inflateSetDictionary( &stream, reinterpret_cast< const unsigned char* >( window ), static_cast< unsigned int >( windowSize ) ) == Z_OK;
+  }
+  stream.next_in = const_cast< unsigned char* >( input );
+  stream.avail_in = static_cast< unsigned int >( inSize );
+  stream.next_out = reinterpret_cast< unsigned char* >( out );
+  stream.avail_out = static_cast< unsigned int >( outSize );
+  if( success )
+  {
+    const int result = ::inflate( &stream, Z_NO_FLUSH );
+    success = ( result == Z_OK || result == Z_STREAM_END ) && stream.avail_out == 0;
+  }
+  ::inflateEnd( &stream );
+  if( success ) out_adler32 = ::adler32( 1, reinterpret_cast< const unsigned char* >( out ), static_cast< unsigned int >( outSize ) );
+  return success;
+}
@@ -7,7 +7,15 @@
 
 #include <iostream>
 #include <string>
-#include <fstream>
+
+#ifdef _WIN32
+# include <io.h>
+# include <fcntl.h>
+# include <sys/stat.h>
+#else
+# include <fcntl.h>
+# include <unistd.h>
+#endif
 
 void recursiveDir( const std::string& dir, unsigned indent )
 {
@@ -70,6 +78,9 @@ int main( int argc, char** argv )
   }
   std::string mountFile = "patch1.bfs";
   if( argc > 1 ) mountFile = argv[ 1 ];
+  // Record access points of large files instead of unpacking one, so they're decompressed in parallel from then on
+  const bool buildAccessIndex = argc > 2 && std::string( argv[ 2 ] ) == "--build-access-index";
+  if( buildAccessIndex ) setBfsParallelInflate( 1, 0 );
 
   if( !PHYSFS_mount( mountFile.c_str(), "/", true ) )
   {
@@ -77,12 +88,25 @@ int main( int argc, char** argv )
     return 1;
   }
 
-  if( argc > 2 )
+  if( buildAccessIndex )
+  {
+    if( !buildBfsAccessIndex( mountFile.c_str(), 16 * 1024 * 1024, 4 * 1024 * 1024 ) )
+    {
+      std::cerr << "Error building access index of " << mountFile << ": " << PHYSFS_getLastError() << std::endl;
+      return 1;
+    }
+    BFSArchiveStats stats;
+    if( getBfsArchiveStats( mountFile.c_str(), &stats ) )
+    {
+      std::cout << "Recorded " << stats.accessIndexPoints << " access points in " << stats.accessIndexFiles << " files of " << mountFile << std::endl;
+    }
+  }
+  else if( argc > 2 )
   {
-    auto file = PHYSFS_openRead( argv[ 2 ] );
-    if( !file )
+    PHYSFS_Stat stat;
+    if( !PHYSFS_stat( argv[ 2 ], &stat ) || stat.filetype != PHYSFS_FILETYPE_REGULAR )
     {
-      std::cerr << "Error opening " << argv[ 2 ] << ": " << PHYSFS_getLastError() << std::endl;
+      std::cerr << "Error opening " << argv[ 2 ] << ": not a file" << std::endl;
     }
     else
     {
@@ -91,34 +115,37 @@ int main( int argc, char** argv )
       {
         if( c == '/' || c == '\\' ) c = ',';
       }
-      std::ofstream outFile( outFilename.c_str(), std::ios::binary );
-      if( !outFile.fail() )
+#ifdef _WIN32
+      const int fd = _open( outFilename.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE );
+#else
+      const int fd = open( outFilename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+#endif
+      if( fd == -1 )
+      {
+        std::cerr << "Error writing to " << outFilename << "!" << std::endl;
+      }
+      else
       {
-        PHYSFS_sint64 bytesRead = 0;
-        char buffer[ 1024 ];
-        bool error = false;
-        while( ( bytesRead = PHYSFS_readBytes( file, buffer, sizeof( buffer ) ) ) > 0 )
+        // Copies straight from the archive file if possible, otherwise in large chunks
+        const long long bytesWritten = exportBfsFile( argv[ 2 ], fd );
+#ifdef _WIN32
+        const bool closed = _close( fd ) == 0;
+#else
+        const bool closed = close( fd ) == 0;
+#endif
+        if( bytesWritten < 0 )
+        {
+          std::cerr << "Error unpacking " << argv[ 2 ] << ": " << PHYSFS_getLastError() << std::endl;
+        }
+        else if( !closed )
         {
-          if( bytesRead < sizeof( buffer ) && !PHYSFS_eof( file ) )
-          {
-            std::cerr << "Error reading from " << argv[ 2 ] << ": " << PHYSFS_getLastError() << std::endl;
-            error = true;
-            break;
-          }
-          outFile.write( buffer, bytesRead );
-          if( outFile.fail() )
-          {
-            std::cerr << "Error writing to " << outFilename << "!" << std::endl;
-            error = true;
-            break;
-          }
+          std::cerr << "Error writing to " << outFilename << "!" << std::endl;
         }
-        if( !error )
+        else
         {
           std::cout << "Unpacked " << argv[ 2 ] << " to " << outFilename << std::endl;
         }
       }
-      PHYSFS_close( file );
     }
   }
   else
@@ -0,0 +1,108 @@
+#include "mappedfile.hpp"
+
+#include <utility>
+
+#ifdef _WIN32
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#else
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+# ifndef O_CLOEXEC
+#  define O_CLOEXEC 0
+# endif
+#endif
+
+MappedFile::~MappedFile()
+{
+  close();
+}
+
+MappedFile::MappedFile( MappedFile&& rhs )
+: m_data( rhs.m_data )
+, m_size( rhs.m_size )
+, m_descriptor( rhs.m_descriptor )
+{
+  rhs.m_data = nullptr;
+  rhs.m_size = 0;
+  rhs.m_descriptor = -1;
+}
+
+MappedFile& MappedFile::operator=( MappedFile&& rhs )
+{
+  if( this == &rhs ) return *this;
+  close();
+  std::swap( m_data, rhs.m_data );
+  std::swap( m_size, rhs.m_size );
+  std::swap( m_descriptor, rhs.m_descriptor );
+  return *this;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open( const char* filename, bool )
+{
+  close();
+  HANDLE file = CreateFileA( filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+  if( file == INVALID_HANDLE_VALUE ) return false;
+  LARGE_INTEGER size;
+  if( !GetFileSizeEx( file, &size ) || size.QuadPart == 0 || GetFileType( file ) != FILE_TYPE_DISK )
+  {
+    CloseHandle( file );
+    return false;
+  }
+  HANDLE mapping = CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+  // the view keeps the file open
+  CloseHandle( file );
+  if( !mapping ) return false;
+  const void* data = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+  CloseHandle( mapping );
+  if( !data ) return false;
+  m_data = static_cast< const char* >( data );
+  m_size = static_cast< std::size_t >( size.QuadPart );
+  return true;
+}
+
+void MappedFile::close()
+{
+  if( m_data ) UnmapViewOfFile( m_data );
+  m_data = nullptr;
+  m_size = 0;
+}
+
+#else
+
+bool MappedFile::open( const char* filename, bool keepDescriptor )
+{
+  close();
+  // the descriptor may be kept, so don't leak it into child processes
+  int fd = ::open( filename, O_RDONLY | O_CLOEXEC );
+  if( fd == -1 ) return false;
+  struct stat info;
+  if( fstat( fd, &info ) != 0 || !S_ISREG( info.st_mode ) || info.st_size == 0 )
+  {
+    ::close( fd );
+    return false;
+  }
+  void* data = mmap( nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+  // the mapping keeps the file open, so the descriptor is only needed for descriptor()
+  if( data == MAP_FAILED || !keepDescriptor ) ::close( fd );
+  if( data == MAP_FAILED ) return false;
+  m_data = static_cast< const char* >( data );
+  m_size = static_cast< std::size_t >( info.st_size );
+  if( keepDescriptor ) m_descriptor = fd;
+  return true;
+}
+
+void MappedFile::close()
+{
+  if( m_data ) munmap( const_cast< char* >( m_data ), m_size );
+  if( m_descriptor != -1 ) ::close( m_descriptor );
+  m_data = nullptr;
+  m_size = 0;
+  m_descriptor = -1;
+}
+
+#endif
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+@brief Read-only memory mapping of a whole file
+**/
+class MappedFile
+{
+public:
+  MappedFile() = default;
+  ~MappedFile();
+  MappedFile( const MappedFile& ) = delete;
+  MappedFile& operator=( const MappedFile& ) = delete;
+  MappedFile( MappedFile&& rhs );
+  MappedFile& operator=( MappedFile&& rhs );
+
+  /**
+  @brief Map the given file, replacing any previous mapping.
+  @param keepDescriptor Keep the file open for descriptor(), where supported
+  @return false if the file could not be mapped, e.g. because it does not exist, is empty or is not a regular file.
+  **/
+  bool open( const char* filename, bool keepDescriptor = false );
+  void close();
+
+  bool isOpen() const { return m_data != nullptr; }
+  const char* data() const { return m_data; }
+  std::size_t size() const { return m_size; }
+  /// File descriptor of the mapped file, for copying from it in the kernel; -1 unless kept open, or not available on this platform
+  int descriptor() const { return m_descriptor; }
+
+private:
+  const char* m_data = nullptr;
+  std::size_t m_size = 0;
+  int m_descriptor = -1;
+};
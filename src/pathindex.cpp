@@ -0,0 +1,265 @@
+#include "pathindex.hpp"
+
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cassert>
+
+namespace
+{
+  struct BuildEntry
+  {
+    std::string path;
+    PathIndex::Type type;
+    BFSFile::Info info;
+    std::uint32_t parent;
+  };
+
+  template< typename T >
+  T* place( std::vector< char >& storage, std::size_t& offset, std::size_t count )
+  {
+    T* result = reinterpret_cast< T* >( storage.data() + offset );
+    offset += count * sizeof( T );
+    return result;
+  }
+}
+
+std::uint32_t PathIndex::hash( const char* str, std::size_t len )
+{
+  // FNV-1a
+  std::uint32_t result = 2166136261u;
+  for( std::size_t i = 0; i < len; ++i )
+  {
+    result ^= static_cast< unsigned char >( str[ i ] );
+    result *= 16777619u;
+  }
+  return result;
+}
+
+void PathIndex::build( const FileList& files )
+{
+  std::vector< BuildEntry > entries;
+  std::unordered_map< std::string, std::uint32_t > dirs;
+  std::unordered_map< std::string, std::uint32_t > knownFiles;
+
+  entries.push_back( { std::string(), TYPE_DIRECTORY, {}, 0 } );
+  dirs.emplace( std::string(), 0 );
+
+  // Returns index of the given directory, creating it and its parents as necessary
+  auto getDirectory = [ &entries, &dirs ]( const std::string& path )
+  {
+    std::uint32_t parent = 0;
+    std::string::size_type slashPos = 0;
+    while( slashPos != std::string::npos )
+    {
+      slashPos = path.find( '/', slashPos + 1 );
+      std::string prefix = path.substr( 0, slashPos );
+      auto entry = dirs.find( prefix );
+      if( entry == dirs.end() )
+      {
+        std::uint32_t index = entries.size();
+        entries.push_back( { prefix, TYPE_DIRECTORY, {}, parent } );
+        entry = dirs.emplace( std::move( prefix ), index ).first;
+      }
+      parent = entry->second;
+    }
+    return parent;
+  };
+
+  for( const auto& file : files )
+  {
+    const std::string& path = file.first;
+    if( path.empty() || knownFiles.count( path ) ) continue;
+    auto slashPos = path.rfind( '/' );
+    std::uint32_t parent = slashPos == std::string::npos ? 0 : getDirectory( path.substr( 0, slashPos ) );
+    knownFiles.emplace( path, entries.size() );
+    entries.push_back( { path, TYPE_FILE, file.second, parent } );
+  }
+
+  // Group children by parent, directories first, then by name
+  std::vector< std::uint32_t > children;
+  children.reserve( entries.size() - 1 );
+  for( std::uint32_t index = 1; index < entries.size(); ++index ) children.push_back( index );
+  auto baseName = [ &entries ]( std::uint32_t index )
+  {
+    const std::string& path = entries[ index ].path;
+    auto slashPos = path.rfind( '/' );
+    return slashPos == std::string::npos ? path.c_str() : path.c_str() + slashPos + 1;
+  };
+  std::sort( children.begin(), children.end(), [ &entries, &baseName ]( std::uint32_t lhs, std::uint32_t rhs )
+  {
+    const BuildEntry& l = entries[ lhs ];
+    const BuildEntry& r = entries[ rhs ];
+    if( l.parent != r.parent ) return l.parent < r.parent;
+    if( l.type != r.type ) return l.type == TYPE_DIRECTORY;
+    return std::strcmp( baseName( lhs ), baseName( rhs ) ) < 0;
+  } );
+
+  // Allocate storage
+  std::uint32_t slotCount = 2;
+  while( slotCount < entries.size() * 2 ) slotCount <<= 1;
+  std::size_t namesSize = 0;
+  for( const auto& entry : entries ) namesSize += entry.path.size() + 1;
+
+  const std::size_t size = sizeof( Header )
+    + slotCount * sizeof( Slot )
+    + entries.size() * sizeof( Entry )
+    + children.size() * sizeof( std::uint32_t )
+    + namesSize;
+  std::vector< char > storage( size ); // zero-initialize, so padding is deterministic
+  std::size_t offset = 0;
+  Header* header = place< Header >( storage, offset, 1 );
+  Slot* slots = place< Slot >( storage, offset, slotCount );
+  Entry* outEntries = place< Entry >( storage, offset, entries.size() );
+  std::uint32_t* outChildren = place< std::uint32_t >( storage, offset, children.size() );
+  char* names = place< char >( storage, offset, namesSize );
+  assert( offset == size );
+
+  header->slotCount = slotCount;
+  header->entryCount = entries.size();
+  header->childCount = children.size();
+  header->namesSize = namesSize;
+
+  std::copy( children.begin(), children.end(), outChildren );
+
+  std::uint32_t nameOffset = 0;
+  std::uint32_t childOffset = 0;
+  for( std::uint32_t index = 0; index < entries.size(); ++index )
+  {
+    const BuildEntry& in = entries[ index ];
+    Entry& out = outEntries[ index ];
+    out.hash = hash( in.path.data(), in.path.size() );
+    out.nameOffset = nameOffset;
+    out.nameLength = in.path.size();
+    out.baseNameOffset = baseName( index ) - in.path.c_str();
+    out.type = in.type;
+    out.info = in.info;
+    std::memcpy( names + nameOffset, in.path.c_str(), in.path.size() + 1 );
+    nameOffset += in.path.size() + 1;
+
+    if( in.type == TYPE_DIRECTORY )
+    {
+      // children are sorted by parent, so find this directory's range
+      while( childOffset < children.size() && entries[ children[ childOffset ] ].parent < index ) ++childOffset;
+      out.firstChild = childOffset;
+      while( childOffset < children.size() && entries[ children[ childOffset ] ].parent == index ) ++childOffset;
+      out.childCount = childOffset - out.firstChild;
+    }
+
+    // Linear probing
+    std::uint32_t slot = out.hash & ( slotCount - 1 );
+    while( slots[ slot ].entry ) slot = ( slot + 1 ) & ( slotCount - 1 );
+    slots[ slot ].hash = out.hash;
+    slots[ slot ].entry = index + 1;
+  }
+
+  m_mapping.close();
+  m_storage = std::move( storage );
+  attach( m_storage.data(), m_storage.size() );
+}
+
+bool PathIndex::map( MappedFile&& mapping, std::size_t offset )
+{
+  if( !mapping.isOpen() || offset > mapping.size() || !validate( mapping.data() + offset, mapping.size() - offset ) ) return false;
+  m_storage.clear();
+  m_mapping = std::move( mapping );
+  attach( m_mapping.data() + offset, m_mapping.size() - offset );
+  return true;
+}
+
+bool PathIndex::validate( const char* data, std::size_t size )
+{
+  if( size < sizeof( Header ) ) return false;
+  const Header& header = *reinterpret_cast< const Header* >( data );
+  if( header.slotCount == 0 || ( header.slotCount & ( header.slotCount - 1 ) ) || header.entryCount == 0 || header.namesSize == 0 ) return false;
+  const std::uint64_t expectedSize = sizeof( Header )
+    + std::uint64_t( header.slotCount ) * sizeof( Slot )
+    + std::uint64_t( header.entryCount ) * sizeof( Entry )
+    + std::uint64_t( header.childCount ) * sizeof( std::uint32_t )
+    + header.namesSize;
+  if( expectedSize != size ) return false;
+
+  const Slot* slots = reinterpret_cast< const Slot* >( data + sizeof( Header ) );
+  const Entry* entries = reinterpret_cast< const Entry* >( slots + header.slotCount );
+  const std::uint32_t* children = reinterpret_cast< const std::uint32_t* >( entries + header.entryCount );
+  const char* names = reinterpret_cast< const char* >( children + header.childCount );
+
+  // Probing terminates at empty slots, so there must be one
+  bool haveEmptySlot = false;
+  for( std::uint32_t slot = 0; slot < header.slotCount; ++slot )
+  {
+    if( slots[ slot ].entry > header.entryCount ) return false;
+    haveEmptySlot |= slots[ slot ].entry == 0;
+  }
+  if( !haveEmptySlot ) return false;
+  for( std::uint32_t child = 0; child < header.childCount; ++child )
+  {
+    if( children[ child ] == 0 || children[ child ] >= header.entryCount ) return false;
+  }
+  if( names[ header.namesSize - 1 ] != '\0' ) return false;
+  for( std::uint32_t index = 0; index < header.entryCount; ++index )
+  {
+    const Entry& entry = entries[ index ];
+    if( std::uint64_t( entry.nameOffset ) + entry.nameLength >= header.namesSize
+      || names[ entry.nameOffset + entry.nameLength ] != '\0'
+      || entry.baseNameOffset > entry.nameLength ) return false;
+    switch( entry.type )
+    {
+    case TYPE_DIRECTORY:
+      if( std::uint64_t( entry.firstChild ) + entry.childCount > header.childCount ) return false;
+      break;
+    case TYPE_FILE:
+      break;
+    default:
+      return false;
+    }
+  }
+  return entries[ 0 ].type == TYPE_DIRECTORY;
+}
+
+void PathIndex::attach( const char* data, std::size_t size )
+{
+  m_size = size;
+  std::size_t offset = 0;
+  auto at = [ data, &offset ]( std::size_t size )
+  {
+    const char* result = data + offset;
+    offset += size;
+    return result;
+  };
+  m_header = reinterpret_cast< const Header* >( at( sizeof( Header ) ) );
+  m_slots = reinterpret_cast< const Slot* >( at( m_header->slotCount * sizeof( Slot ) ) );
+  m_entries = reinterpret_cast< const Entry* >( at( m_header->entryCount * sizeof( Entry ) ) );
+  m_children = reinterpret_cast< const std::uint32_t* >( at( m_header->childCount * sizeof( std::uint32_t ) ) );
+  m_names = at( m_header->namesSize );
+}
+
+const PathIndex::Entry* PathIndex::find( const char* path, const Type* type ) const
+{
+  if( !m_header ) return nullptr;
+
+  std::size_t len = std::strlen( path );
+  // trailing slash: must be a directory
+  if( len > 0 && path[ len - 1 ] == '/' )
+  {
+    --len;
+    static const Type directory = TYPE_DIRECTORY;
+    if( type && *type != TYPE_DIRECTORY ) return nullptr;
+    type = &directory;
+  }
+
+  const std::uint32_t pathHash = hash( path, len );
+  const std::uint32_t mask = m_header->slotCount - 1;
+  for( std::uint32_t slot = pathHash & mask; m_slots[ slot ].entry; slot = ( slot + 1 ) & mask )
+  {
+    if( m_slots[ slot ].hash != pathHash ) continue;
+    const Entry& entry = m_entries[ m_slots[ slot ].entry - 1 ];
+    if( entry.nameLength == len
+      && std::memcmp( m_names + entry.nameOffset, path, len ) == 0
+      && ( !type || entry.type == *type ) )
+    {
+      return &entry;
+    }
+  }
+  return nullptr;
+}
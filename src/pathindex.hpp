@@ -0,0 +1,110 @@
+#pragma once
+
+#include "bfsfile.hpp"
+#include "mappedfile.hpp"
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+/**
+@brief Flat, open-addressed hash index of all paths in an archive
+
+Every file and every directory is an entry keyed on its full normalized path (no leading or trailing slash, root is the empty path).
+All data lives in one contiguous block, so lookups resolve in a single probe sequence without allocating.
+**/
+class PathIndex
+{
+public:
+  enum Type : std::uint32_t
+  {
+    TYPE_DIRECTORY,
+    TYPE_FILE,
+  };
+
+  struct Entry
+  {
+    /// Hash of the full path
+    std::uint32_t hash;
+    /// Full path, null-terminated, relative to start of name data
+    std::uint32_t nameOffset;
+    std::uint32_t nameLength;
+    /// Last path component starts this many bytes into the full path
+    std::uint32_t baseNameOffset;
+    Type type;
+    /// Directories: range of child entry indices, directories first, sorted by name
+    std::uint32_t firstChild;
+    std::uint32_t childCount;
+    /// Files: location in archive
+    BFSFile::Info info;
+  };
+
+  typedef std::vector< std::pair< std::string, BFSFile::Info > > FileList;
+
+public:
+  PathIndex() = default;
+  ~PathIndex() = default;
+  PathIndex( const PathIndex& ) = delete;
+  PathIndex& operator=( const PathIndex& ) = delete;
+
+  /**
+  @brief Replace contents with an index of the given files; their parent directories are added implicitly.
+  **/
+  void build( const FileList& files );
+
+  /**
+  @brief Replace contents with index data previously retrieved via data(), e.g. from a cache file.
+  @param offset Start of index data within mapping, must be 4 byte aligned.
+  @return false if the data is not a consistent index, leaving the index unchanged.
+  **/
+  bool map( MappedFile&& mapping, std::size_t offset );
+
+  /// Serialized index, valid until the next build() or map()
+  const char* data() const { return reinterpret_cast< const char* >( m_header ); }
+  std::size_t dataSize() const { return m_size; }
+
+  /**
+  @param path Path relative to archive root, optionally with a trailing slash (which only matches directories).
+  @param type Only entries of this type match, unless nullptr is passed for any type.
+  @return Matching entry or nullptr.
+  **/
+  const Entry* find( const char* path, const Type* type = nullptr ) const;
+
+  const Entry& root() const { return m_entries[ 0 ]; }
+  const Entry& child( const Entry& dir, std::uint32_t index ) const { return m_entries[ m_children[ dir.firstChild + index ] ]; }
+  const char* name( const Entry& entry ) const { return m_names + entry.nameOffset; }
+  const char* baseName( const Entry& entry ) const { return m_names + entry.nameOffset + entry.baseNameOffset; }
+
+private:
+  struct Header
+  {
+    std::uint32_t slotCount;
+    std::uint32_t entryCount;
+    std::uint32_t childCount;
+    std::uint32_t namesSize;
+  };
+
+  struct Slot
+  {
+    std::uint32_t hash;
+    /// Entry index + 1, 0 for empty slots
+    std::uint32_t entry;
+  };
+
+  static std::uint32_t hash( const char* str, std::size_t len );
+  static bool validate( const char* data, std::size_t size );
+  void attach( const char* data, std::size_t size );
+
+private:
+  /// Owns the index data all members below point into, unless it was mapped
+  std::vector< char > m_storage;
+  MappedFile m_mapping;
+  std::size_t m_size = 0;
+  const Header* m_header = nullptr;
+  const Slot* m_slots = nullptr;
+  const Entry* m_entries = nullptr;
+  const std::uint32_t* m_children = nullptr;
+  const char* m_names = nullptr;
+};
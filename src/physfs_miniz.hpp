@@ -22,7 +22,7 @@ typedef unsigned long mz_ulong;
 typedef void *(*mz_alloc_func)(void *opaque, unsigned int items, unsigned int size);
 typedef void (*mz_free_func)(void *opaque, void *address);
 
-#if defined(_M_IX86) || defined(_M_X64)
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__) || (defined(__aarch64__) && defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__))
 /* Set MINIZ_USE_UNALIGNED_LOADS_AND_STORES to 1 if integer loads and stores to unaligned addresses are acceptable on the target platform (slightly faster). */
 #define MINIZ_USE_UNALIGNED_LOADS_AND_STORES 1
 /* Set MINIZ_LITTLE_ENDIAN to 1 if the processor is little endian. */
@@ -47,7 +47,8 @@ enum
   TINFL_FLAG_PARSE_ZLIB_HEADER = 1,
   TINFL_FLAG_HAS_MORE_INPUT = 2,
   TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF = 4,
-  TINFL_FLAG_COMPUTE_ADLER32 = 8
+  TINFL_FLAG_COMPUTE_ADLER32 = 8,
+  TINFL_FLAG_STOP_AT_BLOCKS = 16
 };
 
 struct tinfl_decompressor_tag; typedef struct tinfl_decompressor_tag tinfl_decompressor;
@@ -63,11 +64,18 @@ typedef enum
   TINFL_STATUS_FAILED = -1,
   TINFL_STATUS_DONE = 0,
   TINFL_STATUS_NEEDS_MORE_INPUT = 1,
-  TINFL_STATUS_HAS_MORE_OUTPUT = 2
+  TINFL_STATUS_HAS_MORE_OUTPUT = 2,
+  TINFL_STATUS_BLOCK_BOUNDARY = 3
 } tinfl_status;
 
 /* Initializes the decompressor to its initial state. */
 #define tinfl_init(r) do { (r)->m_state = 0; } MZ_MACRO_END
+/* With TINFL_FLAG_STOP_AT_BLOCKS, tinfl_decompress() returns TINFL_STATUS_BLOCK_BOUNDARY before each block header; call it again to continue. */
+/* The block then starts m_num_bits bits before the end of the input consumed so far. */
+#define TINFL_STATE_BLOCK_BOUNDARY 54
+/* Initializes the decompressor to continue raw deflate data at a block boundary, where the low num_bits (< 8) bits of bits are left of the byte before the next input. */
+/* Matches may refer back to the output buffer's contents before pOut_buf_next, if non-wrapping. */
+#define tinfl_init_at_block(r, bits, num_bits) do { (r)->m_state = TINFL_STATE_BLOCK_BOUNDARY; (r)->m_bit_buf = (bits); (r)->m_num_bits = (num_bits); (r)->m_dist = (r)->m_counter = (r)->m_num_extra = (r)->m_final = 0; (r)->m_z_adler32 = (r)->m_check_adler32 = 1; (r)->m_dist_from_out_buf_start = (r)->m_total_out = 0; } MZ_MACRO_END
 #define tinfl_get_adler32(r) (r)->m_check_adler32
 
 /* Main low-level decompressor coroutine function. This is the only function actually needed for decompression. All the other functions are just high-level helpers for improved usability. */
@@ -103,7 +111,7 @@ struct tinfl_decompressor_tag
 {
   mz_uint32 m_state, m_num_bits, m_zhdr0, m_zhdr1, m_z_adler32, m_final, m_type, m_check_adler32, m_dist, m_counter, m_num_extra, m_table_sizes[TINFL_MAX_HUFF_TABLES];
   tinfl_bit_buf_t m_bit_buf;
-  size_t m_dist_from_out_buf_start;
+  size_t m_dist_from_out_buf_start, m_total_out;
   tinfl_huff_table m_tables[TINFL_MAX_HUFF_TABLES];
   mz_uint8 m_raw_header[4], m_len_codes[TINFL_MAX_HUFF_SYMBOLS_0 + TINFL_MAX_HUFF_SYMBOLS_1 + 137];
 };
@@ -121,6 +129,9 @@ struct tinfl_decompressor_tag
 #if MINIZ_USE_UNALIGNED_LOADS_AND_STORES && MINIZ_LITTLE_ENDIAN
   #define MZ_READ_LE16(p) *((const mz_uint16 *)(p))
   #define MZ_READ_LE32(p) *((const mz_uint32 *)(p))
+  /* memcpy() compiles to a single load without the aliasing questions of the casts above. */
+  static mz_uint64 tinfl_load_u64(const void *p) { mz_uint64 v; memcpy(&v, p, sizeof(v)); return v; }
+  #define MZ_READ_LE64(p) tinfl_load_u64(p)
 #else
   #define MZ_READ_LE16(p) ((mz_uint32)(((const mz_uint8 *)(p))[0]) | ((mz_uint32)(((const mz_uint8 *)(p))[1]) << 8U))
   #define MZ_READ_LE32(p) ((mz_uint32)(((const mz_uint8 *)(p))[0]) | ((mz_uint32)(((const mz_uint8 *)(p))[1]) << 8U) | ((mz_uint32)(((const mz_uint8 *)(p))[2]) << 16U) | ((mz_uint32)(((const mz_uint8 *)(p))[3]) << 24U))
@@ -129,6 +140,29 @@ struct tinfl_decompressor_tag
 #define TINFL_MEMCPY(d, s, l) memcpy(d, s, l)
 #define TINFL_MEMSET(p, c, l) memset(p, c, l)
 
+/* With a 64-bit bit buffer and cheap unaligned loads, the fast decoding paths top up the bit buffer to at least 56 bits with a single 8-byte load. */
+/* That is enough for a length code, its extra bits, a distance code and its extra bits (15 + 5 + 15 + 13 bits) without checking in between. Only the bytes */
+/* actually consumed are merged in, so the bits above num_bits stay zero like everywhere else. */
+#if TINFL_USE_64BIT_BITBUF && MINIZ_USE_UNALIGNED_LOADS_AND_STORES && MINIZ_LITTLE_ENDIAN
+  #define TINFL_USE_WIDE_REFILL 1
+  #define TINFL_FAST_INPUT_BYTES 8
+  #define TINFL_WIDE_REFILL() do { mz_uint refill_bytes = (63 - num_bits) >> 3; \
+    bit_buf |= (MZ_READ_LE64(pIn_buf_cur) & ((((tinfl_bit_buf_t)1) << (refill_bytes << 3)) - 1)) << num_bits; \
+    pIn_buf_cur += refill_bytes; num_bits += refill_bytes << 3; } MZ_MACRO_END
+#else
+  #define TINFL_USE_WIDE_REFILL 0
+  #define TINFL_FAST_INPUT_BYTES 4
+#endif
+
+/* Looks up the next Huffman code in the bit buffer, which the caller guarantees holds at least 15 bits. */
+#define TINFL_FAST_HUFF_DECODE(sym, pHuff) do { \
+  int fast_sym; mz_uint fast_len; \
+  if ((fast_sym = (pHuff)->m_look_up[bit_buf & (TINFL_FAST_LOOKUP_SIZE - 1)]) >= 0) \
+    fast_len = fast_sym >> 9, fast_sym &= 511; \
+  else { \
+    fast_len = TINFL_FAST_LOOKUP_BITS; do { fast_sym = (pHuff)->m_tree[~fast_sym + ((bit_buf >> fast_len++) & 1)]; } while (fast_sym < 0); \
+  } sym = fast_sym; bit_buf >>= fast_len; num_bits -= fast_len; } MZ_MACRO_END
+
 #define TINFL_CR_BEGIN switch(r->m_state) { case 0:
 #define TINFL_CR_RETURN(state_index, result) do { status = result; r->m_state = state_index; goto common_exit; case state_index:; } MZ_MACRO_END
 #define TINFL_CR_RETURN_FOREVER(state_index, result) do { for ( ; ; ) { TINFL_CR_RETURN(state_index, result); } } MZ_MACRO_END
@@ -194,6 +228,55 @@ struct tinfl_decompressor_tag
     code_len = TINFL_FAST_LOOKUP_BITS; do { temp = (pHuff)->m_tree[~temp + ((bit_buf >> code_len++) & 1)]; } while (temp < 0); \
   } sym = temp; bit_buf >>= code_len; num_bits -= code_len; } MZ_MACRO_END
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+  #include <emmintrin.h>
+  #define TINFL_USE_SSE2 1
+#else
+  #define TINFL_USE_SSE2 0
+#endif
+
+/* Updates the adler-32 of the output. Verifying it costs about as much as the decoding itself on well compressed data, so with SSE2 whole 32-byte */
+/* blocks are summed at once: s1 gains the byte sum and s2 gains 32 times the running s1 plus the bytes weighted 32 down to 1. */
+static mz_uint32 tinfl_adler32(mz_uint32 adler, const mz_uint8 *ptr, size_t buf_len)
+{
+  mz_uint32 i, s1 = adler & 0xffff, s2 = adler >> 16; size_t block_len;
+#if TINFL_USE_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i weights0 = _mm_setr_epi16(32, 31, 30, 29, 28, 27, 26, 25), weights1 = _mm_setr_epi16(24, 23, 22, 21, 20, 19, 18, 17);
+  const __m128i weights2 = _mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9), weights3 = _mm_setr_epi16(8, 7, 6, 5, 4, 3, 2, 1);
+  while (buf_len >= 32)
+  {
+    /* 5536 is the largest multiple of 32 that keeps s2 within 32 bits before the modulo, like the 5552 below. */
+    __m128i v_s1 = zero, v_s1_sums = zero, v_s2 = zero; mz_uint32 v[4];
+    block_len = MZ_MIN(buf_len, 5536) & ~(size_t)31; buf_len -= block_len; s2 += s1 * (mz_uint32)block_len;
+    for ( ; block_len; block_len -= 32, ptr += 32)
+    {
+      const __m128i a = _mm_loadu_si128((const __m128i *)ptr), b = _mm_loadu_si128((const __m128i *)(ptr + 16));
+      v_s1_sums = _mm_add_epi32(v_s1_sums, v_s1);
+      v_s1 = _mm_add_epi32(v_s1, _mm_add_epi32(_mm_sad_epu8(a, zero), _mm_sad_epu8(b, zero)));
+      v_s2 = _mm_add_epi32(v_s2, _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(a, zero), weights0), _mm_madd_epi16(_mm_unpackhi_epi8(a, zero), weights1)));
+      v_s2 = _mm_add_epi32(v_s2, _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(b, zero), weights2), _mm_madd_epi16(_mm_unpackhi_epi8(b, zero), weights3)));
+    }
+    v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_s1_sums, 5));
+    _mm_storeu_si128((__m128i *)v, v_s1); s1 += v[0] + v[2];
+    _mm_storeu_si128((__m128i *)v, v_s2); s2 += v[0] + v[1] + v[2] + v[3];
+    s1 %= 65521U, s2 %= 65521U;
+  }
+#endif
+  block_len = buf_len % 5552;
+  while (buf_len)
+  {
+    for (i = 0; i + 7 < block_len; i += 8, ptr += 8)
+    {
+      s1 += ptr[0], s2 += s1; s1 += ptr[1], s2 += s1; s1 += ptr[2], s2 += s1; s1 += ptr[3], s2 += s1;
+      s1 += ptr[4], s2 += s1; s1 += ptr[5], s2 += s1; s1 += ptr[6], s2 += s1; s1 += ptr[7], s2 += s1;
+    }
+    for ( ; i < block_len; ++i) s1 += *ptr++, s2 += s1;
+    s1 %= 65521U, s2 %= 65521U; buf_len -= block_len; block_len = 5552;
+  }
+  return (s2 << 16) + s1;
+}
+
 static tinfl_status tinfl_decompress(tinfl_decompressor *r, const mz_uint8 *pIn_buf_next, size_t *pIn_buf_size, mz_uint8 *pOut_buf_start, mz_uint8 *pOut_buf_next, size_t *pOut_buf_size, const mz_uint32 decomp_flags)
 {
   static const int s_length_base[31] = { 3,4,5,6,7,8,9,10,11,13, 15,17,19,23,27,31,35,43,51,59, 67,83,99,115,131,163,195,227,258,0,0 };
@@ -214,17 +297,19 @@ static tinfl_status tinfl_decompress(tinfl_decompressor *r, const mz_uint8 *pIn_
   num_bits = r->m_num_bits; bit_buf = r->m_bit_buf; dist = r->m_dist; counter = r->m_counter; num_extra = r->m_num_extra; dist_from_out_buf_start = r->m_dist_from_out_buf_start;
   TINFL_CR_BEGIN
 
-  bit_buf = num_bits = dist = counter = num_extra = r->m_zhdr0 = r->m_zhdr1 = 0; r->m_z_adler32 = r->m_check_adler32 = 1;
+  bit_buf = num_bits = dist = counter = num_extra = r->m_zhdr0 = r->m_zhdr1 = 0; r->m_z_adler32 = r->m_check_adler32 = 1; r->m_total_out = 0;
   if (decomp_flags & TINFL_FLAG_PARSE_ZLIB_HEADER)
   {
     TINFL_GET_BYTE(1, r->m_zhdr0); TINFL_GET_BYTE(2, r->m_zhdr1);
-    counter = (((r->m_zhdr0 * 256 + r->m_zhdr1) % 31 != 0) || (r->m_zhdr1 & 32) || ((r->m_zhdr0 & 15) != 8));
+    /* Like zlib, refuse windows over 32 KB even when the whole output is at hand. */
+    counter = (((r->m_zhdr0 * 256 + r->m_zhdr1) % 31 != 0) || (r->m_zhdr1 & 32) || ((r->m_zhdr0 & 15) != 8) || ((r->m_zhdr0 >> 4) > 7));
     if (!(decomp_flags & TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF)) counter |= (((1U << (8U + (r->m_zhdr0 >> 4))) > 32768U) || ((out_buf_size_mask + 1) < (size_t)(1U << (8U + (r->m_zhdr0 >> 4)))));
     if (counter) { TINFL_CR_RETURN_FOREVER(36, TINFL_STATUS_FAILED); }
   }
 
   do
   {
+    if (decomp_flags & TINFL_FLAG_STOP_AT_BLOCKS) { TINFL_CR_RETURN(TINFL_STATE_BLOCK_BOUNDARY, TINFL_STATUS_BLOCK_BOUNDARY); }
     TINFL_GET_BITS(3, r->m_final, 3); r->m_type = r->m_final >> 1;
     if (r->m_type == 0)
     {
@@ -271,6 +356,11 @@ static tinfl_status tinfl_decompress(tinfl_decompressor *r, const mz_uint8 *pIn_
       else
       {
         for (counter = 0; counter < 3; counter++) { TINFL_GET_BITS(11, r->m_table_sizes[counter], "\05\05\04"[counter]); r->m_table_sizes[counter] += s_min_table_sizes[counter]; }
+        /* Like zlib, refuse length and distance codes the format doesn't define. */
+        if ((r->m_table_sizes[0] > 286) || (r->m_table_sizes[1] > 30))
+        {
+          TINFL_CR_RETURN_FOREVER(45, TINFL_STATUS_FAILED);
+        }
         MZ_CLEAR_OBJ(r->m_tables[2].m_code_size); for (counter = 0; counter < r->m_table_sizes[2]; counter++) { mz_uint s; TINFL_GET_BITS(14, s, 3); r->m_tables[2].m_code_size[s_length_dezigzag[counter]] = (mz_uint8)s; }
         r->m_table_sizes[2] = 19;
       }
@@ -281,7 +371,9 @@ static tinfl_status tinfl_decompress(tinfl_decompressor *r, const mz_uint8 *pIn_
         for (i = 0; i < r->m_table_sizes[r->m_type]; ++i) total_syms[pTable->m_code_size[i]]++;
         used_syms = 0, total = 0; next_code[0] = next_code[1] = 0;
         for (i = 1; i <= 15; ++i) { used_syms += total_syms[i]; next_code[i + 1] = (total = ((total + total_syms[i]) << 1)); }
-        if ((65536 != total) && (used_syms > 1))
+        /* Like zlib, the only incomplete codes allowed are a single 1-bit code, or no codes at all for distances; */
+        /* a code length code must always be complete, and a block without an end-of-block code can't end. */
+        if (((65536 != total) && ((r->m_type == 2) || (used_syms > 1) || (total_syms[1] != used_syms))) || ((r->m_type == 0) && (!pTable->m_code_size[256])))
         {
           TINFL_CR_RETURN_FOREVER(35, TINFL_STATUS_FAILED);
         }
@@ -299,6 +391,12 @@ static tinfl_status tinfl_decompress(tinfl_decompressor *r, const mz_uint8 *pIn_
           }
           tree_cur -= ((rev_code >>= 1) & 1); pTable->m_tree[-tree_cur - 1] = (mz_int16)sym_index;
         }
+        if (65536 != total)
+        {
+          /* Bit patterns an incomplete code leaves unused decode to a symbol that is rejected once seen, so decoding never stalls on them. */
+          mz_int16 invalid = (mz_int16)((1 << 9) | (r->m_type ? 31 : 287));
+          for (i = 0; i < TINFL_FAST_LOOKUP_SIZE; ++i) if (!pTable->m_look_up[i]) pTable->m_look_up[i] = invalid;
+        }
         if (r->m_type == 2)
         {
           for (counter = 0; counter < (r->m_table_sizes[0] + r->m_table_sizes[1]); )
@@ -323,7 +421,7 @@ static tinfl_status tinfl_decompress(tinfl_decompressor *r, const mz_uint8 *pIn_
         mz_uint8 *pSrc;
         for ( ; ; )
         {
-          if (((pIn_buf_end - pIn_buf_cur) < 4) || ((pOut_buf_end - pOut_buf_cur) < 2))
+          if (((pIn_buf_end - pIn_buf_cur) < TINFL_FAST_INPUT_BYTES) || ((pOut_buf_end - pOut_buf_cur) < 3))
           {
             TINFL_HUFF_DECODE(23, counter, &r->m_tables[0]);
             if (counter >= 256)
@@ -331,6 +429,34 @@ static tinfl_status tinfl_decompress(tinfl_decompressor *r, const mz_uint8 *pIn_
             while (pOut_buf_cur >= pOut_buf_end) { TINFL_CR_RETURN(24, TINFL_STATUS_HAS_MORE_OUTPUT); }
             *pOut_buf_cur++ = (mz_uint8)counter;
           }
+#if TINFL_USE_WIDE_REFILL
+          else
+          {
+            /* 56 bits cover three literal codes, so decode up to three literals per refill. */
+            mz_uint sym2;
+            TINFL_WIDE_REFILL();
+            TINFL_FAST_HUFF_DECODE(counter, &r->m_tables[0]);
+            if (counter & 256)
+              break;
+            TINFL_FAST_HUFF_DECODE(sym2, &r->m_tables[0]);
+            pOut_buf_cur[0] = (mz_uint8)counter;
+            if (sym2 & 256)
+            {
+              pOut_buf_cur++;
+              counter = sym2;
+              break;
+            }
+            TINFL_FAST_HUFF_DECODE(counter, &r->m_tables[0]);
+            pOut_buf_cur[1] = (mz_uint8)sym2;
+            if (counter & 256)
+            {
+              pOut_buf_cur += 2;
+              break;
+            }
+            pOut_buf_cur[2] = (mz_uint8)counter;
+            pOut_buf_cur += 3;
+          }
+#else
           else
           {
             int sym2; mz_uint code_len;
@@ -370,18 +496,45 @@ static tinfl_status tinfl_decompress(tinfl_decompressor *r, const mz_uint8 *pIn_
             pOut_buf_cur[1] = (mz_uint8)sym2;
             pOut_buf_cur += 2;
           }
+#endif
         }
         if ((counter &= 511) == 256) break;
+        if (counter > 285)
+        {
+          TINFL_CR_RETURN_FOREVER(46, TINFL_STATUS_FAILED);
+        }
 
         num_extra = s_length_extra[counter - 257]; counter = s_length_base[counter - 257];
-        if (num_extra) { mz_uint extra_bits; TINFL_GET_BITS(25, extra_bits, num_extra); counter += extra_bits; }
+#if TINFL_USE_WIDE_REFILL
+        if ((pIn_buf_end - pIn_buf_cur) >= TINFL_FAST_INPUT_BYTES)
+        {
+          TINFL_WIDE_REFILL();
+          counter += (mz_uint32)bit_buf & ((1U << num_extra) - 1); bit_buf >>= num_extra; num_bits -= num_extra;
+          TINFL_FAST_HUFF_DECODE(dist, &r->m_tables[1]);
+          if (dist > 29)
+          {
+            TINFL_CR_RETURN_FOREVER(47, TINFL_STATUS_FAILED);
+          }
+          num_extra = s_dist_extra[dist]; dist = s_dist_base[dist];
+          dist += (mz_uint32)bit_buf & ((1U << num_extra) - 1); bit_buf >>= num_extra; num_bits -= num_extra;
+        }
+        else
+#endif
+        {
+          if (num_extra) { mz_uint extra_bits; TINFL_GET_BITS(25, extra_bits, num_extra); counter += extra_bits; }
 
-        TINFL_HUFF_DECODE(26, dist, &r->m_tables[1]);
-        num_extra = s_dist_extra[dist]; dist = s_dist_base[dist];
-        if (num_extra) { mz_uint extra_bits; TINFL_GET_BITS(27, extra_bits, num_extra); dist += extra_bits; }
+          TINFL_HUFF_DECODE(26, dist, &r->m_tables[1]);
+          if (dist > 29)
+          {
+            TINFL_CR_RETURN_FOREVER(48, TINFL_STATUS_FAILED);
+          }
+          num_extra = s_dist_extra[dist]; dist = s_dist_base[dist];
+          if (num_extra) { mz_uint extra_bits; TINFL_GET_BITS(27, extra_bits, num_extra); dist += extra_bits; }
+        }
 
         dist_from_out_buf_start = pOut_buf_cur - pOut_buf_start;
-        if ((dist > dist_from_out_buf_start) && (decomp_flags & TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF))
+        /* Like zlib, refuse matches reaching back before the start of the output, also when the buffer wraps. */
+        if ((dist > dist_from_out_buf_start) && ((decomp_flags & TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF) || (dist > r->m_total_out + (size_t)(pOut_buf_cur - pOut_buf_next))))
         {
           TINFL_CR_RETURN_FOREVER(37, TINFL_STATUS_FAILED);
         }
@@ -397,14 +550,52 @@ static tinfl_status tinfl_decompress(tinfl_decompressor *r, const mz_uint8 *pIn_
           }
           continue;
         }
+        else if ((counter >= 3) && (dist == 1))
+        {
+          /* Run of a single byte. */
+          TINFL_MEMSET(pOut_buf_cur, pSrc[0], counter);
+          pOut_buf_cur += counter;
+          continue;
+        }
 #if MINIZ_USE_UNALIGNED_LOADS_AND_STORES
-        else if ((counter >= 9) && (counter <= dist))
+        else if ((counter >= 4) && (counter <= 16) && (dist >= counter) && (pSrc < pOut_buf_cur))
         {
+          /* Short match that doesn't overlap its source: two blocks, overlapping each other if need be, cover it exactly. */
+          if (counter >= 8)
+          {
+            TINFL_MEMCPY(pOut_buf_cur, pSrc, 8);
+            TINFL_MEMCPY(pOut_buf_cur + counter - 8, pSrc + counter - 8, 8);
+          }
+          else
+          {
+            TINFL_MEMCPY(pOut_buf_cur, pSrc, 4);
+            TINFL_MEMCPY(pOut_buf_cur + counter - 4, pSrc + counter - 4, 4);
+          }
+          pOut_buf_cur += counter;
+          continue;
+        }
+        else if ((counter >= 16) && (dist >= 16) && (pSrc < pOut_buf_cur))
+        {
+          /* Whole 16-byte blocks, then one more ending exactly at the end of the match, so nothing outside the match is written. */
+          /* Every block reads at least 16 bytes back, i.e. only output that is already final. */
+          const mz_uint8 *pSrc_last = pSrc + counter - 16;
+          mz_uint8 *pOut_last = pOut_buf_cur + counter - 16;
+          while (pSrc < pSrc_last)
+          {
+            TINFL_MEMCPY(pOut_buf_cur, pSrc, 16);
+            pOut_buf_cur += 16; pSrc += 16;
+          }
+          TINFL_MEMCPY(pOut_last, pSrc_last, 16);
+          pOut_buf_cur = pOut_last + 16;
+          continue;
+        }
+        else if ((counter >= 9) && (dist >= 8))
+        {
+          /* Each 8-byte block only reads bytes at least 8 back, so this also works for overlapping matches. */
           const mz_uint8 *pSrc_end = pSrc + (counter & ~7);
           do
           {
-            ((mz_uint32 *)pOut_buf_cur)[0] = ((const mz_uint32 *)pSrc)[0];
-            ((mz_uint32 *)pOut_buf_cur)[1] = ((const mz_uint32 *)pSrc)[1];
+            TINFL_MEMCPY(pOut_buf_cur, pSrc, 8);
             pOut_buf_cur += 8;
           } while ((pSrc += 8) < pSrc_end);
           if ((counter &= 7) < 3)
@@ -447,21 +638,11 @@ static tinfl_status tinfl_decompress(tinfl_decompressor *r, const mz_uint8 *pIn_
 common_exit:
   r->m_num_bits = num_bits; r->m_bit_buf = bit_buf; r->m_dist = dist; r->m_counter = counter; r->m_num_extra = num_extra; r->m_dist_from_out_buf_start = dist_from_out_buf_start;
   *pIn_buf_size = pIn_buf_cur - pIn_buf_next; *pOut_buf_size = pOut_buf_cur - pOut_buf_next;
+  /* Only needs to count up to a full buffer, past which every distance is valid. */
+  if (r->m_total_out <= out_buf_size_mask) r->m_total_out += *pOut_buf_size;
   if ((decomp_flags & (TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_COMPUTE_ADLER32)) && (status >= 0))
   {
-    const mz_uint8 *ptr = pOut_buf_next; size_t buf_len = *pOut_buf_size;
-    mz_uint32 i, s1 = r->m_check_adler32 & 0xffff, s2 = r->m_check_adler32 >> 16; size_t block_len = buf_len % 5552;
-    while (buf_len)
-    {
-      for (i = 0; i + 7 < block_len; i += 8, ptr += 8)
-      {
-        s1 += ptr[0], s2 += s1; s1 += ptr[1], s2 += s1; s1 += ptr[2], s2 += s1; s1 += ptr[3], s2 += s1;
-        s1 += ptr[4], s2 += s1; s1 += ptr[5], s2 += s1; s1 += ptr[6], s2 += s1; s1 += ptr[7], s2 += s1;
-      }
-      for ( ; i < block_len; ++i) s1 += *ptr++, s2 += s1;
-      s1 %= 65521U, s2 %= 65521U; buf_len -= block_len; block_len = 5552;
-    }
-    r->m_check_adler32 = (s2 << 16) + s1; if ((status == TINFL_STATUS_DONE) && (decomp_flags & TINFL_FLAG_PARSE_ZLIB_HEADER) && (r->m_check_adler32 != r->m_z_adler32)) status = TINFL_STATUS_ADLER32_MISMATCH;
+    r->m_check_adler32 = tinfl_adler32(r->m_check_adler32, pOut_buf_next, *pOut_buf_size); if ((status == TINFL_STATUS_DONE) && (decomp_flags & TINFL_FLAG_PARSE_ZLIB_HEADER) && (r->m_check_adler32 != r->m_z_adler32)) status = TINFL_STATUS_ADLER32_MISMATCH;
   }
   return status;
 }
@@ -514,7 +695,7 @@ typedef struct
   tinfl_status m_last_status;
 } inflate_state;
 
-static int mz_inflateInit2(mz_streamp pStream, int window_bits)
+static inline int mz_inflateInit2(mz_streamp pStream, int window_bits)
 {
   inflate_state *pDecomp;
   if (!pStream) return MZ_STREAM_ERROR;
@@ -545,7 +726,31 @@ static int mz_inflateInit2(mz_streamp pStream, int window_bits)
   return MZ_OK;
 }
 
-static int mz_inflate(mz_streamp pStream, int flush)
+static inline int mz_inflateReset(mz_streamp pStream)
+{
+  inflate_state *pDecomp;
+  if ((!pStream) || (!pStream->state)) return MZ_STREAM_ERROR;
+
+  pStream->data_type = 0;
+  pStream->adler = 0;
+  pStream->msg = NULL;
+  pStream->total_in = 0;
+  pStream->total_out = 0;
+  pStream->reserved = 0;
+
+  pDecomp = (inflate_state *)pStream->state;
+
+  tinfl_init(&pDecomp->m_decomp);
+  pDecomp->m_dict_ofs = 0;
+  pDecomp->m_dict_avail = 0;
+  pDecomp->m_last_status = TINFL_STATUS_NEEDS_MORE_INPUT;
+  pDecomp->m_first_call = 1;
+  pDecomp->m_has_flushed = 0;
+
+  return MZ_OK;
+}
+
+static inline int mz_inflate(mz_streamp pStream, int flush)
 {
   inflate_state* pState;
   mz_uint n, first_call, decomp_flags = TINFL_FLAG_COMPUTE_ADLER32;
@@ -636,7 +841,7 @@ static int mz_inflate(mz_streamp pStream, int flush)
   return ((status == TINFL_STATUS_DONE) && (!pState->m_dict_avail)) ? MZ_STREAM_END : MZ_OK;
 }
 
-static int mz_inflateEnd(mz_streamp pStream)
+static inline int mz_inflateEnd(mz_streamp pStream)
 {
   if (!pStream)
     return MZ_STREAM_ERROR;
@@ -653,6 +858,7 @@ static int mz_inflateEnd(mz_streamp pStream)
   #define uInt unsigned int
   #define z_stream              mz_stream
   #define inflateInit2          mz_inflateInit2
+  #define inflateReset          mz_inflateReset
   #define inflate               mz_inflate
   #define inflateEnd            mz_inflateEnd
   #define Z_SYNC_FLUSH          MZ_SYNC_FLUSH
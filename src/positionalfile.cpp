@@ -0,0 +1,123 @@
+#include "positionalfile.hpp"
+
+#include <algorithm>
+
+#ifdef _WIN32
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#else
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+# include <cerrno>
+# ifndef O_CLOEXEC
+#  define O_CLOEXEC 0
+# endif
+#endif
+
+PositionalFile::~PositionalFile()
+{
+  close();
+}
+
+#ifdef _WIN32
+
+bool PositionalFile::open( const char* filename )
+{
+  close();
+  HANDLE file = CreateFileA( filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+  if( file == INVALID_HANDLE_VALUE ) return false;
+  LARGE_INTEGER size;
+  if( !GetFileSizeEx( file, &size ) || GetFileType( file ) != FILE_TYPE_DISK )
+  {
+    CloseHandle( file );
+    return false;
+  }
+  m_handle = file;
+  m_size = static_cast< std::uint64_t >( size.QuadPart );
+  return true;
+}
+
+void PositionalFile::close()
+{
+  if( m_handle ) CloseHandle( m_handle );
+  m_handle = nullptr;
+  m_size = 0;
+}
+
+bool PositionalFile::isOpen() const
+{
+  return m_handle != nullptr;
+}
+
+std::int64_t PositionalFile::readAt( std::uint64_t offset, char buf[], std::uint64_t len ) const
+{
+  std::uint64_t total = 0;
+  while( total < len )
+  {
+    // ReadFile() at an explicit offset leaves nothing for other threads to race on
+    OVERLAPPED overlapped = {};
+    overlapped.Offset = static_cast< DWORD >( offset + total );
+    overlapped.OffsetHigh = static_cast< DWORD >( ( offset + total ) >> 32 );
+    DWORD bytesRead = 0;
+    const DWORD chunk = static_cast< DWORD >( std::min< std::uint64_t >( len - total, 1u << 30 ) );
+    if( !ReadFile( m_handle, buf + total, chunk, &bytesRead, &overlapped ) )
+    {
+      if( GetLastError() == ERROR_HANDLE_EOF ) break;
+      return -1;
+    }
+    if( bytesRead == 0 ) break;
+    total += bytesRead;
+  }
+  return static_cast< std::int64_t >( total );
+}
+
+#else
+
+bool PositionalFile::open( const char* filename )
+{
+  close();
+  int fd = ::open( filename, O_RDONLY | O_CLOEXEC );
+  if( fd == -1 ) return false;
+  struct stat info;
+  if( fstat( fd, &info ) != 0 || !S_ISREG( info.st_mode ) )
+  {
+    ::close( fd );
+    return false;
+  }
+  m_descriptor = fd;
+  m_size = static_cast< std::uint64_t >( info.st_size );
+  return true;
+}
+
+void PositionalFile::close()
+{
+  if( m_descriptor != -1 ) ::close( m_descriptor );
+  m_descriptor = -1;
+  m_size = 0;
+}
+
+bool PositionalFile::isOpen() const
+{
+  return m_descriptor != -1;
+}
+
+std::int64_t PositionalFile::readAt( std::uint64_t offset, char buf[], std::uint64_t len ) const
+{
+  std::uint64_t total = 0;
+  while( total < len )
+  {
+    const std::size_t chunk = static_cast< std::size_t >( std::min< std::uint64_t >( len - total, 1u << 30 ) );
+    const ssize_t bytesRead = ::pread( m_descriptor, buf + total, chunk, static_cast< off_t >( offset + total ) );
+    if( bytesRead < 0 )
+    {
+      if( errno == EINTR ) continue;
+      return -1;
+    }
+    if( bytesRead == 0 ) break;
+    total += static_cast< std::uint64_t >( bytesRead );
+  }
+  return static_cast< std::int64_t >( total );
+}
+
+#endif
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+@brief Read-only file that reads at given positions without a file position, so any number of threads can read it at once
+**/
+class PositionalFile
+{
+public:
+  PositionalFile() = default;
+  ~PositionalFile();
+  PositionalFile( const PositionalFile& ) = delete;
+  PositionalFile& operator=( const PositionalFile& ) = delete;
+
+  /**
+  @brief Open the given file, replacing any previously opened one.
+  @return false if the file could not be opened, e.g. because it does not exist or is not a regular file.
+  **/
+  bool open( const char* filename );
+  void close();
+
+  bool isOpen() const;
+  std::uint64_t size() const { return m_size; }
+  /**
+  @brief Read from the given position; safe to call concurrently.
+  @return Bytes read, which is less than len at the end of the file, or -1 on error.
+  **/
+  std::int64_t readAt( std::uint64_t offset, char buf[], std::uint64_t len ) const;
+
+private:
+  std::uint64_t m_size = 0;
+#ifdef _WIN32
+  void* m_handle = nullptr;
+#else
+  int m_descriptor = -1;
+#endif
+};
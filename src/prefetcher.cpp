@@ -0,0 +1,103 @@
+#include "prefetcher.hpp"
+
+#include <algorithm>
+#include <system_error>
+
+Prefetcher::Prefetcher( unsigned int threadCount, Load load )
+: m_threadCount( std::max( threadCount, 1u ) )
+, m_load( std::move( load ) )
+, m_stats{}
+{
+}
+
+Prefetcher::~Prefetcher()
+{
+  {
+    std::lock_guard< std::mutex > lock( m_mutex );
+    m_stopping = true;
+    m_stats.cancelled += m_queue.size();
+    m_queue.clear();
+    m_jobs.clear();
+  }
+  m_wakeUp.notify_all();
+  for( auto& thread : m_threads ) thread.join();
+}
+
+void Prefetcher::enqueue( const BFSFile::Info* info, int priority )
+{
+  {
+    std::lock_guard< std::mutex > lock( m_mutex );
+    auto queued = m_jobs.find( info );
+    if( queued != m_jobs.end() )
+    {
+      if( queued->second->priority >= priority ) return;
+      m_queue.erase( queued->second );
+      queued->second = m_queue.insert( { priority, m_nextSequence++, info } ).first;
+    }
+    else
+    {
+      m_jobs.emplace( info, m_queue.insert( { priority, m_nextSequence++, info } ).first );
+    }
+    m_stats.queued = m_queue.size();
+
+    while( m_threads.size() < m_threadCount )
+    {
+      try
+      {
+        m_threads.emplace_back( &Prefetcher::work, this );
+      }
+      catch( std::system_error& )
+      {
+        // Continue with the threads we have, unless there are none
+        if( m_threads.empty() ) throw PHYSFS_ERR_OS_ERROR;
+        break;
+      }
+    }
+  }
+  m_wakeUp.notify_one();
+}
+
+void Prefetcher::cancel( const BFSFile::Info* info )
+{
+  std::lock_guard< std::mutex > lock( m_mutex );
+  auto queued = m_jobs.find( info );
+  if( queued == m_jobs.end() ) return;
+  m_queue.erase( queued->second );
+  m_jobs.erase( queued );
+  m_stats.queued = m_queue.size();
+  ++m_stats.cancelled;
+}
+
+void Prefetcher::cancelAll()
+{
+  std::lock_guard< std::mutex > lock( m_mutex );
+  m_stats.cancelled += m_queue.size();
+  m_queue.clear();
+  m_jobs.clear();
+  m_stats.queued = 0;
+}
+
+Prefetcher::Stats Prefetcher::getStats() const
+{
+  std::lock_guard< std::mutex > lock( m_mutex );
+  return m_stats;
+}
+
+void Prefetcher::work()
+{
+  std::unique_lock< std::mutex > lock( m_mutex );
+  while( true )
+  {
+    m_wakeUp.wait( lock, [ this ]() { return m_stopping || !m_queue.empty(); } );
+    if( m_stopping ) return;
+    const BFSFile::Info* info = m_queue.begin()->info;
+    m_queue.erase( m_queue.begin() );
+    m_jobs.erase( info );
+    m_stats.queued = m_queue.size();
+
+    lock.unlock();
+    m_load( *info );
+    lock.lock();
+    ++m_stats.loaded;
+  }
+}
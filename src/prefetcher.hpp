@@ -0,0 +1,82 @@
+#pragma once
+
+#include <set>
+#include <unordered_map>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+
+#include "bfsfile.hpp"
+
+/**
+@brief Queue of files to load ahead of time on background threads
+
+Files are loaded highest priority first, in the order they were queued within a priority.
+Threads are only started once the first file is queued. All methods are thread-safe.
+**/
+class Prefetcher
+{
+public:
+  typedef std::function< void( const BFSFile::Info& info ) > Load;
+
+  struct Stats
+  {
+    /// Files waiting to be loaded
+    std::uint64_t queued;
+    std::uint64_t loaded;
+    std::uint64_t cancelled;
+  };
+
+public:
+  /**
+  @param threadCount Number of background threads, at least 1
+  @param load Called on a background thread for each queued file; must not throw.
+  **/
+  Prefetcher( unsigned int threadCount, Load load );
+  /// Cancels all queued files and waits for those being loaded
+  ~Prefetcher();
+  Prefetcher( const Prefetcher& ) = delete;
+  Prefetcher& operator=( const Prefetcher& ) = delete;
+
+  /// Queue a file unless it's already queued, raising its priority if it's higher
+  void enqueue( const BFSFile::Info* info, int priority );
+  /// Remove a file from the queue, unless it's already being loaded
+  void cancel( const BFSFile::Info* info );
+  void cancelAll();
+
+  Stats getStats() const;
+
+private:
+  struct Job
+  {
+    int priority;
+    std::uint64_t sequence;
+    const BFSFile::Info* info;
+
+    /// Highest priority first, then first come first served
+    bool operator<( const Job& rhs ) const
+    {
+      return priority != rhs.priority ? priority > rhs.priority : sequence < rhs.sequence;
+    }
+  };
+
+private:
+  void work();
+
+private:
+  const unsigned int m_threadCount;
+  const Load m_load;
+
+  mutable std::mutex m_mutex;
+  std::condition_variable m_wakeUp;
+  std::set< Job > m_queue;
+  /// The queued job of each file, so they are found without going through the whole queue
+  std::unordered_map< const BFSFile::Info*, std::set< Job >::iterator > m_jobs;
+  std::uint64_t m_nextSequence = 0;
+  bool m_stopping = false;
+  Stats m_stats;
+  std::vector< std::thread > m_threads;
+};
@@ -0,0 +1,79 @@
+#include "streamtracker.hpp"
+#include "bfsfilecompressed.hpp"
+
+StreamTracker::StreamTracker( std::uint64_t budget, std::chrono::milliseconds idleTimeout )
+: m_budget( budget )
+, m_idleTimeout( idleTimeout )
+, m_stats{}
+{
+}
+
+void StreamTracker::touch( BFSFileCompressed& file, std::size_t size )
+{
+  const Clock::time_point now = Clock::now();
+  std::lock_guard< std::mutex > lock( m_mutex );
+  auto it = m_lookup.find( &file );
+  if( it != m_lookup.end() )
+  {
+    m_stats.size -= it->second->size;
+    if( size == 0 )
+    {
+      m_entries.erase( it->second );
+      m_lookup.erase( it );
+    }
+    else
+    {
+      it->second->size = size;
+      it->second->lastUse = now;
+      m_entries.splice( m_entries.begin(), m_entries, it->second );
+    }
+  }
+  else if( size > 0 )
+  {
+    m_entries.push_front( { &file, size, now } );
+    m_lookup.emplace( &file, m_entries.begin() );
+  }
+  m_stats.size += size;
+  m_stats.files = m_entries.size();
+
+  // Evict from the least recently used end; files busy on other threads are skipped
+  auto victim = m_entries.end();
+  while( victim != m_entries.begin() )
+  {
+    --victim;
+    const bool idle = m_idleTimeout.count() > 0 && now - victim->lastUse >= m_idleTimeout;
+    const bool overBudget = m_budget > 0 && m_stats.size > m_budget;
+    if( !idle && !overBudget ) break;
+    // That's the caller, at the front, so there's nothing left to try
+    if( victim->file == &file ) break;
+    if( !victim->file->evictState() ) continue;
+    m_stats.size -= victim->size;
+    ++m_stats.evictions;
+    m_lookup.erase( victim->file );
+    victim = m_entries.erase( victim );
+  }
+  m_stats.files = m_entries.size();
+}
+
+void StreamTracker::remove( BFSFileCompressed& file )
+{
+  std::lock_guard< std::mutex > lock( m_mutex );
+  auto it = m_lookup.find( &file );
+  if( it == m_lookup.end() ) return;
+  m_stats.size -= it->second->size;
+  m_entries.erase( it->second );
+  m_lookup.erase( it );
+  m_stats.files = m_entries.size();
+}
+
+void StreamTracker::countRebuild()
+{
+  std::lock_guard< std::mutex > lock( m_mutex );
+  ++m_stats.rebuilds;
+}
+
+StreamTracker::Stats StreamTracker::getStats() const
+{
+  std::lock_guard< std::mutex > lock( m_mutex );
+  return m_stats;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <chrono>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+class BFSFileCompressed;
+
+/**
+@brief Bounds the decompression state held by open compressed files
+
+Files report their state's size whenever they read. Files that have not read for a while, or the least recently read ones
+once the total exceeds the budget, are told to drop their state, which they rebuild on their next read.
+Checks only happen when some file reads, so there's no thread of its own. All methods are thread-safe.
+**/
+class StreamTracker
+{
+public:
+  struct Stats
+  {
+    /// Files currently holding decompression state
+    std::uint64_t files;
+    /// Bytes of decompression state they hold
+    std::uint64_t size;
+    /// States dropped
+    std::uint64_t evictions;
+    /// States rebuilt after being dropped
+    std::uint64_t rebuilds;
+  };
+
+public:
+  /**
+  @param budget Maximum bytes of decompression state of all files together, 0 for no limit
+  @param idleTimeout Files that haven't read for this long drop their state, 0 never
+  **/
+  StreamTracker( std::uint64_t budget, std::chrono::milliseconds idleTimeout );
+  StreamTracker( const StreamTracker& ) = delete;
+  StreamTracker& operator=( const StreamTracker& ) = delete;
+
+  /**
+  @brief Record that file just read and now holds size bytes of state, then evict others as necessary.
+  Called by file with its state locked, so file itself is never evicted here.
+  **/
+  void touch( BFSFileCompressed& file, std::size_t size );
+  /// Stop tracking a file that's being destroyed
+  void remove( BFSFileCompressed& file );
+  void countRebuild();
+
+  Stats getStats() const;
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  struct Entry
+  {
+    BFSFileCompressed* file;
+    std::size_t size;
+    Clock::time_point lastUse;
+  };
+
+private:
+  const std::uint64_t m_budget;
+  const Clock::duration m_idleTimeout;
+
+  mutable std::mutex m_mutex;
+  /// Most recently used first
+  std::list< Entry > m_entries;
+  std::unordered_map< BFSFileCompressed*, std::list< Entry >::iterator > m_lookup;
+  Stats m_stats;
+};
@@ -10,48 +10,201 @@
 #include <cassert>
 #include <algorithm>
 #include <cstdint>
+#include <thread>
+#include <atomic>
+#include <system_error>
+#include <cstring>
 
-static BFSStringPoolHeader readHeader( PHYSFS_Io& io, unsigned int pos )
+static BFSStringPoolHeader readHeader( const char* data, std::size_t size )
 {
   BFSStringPoolHeader header;
-  if( !io.seek( &io, pos ) || io.read( &io, &header, sizeof( header ) ) != sizeof( header ) )
+  if( size < sizeof( header ) )
   {
     throw UnexpectedEnfOfInput();
   }
+  std::memcpy( &header, data, sizeof( header ) );
   // Byte swap
   header.end = PHYSFS_swapULE32( header.end );
   header.offsetsOffset = PHYSFS_swapULE32( header.offsetsOffset );
   header.uncompressedSizesOffset = PHYSFS_swapULE32( header.uncompressedSizesOffset );
   header.huffmannTreeOffset = PHYSFS_swapULE32( header.huffmannTreeOffset );
   header.compressedStringsOffset = PHYSFS_swapULE32( header.compressedStringsOffset );
-  // Adjust offsets
-  header.end += pos;
-  header.offsetsOffset += pos;
-  header.uncompressedSizesOffset += pos;
-  header.huffmannTreeOffset += pos;
-  header.compressedStringsOffset += pos;
   return header;
 }
 
+StringPool::StringPool()
+{
+}
+
+StringPool::~StringPool()
+{
+}
+
 StringPool::StringPool( StringPool&& rhs )
-: m_pool( std::move( rhs.m_pool ) )
+: m_huffmannTable( std::move( rhs.m_huffmannTable ) )
+, m_compressedStrings( std::move( rhs.m_compressedStrings ) )
+, m_offsets( std::move( rhs.m_offsets ) )
+, m_uncompressedSizes( std::move( rhs.m_uncompressedSizes ) )
+, m_stringCount( rhs.m_stringCount )
+, m_strings( std::move( rhs.m_strings ) )
+, m_decodedCount( rhs.m_decodedCount.load() )
+, m_arena( std::move( rhs.m_arena ) )
+, m_arenaPos( rhs.m_arenaPos )
+, m_arenaLeft( rhs.m_arenaLeft )
 {
+  rhs.m_stringCount = 0;
+  rhs.m_decodedCount = 0;
+  rhs.m_arenaPos = nullptr;
+  rhs.m_arenaLeft = 0;
 }
 
 StringPool& StringPool::operator=( StringPool&& rhs )
 {
-  m_pool = std::move( rhs.m_pool );
+  m_huffmannTable = std::move( rhs.m_huffmannTable );
+  m_compressedStrings = std::move( rhs.m_compressedStrings );
+  m_offsets = std::move( rhs.m_offsets );
+  m_uncompressedSizes = std::move( rhs.m_uncompressedSizes );
+  m_stringCount = rhs.m_stringCount;
+  rhs.m_stringCount = 0;
+  m_strings = std::move( rhs.m_strings );
+  m_decodedCount = rhs.m_decodedCount.load();
+  rhs.m_decodedCount = 0;
+  m_arena = std::move( rhs.m_arena );
+  m_arenaPos = rhs.m_arenaPos;
+  m_arenaLeft = rhs.m_arenaLeft;
+  rhs.m_arenaPos = nullptr;
+  rhs.m_arenaLeft = 0;
   return *this;
 }
 
-int StringPool::read( PHYSFS_Io& io, unsigned int pos )
+bool StringPool::decodeAll( unsigned int threadCount )
+{
+  if( m_decodedCount == m_stringCount ) return true;
+  std::lock_guard< std::mutex > lock( m_decodeMutex );
+
+  // Lay out all missing strings in a single block up front, so workers can decode straight into their slots
+  std::vector< unsigned int > pending;
+  std::vector< char* > slots;
+  pending.reserve( m_stringCount - m_decodedCount );
+  std::size_t totalSize = 0;
+  for( unsigned int strIndex = 0; strIndex < m_stringCount; ++strIndex )
+  {
+    if( m_strings[ strIndex ].load( std::memory_order_relaxed ) ) continue;
+    pending.push_back( strIndex );
+    totalSize += length( strIndex );
+  }
+  char* slot = allocate( totalSize );
+  slots.reserve( pending.size() );
+  for( unsigned int strIndex : pending )
+  {
+    slots.push_back( slot );
+    slot += length( strIndex );
+  }
+
+  // Strings are independent, so workers grab blocks of them
+  enum { BLOCK_SIZE = 512 };
+  const unsigned int count = pending.size();
+  std::atomic< unsigned int > nextBlock( 0 );
+  std::atomic< bool > failed( false );
+  auto work = [ this, &pending, &slots, count, &nextBlock, &failed ]()
+  {
+    try
+    {
+      unsigned int begin;
+      while( !failed && ( begin = nextBlock.fetch_add( BLOCK_SIZE ) ) < count )
+      {
+        const unsigned int end = std::min< unsigned int >( begin + BLOCK_SIZE, count );
+        for( unsigned int i = begin; i < end; ++i )
+        {
+          if( !decode( pending[ i ], slots[ i ] ) ) failed = true;
+        }
+      }
+    }
+    catch( ... )
+    {
+      failed = true;
+    }
+  };
+
+  if( threadCount == 0 ) threadCount = std::max( 1u, std::thread::hardware_concurrency() );
+  threadCount = std::min< unsigned int >( threadCount, ( count + BLOCK_SIZE - 1 ) / BLOCK_SIZE );
+  std::vector< std::thread > threads;
+  for( unsigned int i = 1; i < threadCount; ++i )
+  {
+    try
+    {
+      threads.emplace_back( work );
+    }
+    catch( std::system_error& )
+    {
+      // Continue with the threads we have
+      break;
+    }
+  }
+  work();
+  for( auto& thread : threads ) thread.join();
+
+  if( failed ) return false;
+  for( unsigned int i = 0; i < count; ++i ) m_strings[ pending[ i ] ].store( slots[ i ], std::memory_order_release );
+  m_decodedCount = m_stringCount;
+  return true;
+}
+
+const char* StringPool::get( unsigned int index )
+{
+  if( index >= m_stringCount ) return nullptr;
+  const char* result = m_strings[ index ].load( std::memory_order_acquire );
+  if( result ) return result;
+
+  std::lock_guard< std::mutex > lock( m_decodeMutex );
+  // Another thread may have been faster
+  result = m_strings[ index ].load( std::memory_order_relaxed );
+  if( result ) return result;
+  char* str = allocate( length( index ) );
+  if( !decode( index, str ) ) return nullptr;
+  m_strings[ index ].store( str, std::memory_order_release );
+  ++m_decodedCount;
+  return str;
+}
+
+char* StringPool::allocate( std::size_t size )
+{
+  enum { ARENA_BLOCK_SIZE = 64 * 1024 };
+  // Empty strings still need a valid pointer, since nullptr marks them as not decoded
+  static char empty;
+  if( size == 0 ) return &empty;
+  // Large requests get a block of their own rather than wasting the rest of the current one
+  if( size > ARENA_BLOCK_SIZE / 4 )
+  {
+    m_arena.emplace_back( new char[ size ] );
+    return m_arena.back().get();
+  }
+  if( size > m_arenaLeft )
+  {
+    m_arena.emplace_back( new char[ ARENA_BLOCK_SIZE ] );
+    m_arenaPos = m_arena.back().get();
+    m_arenaLeft = ARENA_BLOCK_SIZE;
+  }
+  char* result = m_arenaPos;
+  m_arenaPos += size;
+  m_arenaLeft -= size;
+  return result;
+}
+
+int StringPool::load( const char* data, std::size_t size )
 {
   try
   {
-    m_pool.clear();
+    m_stringCount = 0;
+    m_strings = std::vector< std::atomic< const char* > >();
+    m_decodedCount = 0;
+    m_arena.clear();
+    m_arenaPos = nullptr;
+    m_arenaLeft = 0;
 
     // Read header
-    BFSStringPoolHeader header = readHeader( io, pos );
+    BFSStringPoolHeader header = readHeader( data, size );
+    if( header.end > size ) return -1;
 
     unsigned int huffmanTreeSize;
     unsigned int offsetsSize;
@@ -81,52 +234,24 @@ int StringPool::read( PHYSFS_Io& io, unsigned int pos )
     }
 
     // Read Huffmann Tree
-    std::vector< char > huffmanTreeData( huffmanTreeSize );
-    if( !io.seek( &io, header.huffmannTreeOffset ) ) return -1;
-    if( io.read( &io, huffmanTreeData.data(), huffmanTreeSize ) != huffmanTreeSize ) return -1;
-    Huffmann huffmannTree( huffmanTreeData.data(), huffmanTreeData.data() + huffmanTreeData.size() );
-    huffmanTreeData.clear();
+    const char* huffmanTreeData = data + header.huffmannTreeOffset;
+    HuffmannTable huffmannTable( Huffmann( huffmanTreeData, huffmanTreeData + huffmanTreeSize ) );
 
     // Read unpacked sizes
-    std::vector< std::uint16_t > uncompressedSizes( uncompressedSizesSize / 2 );
-    if( !io.seek( &io, header.uncompressedSizesOffset ) ) return -1;
-    if( io.read( &io, uncompressedSizes.data(), uncompressedSizesSize ) != uncompressedSizesSize ) return -1;
+    m_uncompressedSizes.resize( uncompressedSizesSize / 2 );
+    std::memcpy( m_uncompressedSizes.data(), data + header.uncompressedSizesOffset, m_uncompressedSizes.size() * 2 );
 
     // Read offsets
-    std::vector< std::uint32_t > offsets( offsetsSize / 4 );
-    if( !io.seek( &io, header.offsetsOffset ) ) return -1;
-    if( io.read( &io, offsets.data(), offsetsSize ) != offsetsSize ) return -1;
+    m_offsets.resize( offsetsSize / 4 );
+    std::memcpy( m_offsets.data(), data + header.offsetsOffset, m_offsets.size() * 4 );
 
     // Read packed strings
-    std::vector< char > compressedStrings( compressedStringsSize );
-    if( !io.seek( &io, header.compressedStringsOffset ) ) return -1;
-    if( io.read( &io, compressedStrings.data(), compressedStringsSize ) != compressedStringsSize ) return -1;
-
-    const unsigned int stringCount = std::min( uncompressedSizes.size(), offsets.size() );
+    m_compressedStrings.assign( data + header.compressedStringsOffset, data + header.compressedStringsOffset + compressedStringsSize );
 
-    m_pool.reserve( stringCount );
-    for( unsigned int strIndex = 0; strIndex < stringCount; ++strIndex )
-    {
-      const char * const begin = compressedStrings.data() + PHYSFS_swapULE32( offsets[ strIndex ] );
-      const char * const end = compressedStrings.data() + compressedStrings.size();
-      BitStream stream( begin, end );
-
-      std::string str;
-      std::uint16_t uncompressedSize = PHYSFS_swapULE16( uncompressedSizes[ strIndex ] );
-      str.reserve( uncompressedSize );
-
-      for( unsigned int charIndex = 0; charIndex < uncompressedSize; ++charIndex )
-      {
-        char curChar;
-        if( !huffmannTree.decode( stream, curChar ) )
-        {
-          m_pool.clear();
-          return -1;
-        }
-        str.push_back( curChar );
-      }
-      m_pool.emplace_back( std::move( str ) );
-    }
+    m_huffmannTable = std::move( huffmannTable );
+    m_stringCount = std::min( m_uncompressedSizes.size(), m_offsets.size() );
+    m_strings = std::vector< std::atomic< const char* > >( m_stringCount );
+    for( auto& str : m_strings ) str.store( nullptr, std::memory_order_relaxed );
     return header.end;
   }
   catch( UnexpectedEnfOfInput )
@@ -134,3 +259,19 @@ int StringPool::read( PHYSFS_Io& io, unsigned int pos )
     return -1;
   }
 }
+
+unsigned int StringPool::length( unsigned int index ) const
+{
+  return PHYSFS_swapULE16( m_uncompressedSizes.at( index ) );
+}
+
+bool StringPool::decode( unsigned int index, char* out_string ) const
+{
+  const std::uint32_t offset = PHYSFS_swapULE32( m_offsets[ index ] );
+  if( offset > m_compressedStrings.size() ) return false;
+  const char * const begin = m_compressedStrings.data() + offset;
+  const char * const end = m_compressedStrings.data() + m_compressedStrings.size();
+  BitStream stream( begin, end );
+
+  return m_huffmannTable.decode( stream, PHYSFS_swapULE16( m_uncompressedSizes[ index ] ), out_string );
+}
@@ -2,31 +2,76 @@
 
 #include <string>
 #include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <cstddef>
+#include <cstdint>
 
-struct PHYSFS_Io;
+#include "huffmann.hpp"
 
+/**
+@brief Huffman compressed string pool of a BFS archive
+
+Once loaded, get(), decodeAll() and the const methods are thread-safe; decoded strings are published atomically so lookups of strings already decoded don't lock.
+**/
 class StringPool
 {
 public:
-  StringPool() = default;
-  ~StringPool() = default;
-  StringPool( const StringPool& rhs ) = default;
-  StringPool& operator=( const StringPool& rhs ) = default;
+  StringPool();
+  ~StringPool();
+  StringPool( const StringPool& rhs ) = delete;
+  StringPool& operator=( const StringPool& rhs ) = delete;
   StringPool( StringPool&& rhs );
   StringPool& operator=( StringPool&& rhs );
 
   /**
-  @param io File to read from; i/o position will be moved past end of pool.
-  @param pos i/o position of string pool start
-  @return i/o position past end of pool.
+  @brief Load the compressed pool without decoding any strings; get() decodes them on first use.
+  @param data Start of the string pool
+  @param size Bytes available at data, at least the size of the pool
+  @return Size of the pool, or -1 on error.
+  **/
+  int load( const char* data, std::size_t size );
+
+  /**
+  @brief Decode all strings of a loaded pool that have not been decoded yet.
+  @param threadCount Number of threads to decode on, including the calling one; 0 for one per core.
+  @return false on error
   **/
-  int read( PHYSFS_Io& io, unsigned int pos );
+  bool decodeAll( unsigned int threadCount = 1 );
 
-  const std::string& at( unsigned int index ) const { return m_pool.at( index ); }
-  unsigned int size() const { return m_pool.size(); }
+  /**
+  @brief Retrieve a string, decoding it if this is the first time it is needed.
+  @return The string of length( index ) characters, not null-terminated; nullptr if it failed to decode.
+  **/
+  const char* get( unsigned int index );
+
+  /// Length of a string without decoding it
+  unsigned int length( unsigned int index ) const;
+  unsigned int size() const { return m_stringCount; }
+  /// Number of strings decoded so far
+  unsigned int decodedCount() const { return m_decodedCount.load( std::memory_order_relaxed ); }
 
 private:
-  std::vector< std::string > m_pool;
+  /// Decode a string into out_string, which must have room for length( index ) characters
+  bool decode( unsigned int index, char* out_string ) const;
+  /// Reserve arena space for decoded strings; stays valid until the pool is reloaded
+  char* allocate( std::size_t size );
 
+private:
+  HuffmannTable m_huffmannTable;
+  std::vector< char > m_compressedStrings;
+  std::vector< std::uint32_t > m_offsets;
+  std::vector< std::uint16_t > m_uncompressedSizes;
+  unsigned int m_stringCount = 0;
+  /// Decoded strings by index, nullptr until needed; they point into m_arena
+  std::vector< std::atomic< const char* > > m_strings;
+  std::atomic< unsigned int > m_decodedCount{ 0 };
+  /// Serializes decoding, i.e. writes to m_strings and m_arena
+  std::mutex m_decodeMutex;
+  /// Blocks holding the decoded strings back to back
+  std::vector< std::unique_ptr< char[] > > m_arena;
+  char* m_arenaPos = nullptr;
+  std::size_t m_arenaLeft = 0;
 };
 
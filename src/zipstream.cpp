@@ -1,192 +1,215 @@
 #include "zipstream.hpp"
+#include "inflater.hpp"
+#include "inflaterpool.hpp"
 
 #include <physfs.h>
-extern "C"
-{
-#include "physfs_miniz.hpp"
-}
 
+#include <vector>
 #include <utility>
-#include <cstdlib>
-#include <cstring>
+#include <algorithm>
+#include <atomic>
 
-// zlib's inflateCopy not supplied by physfs_miniz.hpp
-static int inflateCopy( z_stream* dest, const z_stream* src )
+/// Decompression state with its buffered input; only the stream owning it alone may modify it
+struct ZipStream::State
 {
-  if( !dest || !src ) return MZ_PARAM_ERROR;
-  auto prevMsg = dest->msg;
-  std::memcpy( dest, src, sizeof( z_stream ) );
-  dest->msg = prevMsg;
+  explicit State( InflaterPool* pool );
+  ~State();
+  State( const State& ) = delete;
+  State& operator=( const State& ) = delete;
 
-  // copy stream state, if any
-  if( dest->state )
-  {
-    if( !dest->zalloc ) return Z_STREAM_ERROR;
-    inflate_state* state = static_cast< inflate_state* >( dest->zalloc( dest->opaque, 1, sizeof( inflate_state ) ) );
-    if( !state )
-    {
-      dest->state = nullptr;
-      return Z_MEM_ERROR;
-    }
-    std::memcpy( state, src->state, sizeof( inflate_state ) );
-    dest->state = reinterpret_cast< mz_internal_state* >( state );
-  }
-  return Z_OK;
-}
+  /// Where inflater and buffer go back to, if anywhere
+  InflaterPool* const pool;
+  /// Streams using this state; each lets go with a release, so whoever sees 1 with an acquire may modify it
+  std::atomic< unsigned int > sharers{ 1 };
+  std::unique_ptr< Inflater > inflater;
+  /// Compressed data not yet consumed, in buffer or provided by readDirect()
+  const unsigned char* input = nullptr;
+  std::size_t inputSize = 0;
+  /// Compressed input, allocated on first read
+  std::vector< unsigned char > buffer;
+};
 
-static void* alloc_func( void *opaque, unsigned int items, unsigned int size )
+ZipStream::State::State( InflaterPool* pool )
+: pool( pool )
 {
-  ( void )opaque;
-  return std::malloc( items * size );
 }
 
-static void free_func( void *opaque, void *address )
+ZipStream::State::~State()
 {
-  ( void )opaque;
-  std::free( address );
+  if( !pool ) return;
+  pool->release( std::move( inflater ) );
+  pool->release( std::move( buffer ) );
 }
 
-ZipStream::ZipStream()
-: m_stream( new z_stream{} ) // zero-initialize
-, m_buffer( BUFFERSIZE )
+ZipStream::ZipStream( InflaterPool* pool )
+: m_pool( pool )
 {
-  m_stream->zalloc = alloc_func;
-  m_stream->zfree = free_func;
-  switch( inflateInit2( m_stream, MAX_WBITS ) )
-  {
-  case Z_OK:
-    break;
-  case Z_MEM_ERROR:
-    delete m_stream;
-    m_stream = nullptr;
-    throw PHYSFS_ERR_OUT_OF_MEMORY;
-  default:
-    delete m_stream;
-    m_stream = nullptr;
-    throw PHYSFS_ERR_OTHER_ERROR;
-  }
 }
 
 ZipStream::~ZipStream()
 {
-  if( m_stream )
-  {
-    inflateEnd( m_stream );
-    delete m_stream;
-  }
+  releaseState();
 }
 
 ZipStream::ZipStream( const ZipStream& rhs )
-: m_stream( new z_stream{} ) // zero-initialize
-, m_buffer( BUFFERSIZE )
+: m_pool( rhs.m_pool )
+, m_state( rhs.m_state )
 {
-  copyStream( rhs );
+  if( m_state ) m_state->sharers.fetch_add( 1, std::memory_order_relaxed );
 }
 
 ZipStream& ZipStream::operator=( const ZipStream& rhs )
 {
-  if( m_stream ) inflateEnd( m_stream );
-  copyStream( rhs );
+  if( rhs.m_state ) rhs.m_state->sharers.fetch_add( 1, std::memory_order_relaxed );
+  releaseState();
+  m_state = rhs.m_state;
   return *this;
 }
 
-void ZipStream::copyStream( const ZipStream& rhs )
+ZipStream::ZipStream( ZipStream&& rhs )
+: m_pool( rhs.m_pool )
+, m_state( std::move( rhs.m_state ) )
 {
-  if( !rhs.m_stream )
-  {
-    delete m_stream;
-    m_stream = nullptr;
-    return;
-  }
-  if( !m_stream ) m_stream = new z_stream{};
-  switch( inflateCopy( m_stream, rhs.m_stream ) )
+}
+
+ZipStream& ZipStream::operator=( ZipStream&& rhs )
+{
+  if( this == &rhs ) return *this;
+  releaseState();
+  m_pool = rhs.m_pool;
+  m_state = std::move( rhs.m_state );
+  return *this;
+}
+
+void ZipStream::releaseState()
+{
+  // Orders our use of the state before whichever sharer modifies it next
+  if( m_state ) m_state->sharers.fetch_sub( 1, std::memory_order_release );
+  m_state.reset();
+}
+
+/// New Inflater from pool, if any
+static std::unique_ptr< Inflater > acquireInflater( InflaterPool* pool )
+{
+  return pool ? pool->acquireInflater() : std::unique_ptr< Inflater >( new Inflater );
+}
+
+/// Copy of source, in memory from pool if any
+static std::unique_ptr< Inflater > copyInflater( InflaterPool* pool, const Inflater& source )
+{
+  if( !pool ) return std::unique_ptr< Inflater >( new Inflater( source ) );
+  std::unique_ptr< Inflater > result = pool->acquireInflater();
+  *result = source;
+  return result;
+}
+
+ZipStream::State& ZipStream::unshare()
+{
+  if( !m_state )
   {
-  case Z_OK:
-    break;
-  case Z_MEM_ERROR:
-    delete m_stream;
-    m_stream = nullptr;
-    throw PHYSFS_ERR_OUT_OF_MEMORY;
-  default:
-    delete m_stream;
-    m_stream = nullptr;
-    throw PHYSFS_ERR_OTHER_ERROR;
+    m_state = std::make_shared< State >( m_pool );
+    m_state->inflater = acquireInflater( m_pool );
   }
-  // copy input buffer if necessary
-  if( rhs.m_stream->avail_in > 0 )
+  else if( m_state->sharers.load( std::memory_order_acquire ) > 1 )
   {
-    m_buffer = rhs.m_buffer;
-    m_stream->next_in = m_buffer.data() + ( rhs.m_stream->next_in - rhs.m_buffer.data() );
+    // Others still use it, so continue on a copy of our own, borrowed from our pool
+    const State& shared = *m_state;
+    std::shared_ptr< State > copy = std::make_shared< State >( m_pool );
+    copy->inflater = copyInflater( m_pool, *shared.inflater );
+    copy->input = shared.input;
+    copy->inputSize = shared.inputSize;
+    // copy input buffer if necessary; input read directly from elsewhere stays valid as is
+    const unsigned char* const bufferBegin = shared.buffer.data();
+    if( shared.inputSize > 0 && shared.input >= bufferBegin && shared.input <= bufferBegin + shared.buffer.size() )
+    {
+      copy->buffer = m_pool ? m_pool->acquireBuffer( shared.buffer.size() ) : std::vector< unsigned char >( shared.buffer.size() );
+      std::copy( shared.buffer.begin(), shared.buffer.end(), copy->buffer.begin() );
+      copy->input = copy->buffer.data() + ( shared.input - bufferBegin );
+    }
+    releaseState();
+    m_state = std::move( copy );
   }
+  return *m_state;
 }
 
-ZipStream::ZipStream( ZipStream&& rhs )
-: m_stream( rhs.m_stream )
-, m_buffer( std::move( rhs.m_buffer ) )
+std::int64_t ZipStream::read( char buf[], const std::uint64_t len, std::function< std::int64_t( char buf[], const std::uint64_t len ) > readInput )
 {
-  rhs.m_stream = nullptr;
+  return decompress( buf, len, [ this, &readInput ]()
+  {
+    State& state = *m_state;
+    if( state.buffer.empty() ) state.buffer = m_pool ? m_pool->acquireBuffer( BUFFERSIZE ) : std::vector< unsigned char >( BUFFERSIZE );
+    const std::int64_t inputRead = readInput( reinterpret_cast< char* >( state.buffer.data() ), state.buffer.size() );
+    if( inputRead > 0 )
+    {
+      state.input = state.buffer.data();
+      state.inputSize = static_cast< std::size_t >( inputRead );
+    }
+    return inputRead;
+  } );
 }
 
-ZipStream& ZipStream::operator=( ZipStream&& rhs )
+std::int64_t ZipStream::readDirect( char buf[], const std::uint64_t len, std::function< std::int64_t( const char*& out_data ) > getInput )
 {
-  if( m_stream )
+  return decompress( buf, len, [ this, &getInput ]()
   {
-    inflateEnd( m_stream );
-    delete m_stream;
-  }
-  m_stream = rhs.m_stream;
-  rhs.m_stream = nullptr;
-  m_buffer = std::move( rhs.m_buffer );
-  return *this;
+    const char* data = nullptr;
+    const std::int64_t inputSize = getInput( data );
+    if( inputSize > 0 )
+    {
+      m_state->input = reinterpret_cast< const unsigned char* >( data );
+      m_state->inputSize = static_cast< std::size_t >( inputSize );
+    }
+    return inputSize;
+  } );
 }
 
-
-std::int64_t ZipStream::read( char buf[], const std::uint64_t len, std::function< std::int64_t( char buf[], const std::uint64_t len ) > readInput )
+std::int64_t ZipStream::decompress( char buf[], const std::uint64_t len, const std::function< std::int64_t() >& fillInput )
 {
-  if( !m_stream )
+  State* state;
+  try
+  {
+    state = &unshare();
+  }
+  catch( PHYSFS_ErrorCode code )
   {
-    PHYSFS_setErrorCode( PHYSFS_ERR_OTHER_ERROR );
+    PHYSFS_setErrorCode( code );
     return -1;
   }
-  std::int64_t read = 0;
-  m_stream->avail_out = len;
-  m_stream->next_out = reinterpret_cast< unsigned char* >( buf );
-  while( read < len )
+  unsigned char* out = reinterpret_cast< unsigned char* >( buf );
+  std::size_t outSize = len;
+  bool inputExhausted = false;
+  while( outSize > 0 )
   {
     // Fill input buffer if necessary
-    if( m_stream->avail_in == 0 )
+    if( state->inputSize == 0 && !inputExhausted )
     {
-      m_stream->avail_in = readInput( reinterpret_cast< char* >( m_buffer.data() ), m_buffer.size() );
-      if( m_stream->avail_in < 0 )
+      const std::int64_t inputRead = fillInput();
+      if( inputRead < 0 )
       {
-        // readInput() should've set an error code.
+        // fillInput() should've set an error code.
         return -1;
       }
-      if( m_stream->avail_in == 0 )
-      {
-        PHYSFS_setErrorCode( PHYSFS_ERR_PAST_EOF );
-        break;
-      }
-      m_stream->next_in = m_buffer.data();
+      // Out of input, but there may still be decompressed data to hand out
+      inputExhausted = inputRead == 0;
     }
-    auto previouslyRead = m_stream->total_out;
-    auto retVal = inflate( m_stream, Z_SYNC_FLUSH );
-    read += m_stream->total_out - previouslyRead;
-    switch( retVal )
+    switch( state->inflater->inflate( state->input, state->inputSize, out, outSize ) )
     {
-    case Z_OK:
+    case Inflater::RESULT_OK:
       // Read something, not done yet
       break;
-    case Z_STREAM_END:
+    case Inflater::RESULT_END:
       // Read all there is
-      return read;
+      return out - reinterpret_cast< unsigned char* >( buf );
+    case Inflater::RESULT_NEED_INPUT:
+      if( inputExhausted )
+      {
+        PHYSFS_setErrorCode( PHYSFS_ERR_PAST_EOF );
+        return out - reinterpret_cast< unsigned char* >( buf );
+      }
       break;
 
       // Error cases
-    case Z_ERRNO:
-      PHYSFS_setErrorCode( PHYSFS_ERR_IO );
-      return -1;
-    case Z_MEM_ERROR:
+    case Inflater::RESULT_OUT_OF_MEMORY:
       PHYSFS_setErrorCode( PHYSFS_ERR_OUT_OF_MEMORY );
       return -1;
     default:
@@ -194,5 +217,41 @@ std::int64_t ZipStream::read( char buf[], const std::uint64_t len, std::function
       return -1;
     }
   }
-  return read;
+  return out - reinterpret_cast< unsigned char* >( buf );
+}
+
+ZipStream ZipStream::snapshot() const
+{
+  ZipStream result( m_pool );
+  if( m_state )
+  {
+    result.m_state = std::make_shared< State >( m_pool );
+    result.m_state->inflater = copyInflater( m_pool, *m_state->inflater );
+  }
+  return result;
+}
+
+std::uint64_t ZipStream::totalIn() const
+{
+  return m_state ? m_state->inflater->totalIn() : 0;
+}
+
+std::uint64_t ZipStream::totalOut() const
+{
+  return m_state ? m_state->inflater->totalOut() : 0;
+}
+
+bool ZipStream::inflateWhole( const char* in, std::size_t inSize, char* out, std::size_t outSize )
+{
+  return ::inflateWhole( in, inSize, out, outSize );
+}
+
+std::size_t ZipStream::memoryUsage() const
+{
+  return m_state ? sizeof( State ) + Inflater::stateSize() + m_state->buffer.size() : 0;
+}
+
+std::size_t ZipStream::snapshotSize()
+{
+  return sizeof( ZipStream ) + sizeof( State ) + Inflater::stateSize();
 }
@@ -1,10 +1,11 @@
 #pragma once
 
 #include <functional>
-#include <vector>
+#include <memory>
 #include <cstdint>
+#include <cstddef>
 
-typedef struct mz_stream_s mz_stream;
+class InflaterPool;
 
 class ZipStream
 {
@@ -13,17 +14,14 @@ class ZipStream
   };
 public:
   /**
-  @throw PHYSFS_ErrorCode on error
+  Decompression state is only allocated on the first read()
+  @param pool Where to borrow decompression state and buffers from instead of allocating them, if any; must outlive the stream and its copies
   **/
-  ZipStream();
+  explicit ZipStream( InflaterPool* pool = nullptr );
   ~ZipStream();
-  /**
-  @throw PHYSFS_ErrorCode on error
-  **/
+  /// Shares the decompression state and buffered input until either stream reads on, so copies are cheap
   ZipStream( const ZipStream& rhs );
-  /**
-  @throw PHYSFS_ErrorCode on error
-  **/
+  /// Like the copy constructor, but keeps using our own pool
   ZipStream& operator=( const ZipStream& rhs );
   ZipStream( ZipStream&& rhs );
   ZipStream& operator=( ZipStream&& rhs );
@@ -36,11 +34,52 @@ public:
   **/
   std::int64_t read( char buf[], const std::uint64_t len, std::function< std::int64_t( char buf[], const std::uint64_t len ) > readInput );
 
+  /**
+  Like read(), but decompresses straight from memory instead of copying the compressed data into a buffer first.
+  @param getInput function pointing out_data at the next compressed data, which must stay valid until decompressed; returns its size (at most UINT_MAX), 0 at the end or -1 on error.
+  **/
+  std::int64_t readDirect( char buf[], const std::uint64_t len, std::function< std::int64_t( const char*& out_data ) > getInput );
+
+  /**
+  @brief Copy of the decompression state without buffered input, for resuming decompression later.
+  Input has to continue at totalIn() once the copy is used.
+  @throw PHYSFS_ErrorCode on error
+  **/
+  ZipStream snapshot() const;
+
+  /// Compressed bytes consumed so far
+  std::uint64_t totalIn() const;
+  /// Uncompressed bytes returned so far
+  std::uint64_t totalOut() const;
+  /// Memory held by the decompression state and buffered input, 0 before the first read()
+  std::size_t memoryUsage() const;
+  /// Approximate memory used by a snapshot()
+  static std::size_t snapshotSize();
+
+  /**
+  @brief Decompress a complete zlib stream in one go, without any streaming state.
+  @param out Receives the uncompressed data, which must be exactly outSize bytes.
+  @return false on error
+  **/
+  static bool inflateWhole( const char* in, std::size_t inSize, char* out, std::size_t outSize );
+
 private:
-  void copyStream( const ZipStream& rhs );
+  struct State;
+
+private:
+  /**
+  @brief The state to decompress with, for our use only: created on first use, copied if shared with other streams.
+  @throw PHYSFS_ErrorCode on error
+  **/
+  State& unshare();
+  /// Stop using our state, counting us out of its sharers
+  void releaseState();
+  /// Shared implementation of read() and readDirect(); fillInput provides more input if possible and returns its size or -1
+  std::int64_t decompress( char buf[], const std::uint64_t len, const std::function< std::int64_t() >& fillInput );
 
 private:
-  mz_stream* m_stream;
-  std::vector< unsigned char > m_buffer;
+  InflaterPool* m_pool;
+  /// nullptr until the first read(); shared with copies, never modified while it has other sharers
+  std::shared_ptr< State > m_state;
 };
 
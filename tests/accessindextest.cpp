@@ -0,0 +1,209 @@
+/*
+Decompresses large files split at their access points across threads, and compares the output byte for byte with decompressing
+them whole on one thread: through AccessIndex itself, and through an archive indexed with buildBfsAccessIndex(). Damaged sidecar
+files must not change what is read, only that it is read without the access points.
+*/
+
+#include "testsupport.hpp"
+
+#include <physfs.h>
+#include "bfsarchiver.h"
+#include "accessindex.hpp"
+#include "inflater.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+static const char* const ARCHIVE = "accessindextest.bfs";
+static const char* const SIDECAR = "accessindextest.bfs.acc";
+static const unsigned long long MIN_FILE_SIZE = 1 << 20;
+static const unsigned int SPACING = 256 * 1024;
+
+/// Layout of the sidecar file: header, then entries, points and windows
+enum SidecarLayout
+{
+  HEADER_SIZE = 56,
+  ENTRY_COUNT_OFFSET = 16,
+  POINT_COUNT_OFFSET = 20,
+  ENTRY_SIZE = 16,
+  POINT_SIZE = 32,
+  POINT_IN_BIT_POS_OFFSET = 8,
+};
+
+static void checkAccessIndex( const std::string& source, const std::string& compressed, const char* what )
+{
+  std::string serial( source.size(), '\0' );
+  if( !CHECK( inflateWhole( compressed.data(), compressed.size(), &serial[ 0 ], serial.size() ) && serial == source ) ) return;
+
+  AccessIndex index;
+  std::string out( source.size(), '\0' );
+  if( !CHECK( index.add( 0, compressed.data(), compressed.size(), &out[ 0 ], out.size(), 64 * 1024 ) && out == source ) ) return;
+  if( !CHECK( index.contains( 0 ) && index.pointCount() > 2 ) )
+  {
+    std::fprintf( stderr, "  %s: %zu access points\n", what, index.pointCount() );
+    return;
+  }
+  for( unsigned int threads : { 1, 2, 3, 8, 0 } )
+  {
+    out.assign( source.size(), '\0' );
+    if( !CHECK( index.inflateWhole( 0, compressed.data(), compressed.size(), &out[ 0 ], out.size(), threads ) && out == serial ) )
+    {
+      std::fprintf( stderr, "  %s, %u threads\n", what, threads );
+    }
+  }
+  // Files without access points are left to the caller
+  CHECK( !index.inflateWhole( 1, compressed.data(), compressed.size(), &out[ 0 ], out.size(), 4 ) );
+
+  // A corrupt stream fails its checksum, even where every part decompresses
+  std::string corrupt = compressed;
+  corrupt[ corrupt.size() / 2 ] ^= 0x10;
+  std::string reference( source.size(), '\0' );
+  if( !uncompressZlib( corrupt, reference ) ) CHECK( !index.inflateWhole( 0, corrupt.data(), corrupt.size(), &out[ 0 ], out.size(), 4 ) );
+}
+
+static std::string readFile( const char* path )
+{
+  std::ifstream stream( path, std::ios::binary );
+  return std::string( std::istreambuf_iterator< char >( stream ), std::istreambuf_iterator< char >() );
+}
+
+static std::uint32_t readUint32( const std::string& data, std::size_t offset )
+{
+  std::uint32_t value = 0;
+  if( offset + sizeof( value ) <= data.size() ) std::memcpy( &value, data.data() + offset, sizeof( value ) );
+  return value;
+}
+
+/// Mount the archive, read every file whole and compare it; @return Files decompressed in parallel
+static unsigned long long readAll( const std::map< std::string, std::string >& files, const char* what, unsigned long long* indexedFiles = nullptr )
+{
+  if( !CHECK( PHYSFS_mount( ARCHIVE, "/", 1 ) ) ) return 0;
+  std::string contents;
+  for( const auto& file : files )
+  {
+    PHYSFS_File* handle = PHYSFS_openRead( file.first.c_str() );
+    if( !CHECK( handle ) ) continue;
+    contents.assign( file.second.size(), '\0' );
+    if( !CHECK( PHYSFS_readBytes( handle, &contents[ 0 ], contents.size() ) == PHYSFS_sint64( contents.size() ) && contents == file.second ) )
+    {
+      std::fprintf( stderr, "  %s, %s\n", file.first.c_str(), what );
+    }
+    PHYSFS_close( handle );
+  }
+  BFSArchiveStats stats;
+  CHECK( getBfsArchiveStats( ARCHIVE, &stats ) );
+  if( indexedFiles ) *indexedFiles = stats.accessIndexFiles;
+  PHYSFS_unmount( ARCHIVE );
+  return stats.parallelInflates;
+}
+
+/// Write a damaged copy of the sidecar file, read the archive with it and check no file was decompressed with its access points
+static void checkDamaged( const std::map< std::string, std::string >& files, const std::string& sidecar, const char* what )
+{
+  std::ofstream( SIDECAR, std::ios::binary | std::ios::trunc ) << sidecar;
+  if( !CHECK( readAll( files, what ) == 0 ) ) std::fprintf( stderr, "  access points used, %s\n", what );
+}
+
+int main( int argc, char** argv )
+{
+  std::mt19937 random( 2323 );
+  const std::string text = makeTestData( random, 3 << 20 );
+  std::string noise( 2 << 20, '\0' );
+  for( char& c : noise ) c = char( random() );
+  for( int level : { 1, 6, 9 } )
+  {
+    char what[ 64 ];
+    std::snprintf( what, sizeof( what ), "level %d", level );
+    checkAccessIndex( text, deflateZlib( text, level, STRATEGY_DEFAULT ), what );
+    std::snprintf( what, sizeof( what ), "level %d, fixed codes", level );
+    checkAccessIndex( text, deflateZlib( text, level, STRATEGY_FIXED ), what );
+  }
+  checkAccessIndex( text, deflateZlib( text, 6, STRATEGY_DEFAULT, FLUSH_FULL, 100000 ), "full flushes" );
+  checkAccessIndex( noise, deflateZlib( noise, 6, STRATEGY_DEFAULT ), "incompressible" );
+
+  // Large files to index, one too many to be stored, and small ones that aren't indexed
+  std::map< std::string, std::string > files;
+  BFSWriter writer;
+  const std::size_t largeFiles = 4;
+  for( std::size_t i = 0; i < largeFiles; ++i )
+  {
+    const std::string path = "data/large" + std::to_string( i ) + ".bin";
+    files[ path ] = makeTestData( random, ( 2 << 20 ) + random() % ( 1 << 20 ) );
+    writer.add( path, files[ path ], 1 + 4 * i % 9 );
+  }
+  files[ "data/stored.bin" ] = makeTestData( random, 2 << 20 );
+  writer.add( "data/stored.bin", files[ "data/stored.bin" ], 0 );
+  for( std::size_t i = 0; i < 20; ++i )
+  {
+    const std::string path = "data/small" + std::to_string( i ) + ".txt";
+    files[ path ] = makeTestData( random, random() % 50000 );
+    writer.add( path, files[ path ], 6 );
+  }
+  std::remove( SIDECAR );
+  if( !CHECK( writer.write( ARCHIVE ) ) ) return checkResult();
+
+  PHYSFS_init( argv[ 0 ] );
+  registerBfsArchiver();
+  setBfsParallelInflate( 1, 4 );
+
+  // Indexing uses the access points right away
+  if( CHECK( PHYSFS_mount( ARCHIVE, "/", 1 ) ) )
+  {
+    CHECK( buildBfsAccessIndex( ARCHIVE, MIN_FILE_SIZE, SPACING ) );
+    PHYSFS_unmount( ARCHIVE );
+  }
+  unsigned long long indexedFiles = 0;
+  CHECK( readAll( files, "indexed", &indexedFiles ) == largeFiles && indexedFiles == largeFiles );
+  setBfsMemoryMap( 0 );
+  CHECK( readAll( files, "indexed, positional reads" ) == largeFiles );
+  setBfsMemoryMap( 1 );
+
+  // Damaged sidecar files are either rejected on mount, or their access points fail the checksum and the files are decompressed whole
+  const std::string sidecar = readFile( SIDECAR );
+  const std::uint32_t entryCount = readUint32( sidecar, ENTRY_COUNT_OFFSET );
+  const std::uint32_t pointCount = readUint32( sidecar, POINT_COUNT_OFFSET );
+  const std::size_t pointsOffset = HEADER_SIZE + std::size_t( entryCount ) * ENTRY_SIZE;
+  const std::size_t windowsOffset = pointsOffset + std::size_t( pointCount ) * POINT_SIZE;
+  if( CHECK( entryCount == largeFiles && windowsOffset < sidecar.size() ) )
+  {
+    checkDamaged( files, sidecar.substr( 0, sidecar.size() - 1 ), "truncated" );
+    checkDamaged( files, sidecar.substr( 0, HEADER_SIZE / 2 ), "truncated header" );
+
+    std::string damaged = sidecar;
+    damaged[ HEADER_SIZE - 1 ] ^= 1;
+    checkDamaged( files, damaged, "other archive" );
+
+    damaged = sidecar;
+    for( std::size_t i = windowsOffset; i < damaged.size(); ++i ) damaged[ i ] ^= 0x5a;
+    checkDamaged( files, damaged, "damaged windows" );
+
+    // Every access point but the first of each file starts a bit late
+    damaged = sidecar;
+    for( std::uint32_t i = 0; i < pointCount; ++i )
+    {
+      std::uint64_t inBitPos;
+      char* field = &damaged[ pointsOffset + std::size_t( i ) * POINT_SIZE + POINT_IN_BIT_POS_OFFSET ];
+      std::memcpy( &inBitPos, field, sizeof( inBitPos ) );
+      if( inBitPos == 0 ) continue;
+      ++inBitPos;
+      std::memcpy( field, &inBitPos, sizeof( inBitPos ) );
+    }
+    checkDamaged( files, damaged, "misplaced access points" );
+
+    damaged = sidecar;
+    for( std::uint32_t i = 0; i < pointCount; ++i ) std::memset( &damaged[ pointsOffset + std::size_t( i ) * POINT_SIZE ], 0xff, POINT_SIZE );
+    checkDamaged( files, damaged, "access points out of range" );
+  }
+
+  // Without parallel decompression the sidecar file is ignored
+  std::ofstream( SIDECAR, std::ios::binary | std::ios::trunc ) << sidecar;
+  setBfsParallelInflate( 0, 0 );
+  CHECK( readAll( files, "parallel decompression disabled", &indexedFiles ) == 0 && indexedFiles == 0 );
+
+  PHYSFS_deinit();
+  std::remove( ARCHIVE );
+  std::remove( SIDECAR );
+  return checkResult();
+}
@@ -0,0 +1,184 @@
+/*
+Round trips data compressed by zlib through the inflate backend selected with BFS_INFLATE_BACKEND: whole, streaming in chunks,
+from copies of a stream halfway through, split up at the block boundaries it reports, and through the files of a mounted archive.
+Streams zlib considers corrupt must fail.
+*/
+
+#include "testsupport.hpp"
+
+#include <physfs.h>
+#include "bfsarchiver.h"
+#include "inflater.hpp"
+
+#include <zlib.h>
+
+#include <cstdio>
+#include <cstdlib>
+
+static const char* const ARCHIVE = "backendtest.bfs";
+
+/// Stream through an Inflater in chunks of the given sizes; @return whether it reached the end of the stream
+static bool inflateStreaming( Inflater& inflater, const std::string& in, std::size_t inChunk, std::size_t outChunk, std::size_t maxSize, std::string& out )
+{
+  std::vector< unsigned char > buffer( outChunk );
+  std::size_t inPos = 0;
+  out.clear();
+  while( out.size() <= maxSize )
+  {
+    const unsigned char* input = reinterpret_cast< const unsigned char* >( in.data() ) + inPos;
+    std::size_t inSize = std::min( inChunk, in.size() - inPos );
+    const std::size_t inOffered = inSize;
+    unsigned char* output = buffer.data();
+    std::size_t outSize = buffer.size();
+    const Inflater::Result result = inflater.inflate( input, inSize, output, outSize );
+    inPos += inOffered - inSize;
+    out.append( reinterpret_cast< const char* >( buffer.data() ), buffer.size() - outSize );
+    if( result == Inflater::RESULT_END ) return true;
+    if( result == Inflater::RESULT_CORRUPT || result == Inflater::RESULT_OUT_OF_MEMORY ) return false;
+    if( result == Inflater::RESULT_NEED_INPUT && inPos == in.size() ) return false;
+  }
+  return false;
+}
+
+static void checkStream( const std::string& compressed, const std::string& expected, const char* what )
+{
+  std::string reference( expected.size(), '\0' );
+  const bool valid = uncompressZlib( compressed, reference );
+
+  std::string out( expected.size(), '\0' );
+  const bool whole = inflateWhole( compressed.data(), compressed.size(), &out[ 0 ], out.size() );
+  if( !CHECK( whole == valid ) || !CHECK( !valid || out == expected ) ) std::fprintf( stderr, "  whole, %s, %zu bytes\n", what, expected.size() );
+  if( valid && !expected.empty() )
+  {
+    std::string shorter( expected.size() - 1, '\0' );
+    CHECK( !inflateWhole( compressed.data(), compressed.size(), &shorter[ 0 ], shorter.size() ) );
+  }
+
+  const std::size_t chunks[][ 2 ] = { { 1, 1 }, { 7, 13 }, { 4096, 65536 }, { 1 << 20, 1 << 20 } };
+  for( const auto& chunk : chunks )
+  {
+    if( chunk[ 0 ] == 1 && expected.size() > 20000 ) continue;
+    Inflater inflater;
+    const bool streamed = inflateStreaming( inflater, compressed, chunk[ 0 ], chunk[ 1 ], expected.size(), out ) && out.size() == expected.size();
+    if( !CHECK( streamed == valid ) || !CHECK( !valid || out == expected ) )
+    {
+      std::fprintf( stderr, "  streaming, %s, %zu bytes in chunks of %zu in, %zu out\n", what, expected.size(), chunk[ 0 ], chunk[ 1 ] );
+    }
+    if( valid ) CHECK( inflater.totalOut() == expected.size() );
+  }
+}
+
+/// Copy a stream halfway through, as duplicating an open file does, and finish both
+static void checkCopies( const std::string& compressed, const std::string& expected )
+{
+  // Stop once half of the output is there, which some backends need several calls for
+  Inflater original;
+  const unsigned char* input = reinterpret_cast< const unsigned char* >( compressed.data() );
+  std::size_t inSize = compressed.size();
+  std::string out( expected.size() / 2, '\0' );
+  unsigned char* output = reinterpret_cast< unsigned char* >( &out[ 0 ] );
+  std::size_t outSize = out.size();
+  while( outSize > 0 && original.inflate( input, inSize, output, outSize ) == Inflater::RESULT_OK );
+  if( !CHECK( outSize == 0 && expected.compare( 0, out.size(), out ) == 0 ) ) return;
+
+  Inflater copy( original );
+  Inflater assigned;
+  assigned = original;
+  for( Inflater* inflater : { &original, &copy, &assigned } )
+  {
+    const unsigned char* in = input;
+    std::size_t size = inSize;
+    std::string rest( expected.size() - out.size() + 1, '\0' );
+    unsigned char* restOut = reinterpret_cast< unsigned char* >( &rest[ 0 ] );
+    std::size_t restSize = rest.size();
+    Inflater::Result result;
+    while( ( result = inflater->inflate( in, size, restOut, restSize ) ) == Inflater::RESULT_OK );
+    rest.resize( rest.size() - restSize );
+    CHECK( result == Inflater::RESULT_END && expected.compare( out.size(), std::string::npos, rest ) == 0 );
+  }
+
+  // A reset stream starts over
+  original.reset();
+  std::string again;
+  CHECK( inflateStreaming( original, compressed, 4096, 4096, expected.size(), again ) && again == expected );
+}
+
+/// Decompress from every block boundary reported on the way to the end, given the window before it
+static void checkParts( const std::string& compressed, const std::string& expected )
+{
+  std::string out( expected.size(), '\0' );
+  std::vector< std::pair< std::size_t, std::uint64_t > > blocks;
+  const bool indexed = inflateWholeIndexed( compressed.data(), compressed.size(), &out[ 0 ], out.size(), [ &blocks ]( std::size_t outPos, std::uint64_t inBitPos )
+  {
+    blocks.push_back( { outPos, inBitPos } );
+  } );
+  if( !CHECK( indexed && out == expected ) ) return;
+  for( const auto& block : blocks )
+  {
+    if( block.first >= expected.size() ) continue;
+    const std::size_t windowSize = std::min< std::size_t >( block.first, 32768 );
+    const std::size_t inStart = std::size_t( block.second / 8 );
+    std::string part( expected.size() - block.first, '\0' );
+    std::uint32_t checksum = 0;
+    const bool decoded = inflatePart( compressed.data() + inStart, compressed.size() - inStart, unsigned( block.second % 8 ),
+      expected.data() + block.first - windowSize, windowSize, &part[ 0 ], part.size(), checksum );
+    CHECK( decoded && expected.compare( block.first, std::string::npos, part ) == 0
+      && checksum == adler32( 1, reinterpret_cast< const Bytef* >( part.data() ), uInt( part.size() ) ) );
+  }
+}
+
+int main( int argc, char** argv )
+{
+  std::printf( "inflate backend: %s\n", Inflater::backendName() );
+  std::mt19937 random( 4321 );
+  std::vector< std::string > sources;
+  for( std::size_t size : { 0, 1, 100, 5000, 100000, 1000000 } ) sources.push_back( makeTestData( random, size ) );
+  std::string random1M( 1000000, '\0' );
+  for( char& c : random1M ) c = char( random() );
+  sources.push_back( random1M );
+
+  for( const std::string& source : sources )
+  {
+    for( int level : { 0, 1, 6, 9 } )
+    {
+      for( int strategy : { STRATEGY_DEFAULT, STRATEGY_FIXED } )
+      {
+        const std::string compressed = deflateZlib( source, level, DeflateStrategy( strategy ), FLUSH_FULL, 100000 );
+        char what[ 64 ];
+        std::snprintf( what, sizeof( what ), "level %d%s", level, strategy == STRATEGY_FIXED ? ", fixed codes" : "" );
+        checkStream( compressed, source, what );
+        if( !source.empty() ) checkCopies( compressed, source );
+        checkParts( compressed, source );
+      }
+    }
+  }
+
+  for( int i = 0; i < 300; ++i )
+  {
+    const std::string& source = sources[ 1 + random() % ( sources.size() - 1 ) ];
+    std::string corrupt = deflateZlib( source, 1 + random() % 9, STRATEGY_DEFAULT );
+    for( unsigned int flips = 1 + random() % 4; flips > 0; --flips ) corrupt[ random() % corrupt.size() ] ^= char( 1 << random() % 8 );
+    checkStream( corrupt, source, "corrupted" );
+  }
+
+  // Files of a mounted archive decompress through the backend too
+  const std::map< std::string, std::string > files = writeTestArchive( ARCHIVE, 200, 5, 300000 );
+  PHYSFS_init( argv[ 0 ] );
+  registerBfsArchiver();
+  if( CHECK( !files.empty() ) && CHECK( PHYSFS_mount( ARCHIVE, "/", 1 ) ) )
+  {
+    std::string contents;
+    for( const auto& file : files )
+    {
+      PHYSFS_File* handle = PHYSFS_openRead( file.first.c_str() );
+      if( !CHECK( handle ) ) continue;
+      contents.assign( file.second.size(), '\0' );
+      CHECK( PHYSFS_readBytes( handle, &contents[ 0 ], contents.size() ) == PHYSFS_sint64( contents.size() ) && contents == file.second );
+      PHYSFS_close( handle );
+    }
+    PHYSFS_unmount( ARCHIVE );
+  }
+  PHYSFS_deinit();
+  std::remove( ARCHIVE );
+  return checkResult();
+}
@@ -0,0 +1,197 @@
+/*
+Reads, seeks, duplicates and closes the PHYSFS_Io of open files from many threads at once, handing handles between threads so
+duplicates sharing decompression state are used concurrently, and checks every byte read and every position reported.
+Runs with the archive memory mapped, read with positional reads, and read through a locked PHYSFS_Io.
+Usage: duplicatetest [threads, default 8] [operations per thread, default 4000]
+*/
+
+#include "testsupport.hpp"
+
+#include "bfsarchive.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <thread>
+
+static const char* const ARCHIVE = "duplicatetest.bfs";
+/// Handles open at once, all told
+static const std::size_t MAX_HANDLES = 64;
+
+struct Handle
+{
+  PHYSFS_Io* io;
+  const std::pair< std::string, std::string >* file;
+  /// Where the next read should start
+  std::uint64_t position;
+};
+
+/// Open handles not in use by any thread; a thread takes one out, works on it and puts it back, or others it made
+class HandlePool
+{
+public:
+  HandlePool( BFSArchive& archive, const std::vector< std::pair< std::string, std::string > >& files )
+    : m_archive( archive )
+    , m_files( files )
+  {
+  }
+
+  ~HandlePool()
+  {
+    for( const Handle& handle : m_handles ) handle.io->destroy( handle.io );
+  }
+
+  /// Take a random handle, opening one if there are none; @return false if the file could not be opened
+  bool take( std::mt19937& random, Handle& out_handle )
+  {
+    {
+      std::lock_guard< std::mutex > lock( m_mutex );
+      if( !m_handles.empty() )
+      {
+        const std::size_t index = random() % m_handles.size();
+        out_handle = m_handles[ index ];
+        m_handles[ index ] = m_handles.back();
+        m_handles.pop_back();
+        return true;
+      }
+    }
+    return open( random, out_handle );
+  }
+
+  bool open( std::mt19937& random, Handle& out_handle )
+  {
+    const auto& file = m_files[ random() % m_files.size() ];
+    BFSFile* opened = m_archive.openRead( file.first.c_str() );
+    if( !opened ) return false;
+    out_handle = { opened->getPhysFSInterface(), &file, 0 };
+    return true;
+  }
+
+  /// Give a handle back for any thread to take, or close it if there are enough open
+  void put( const Handle& handle )
+  {
+    {
+      std::lock_guard< std::mutex > lock( m_mutex );
+      if( m_handles.size() < MAX_HANDLES )
+      {
+        m_handles.push_back( handle );
+        return;
+      }
+    }
+    handle.io->destroy( handle.io );
+  }
+
+private:
+  BFSArchive& m_archive;
+  const std::vector< std::pair< std::string, std::string > >& m_files;
+  std::mutex m_mutex;
+  std::vector< Handle > m_handles;
+};
+
+/// One random operation on a handle taken from the pool; @return false if it read or reported anything wrong
+static bool step( HandlePool& pool, std::mt19937& random, std::string& buffer )
+{
+  Handle handle;
+  if( !pool.take( random, handle ) ) return false;
+  const std::string& expected = handle.file->second;
+  bool success = true;
+  switch( random() % 8 )
+  {
+  case 0:
+  {
+    // Duplicates start where the original is
+    PHYSFS_Io* duplicate = handle.io->duplicate( handle.io );
+    success = duplicate && duplicate->tell( duplicate ) == PHYSFS_sint64( handle.position ) && duplicate->length( duplicate ) == PHYSFS_sint64( expected.size() );
+    if( duplicate ) pool.put( { duplicate, handle.file, handle.position } );
+    break;
+  }
+  case 1:
+    handle.io->destroy( handle.io );
+    return true;
+  case 2:
+  case 3:
+    handle.position = random() % ( expected.size() + 1 );
+    success = handle.io->seek( handle.io, handle.position ) != 0;
+    break;
+  default:
+  {
+    const std::size_t size = std::min< std::size_t >( expected.size() - std::size_t( handle.position ), random() % 50000 );
+    buffer.resize( size );
+    success = handle.io->read( handle.io, &buffer[ 0 ], size ) == PHYSFS_sint64( size )
+      && expected.compare( std::size_t( handle.position ), size, buffer ) == 0;
+    handle.position += size;
+    break;
+  }
+  }
+  success = success && handle.io->tell( handle.io ) == PHYSFS_sint64( handle.position );
+  pool.put( handle );
+  return success;
+}
+
+static void checkConcurrently( BFSArchive& archive, const std::vector< std::pair< std::string, std::string > >& files,
+  unsigned int threadCount, unsigned int steps, const char* mode )
+{
+  HandlePool pool( archive, files );
+  std::atomic< unsigned int > failures( 0 );
+  std::vector< std::thread > threads;
+  for( unsigned int i = 0; i < threadCount; ++i )
+  {
+    threads.emplace_back( [ &, i ]()
+    {
+      std::mt19937 random( i );
+      std::string buffer;
+      for( unsigned int j = 0; j < steps; ++j )
+      {
+        if( !step( pool, random, buffer ) ) ++failures;
+      }
+    } );
+  }
+  for( auto& thread : threads ) thread.join();
+  if( !CHECK( failures == 0 ) ) std::fprintf( stderr, "  %u of %u operations failed, %s\n", failures.load(), threadCount * steps, mode );
+}
+
+int main( int argc, char** argv )
+{
+  const unsigned int threadCount = argc > 1 ? std::atoi( argv[ 1 ] ) : 8;
+  const unsigned int steps = argc > 2 ? std::atoi( argv[ 2 ] ) : 4000;
+  const std::map< std::string, std::string > contents = writeTestArchive( ARCHIVE, 60, 21, 600000 );
+  if( !CHECK( !contents.empty() ) ) return checkResult();
+  const std::vector< std::pair< std::string, std::string > > files( contents.begin(), contents.end() );
+  std::ifstream stream( ARCHIVE, std::ios::binary );
+  const std::shared_ptr< const std::string > data = std::make_shared< const std::string >( std::istreambuf_iterator< char >( stream ), std::istreambuf_iterator< char >() );
+  PHYSFS_init( argv[ 0 ] );
+
+  try
+  {
+    BFSArchive::Options options;
+    {
+      BFSArchive archive( *createMemoryIo( data ), ARCHIVE, options );
+      checkConcurrently( archive, files, threadCount, steps, "mapped" );
+    }
+    // Frequent checkpoints for seeks to share, and few streams keeping their state
+    options.useMemoryMap = false;
+    options.checkpointInterval = 64 * 1024;
+    options.streamStateBudget = 1024 * 1024;
+    {
+      BFSArchive archive( *createMemoryIo( data ), ARCHIVE, options );
+      checkConcurrently( archive, files, threadCount, steps, "positional reads" );
+    }
+    // Without a name, the archive is read through the PHYSFS_Io, and nothing is pooled
+    options.inflaterPoolBudget = 0;
+    options.streamStateBudget = 0;
+    {
+      BFSArchive archive( *createMemoryIo( data ), nullptr, options );
+      checkConcurrently( archive, files, threadCount, steps, "locked PHYSFS_Io" );
+    }
+  }
+  catch( PHYSFS_ErrorCode code )
+  {
+    CHECK( code == PHYSFS_ERR_OK );
+  }
+
+  PHYSFS_deinit();
+  std::remove( ARCHIVE );
+  return checkResult();
+}
@@ -0,0 +1,118 @@
+/*
+Keeps 50,000 files of one archive open at once, opened from several threads concurrently, and reads from all of them,
+with the archive memory mapped and read with positional reads. Open files share the archive's file instead of opening their own.
+Usage: handlestest [open files, default 50000]
+*/
+
+#include "testsupport.hpp"
+
+#include <physfs.h>
+#include "bfsarchiver.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#ifdef __linux__
+# include <dirent.h>
+#endif
+
+static const char* const ARCHIVE = "handlestest.bfs";
+static const unsigned int THREAD_COUNT = 4;
+/// Bytes read from each open file
+static const PHYSFS_sint64 READ_SIZE = 3000;
+
+/// @return Open file descriptors of this process, or -1 if unknown
+static int countDescriptors()
+{
+#ifdef __linux__
+  DIR* directory = opendir( "/proc/self/fd" );
+  if( !directory ) return -1;
+  int count = 0;
+  while( readdir( directory ) ) ++count;
+  closedir( directory );
+  return count;
+#else
+  return -1;
+#endif
+}
+
+static void openAll( const std::vector< std::pair< std::string, std::string > >& files, unsigned int handleCount, const char* mode )
+{
+  const int descriptorsBefore = countDescriptors();
+  std::vector< PHYSFS_File* > handles( handleCount, nullptr );
+  std::atomic< unsigned int > failures( 0 );
+  // Open concurrently, each thread every THREAD_COUNT-th file, and leave them all open
+  std::vector< std::thread > threads;
+  for( unsigned int i = 0; i < THREAD_COUNT; ++i )
+  {
+    threads.emplace_back( [ &, i ]()
+    {
+      for( unsigned int j = i; j < handleCount; j += THREAD_COUNT )
+      {
+        if( !( handles[ j ] = PHYSFS_openRead( files[ j % files.size() ].first.c_str() ) ) ) ++failures;
+      }
+    } );
+  }
+  for( auto& thread : threads ) thread.join();
+  threads.clear();
+  if( !CHECK( failures == 0 ) ) std::fprintf( stderr, "  %u of %u files failed to open, %s\n", failures.load(), handleCount, mode );
+  const int descriptorsOpen = countDescriptors();
+  if( descriptorsBefore >= 0 && !CHECK( descriptorsOpen - descriptorsBefore < 16 ) )
+  {
+    std::fprintf( stderr, "  %d file descriptors for %u open files, %s\n", descriptorsOpen - descriptorsBefore, handleCount, mode );
+  }
+
+  // Read the start of every file, while all of them are open
+  for( unsigned int i = 0; i < THREAD_COUNT; ++i )
+  {
+    threads.emplace_back( [ &, i ]()
+    {
+      std::string buffer( READ_SIZE, '\0' );
+      for( unsigned int j = i; j < handleCount; j += THREAD_COUNT )
+      {
+        if( !handles[ j ] ) continue;
+        const std::string& expected = files[ j % files.size() ].second;
+        const PHYSFS_sint64 size = std::min< PHYSFS_sint64 >( READ_SIZE, expected.size() );
+        if( PHYSFS_readBytes( handles[ j ], &buffer[ 0 ], size ) != size || expected.compare( 0, std::size_t( size ), buffer, 0, std::size_t( size ) ) != 0 ) ++failures;
+      }
+    } );
+  }
+  for( auto& thread : threads ) thread.join();
+  if( !CHECK( failures == 0 ) ) std::fprintf( stderr, "  %u of %u reads wrong, %s\n", failures.load(), handleCount, mode );
+
+  for( PHYSFS_File* handle : handles )
+  {
+    if( handle ) PHYSFS_close( handle );
+  }
+}
+
+int main( int argc, char** argv )
+{
+  const unsigned int handleCount = argc > 1 ? std::atoi( argv[ 1 ] ) : 50000;
+  const std::map< std::string, std::string > contents = writeTestArchive( ARCHIVE, 500, 13, 20000 );
+  if( !CHECK( !contents.empty() ) ) return checkResult();
+  const std::vector< std::pair< std::string, std::string > > files( contents.begin(), contents.end() );
+
+  PHYSFS_init( argv[ 0 ] );
+  registerBfsArchiver();
+  // Compressed files that have been read hold their decompression state; this many of them would take gigabytes
+  setBfsStreamStateLimit( 64 << 20, 0 );
+
+  setBfsMemoryMap( 1 );
+  if( CHECK( PHYSFS_mount( ARCHIVE, "/", 1 ) ) )
+  {
+    openAll( files, handleCount, "mapped" );
+    PHYSFS_unmount( ARCHIVE );
+  }
+  setBfsMemoryMap( 0 );
+  if( CHECK( PHYSFS_mount( ARCHIVE, "/", 1 ) ) )
+  {
+    openAll( files, handleCount, "positional reads" );
+    PHYSFS_unmount( ARCHIVE );
+  }
+
+  PHYSFS_deinit();
+  std::remove( ARCHIVE );
+  return checkResult();
+}
@@ -0,0 +1,119 @@
+/*
+Looks files and directories up through the archive's hash table: files are found without decoding every path, nor are
+directories and missing paths; an archive whose hash table doesn't match its contents is indexed instead, and lookups still work.
+*/
+
+#include "testsupport.hpp"
+
+#include <physfs.h>
+#include "bfsarchiver.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <algorithm>
+
+static const char* const ARCHIVE = "hashtabletest.bfs";
+static const char* const MISMATCHED_ARCHIVE = "hashtabletest-mismatched.bfs";
+
+static unsigned int decodedStrings( const char* archive )
+{
+  BFSArchiveStats stats;
+  if( !CHECK( getBfsArchiveStats( archive, &stats ) ) ) return 0;
+  return stats.decodedStringCount;
+}
+
+static unsigned int stringCount( const char* archive )
+{
+  BFSArchiveStats stats;
+  if( !CHECK( getBfsArchiveStats( archive, &stats ) ) ) return 0;
+  return stats.stringCount;
+}
+
+/// Check stat() of all directories of the files, and of paths next to them that don't exist
+static void checkDirectories( const std::map< std::string, std::string >& files )
+{
+  std::set< std::string > directories;
+  for( const auto& file : files )
+  {
+    for( std::size_t slash = file.first.find( '/' ); slash != std::string::npos; slash = file.first.find( '/', slash + 1 ) )
+    {
+      directories.insert( file.first.substr( 0, slash ) );
+    }
+  }
+  PHYSFS_Stat stat;
+  CHECK( PHYSFS_stat( "", &stat ) && stat.filetype == PHYSFS_FILETYPE_DIRECTORY );
+  for( const std::string& directory : directories )
+  {
+    CHECK( PHYSFS_stat( directory.c_str(), &stat ) && stat.filetype == PHYSFS_FILETYPE_DIRECTORY );
+    CHECK( !PHYSFS_stat( ( directory + "x" ).c_str(), &stat ) );
+    CHECK( !PHYSFS_stat( ( directory + "/missing.dds" ).c_str(), &stat ) );
+  }
+}
+
+/// Check stat() of all files, and of a prefix of one
+static void checkFiles( const std::map< std::string, std::string >& files )
+{
+  PHYSFS_Stat stat;
+  for( const auto& file : files )
+  {
+    CHECK( PHYSFS_stat( file.first.c_str(), &stat ) && stat.filetype == PHYSFS_FILETYPE_REGULAR && stat.filesize == PHYSFS_sint64( file.second.size() ) );
+  }
+  const std::string& first = files.begin()->first;
+  CHECK( !PHYSFS_stat( first.substr( 0, first.size() - 1 ).c_str(), &stat ) );
+}
+
+int main( int argc, char** argv )
+{
+  // Many files in few directories, like game archives
+  std::map< std::string, std::string > files;
+  BFSWriter writer;
+  std::mt19937 random( 21 );
+  for( unsigned int i = 0; i < 10000; ++i )
+  {
+    const std::string path = "data" + std::to_string( i % 4 ) + "/textures" + std::to_string( i % 20 ) + "/file" + std::to_string( i ) + ".dds";
+    files[ path ] = makeTestData( random, random() % 100 );
+    writer.add( path, files[ path ], i % 2 );
+  }
+  if( !CHECK( writer.write( ARCHIVE ) ) ) return checkResult();
+
+  // Swap the first two buckets, as if hashed differently
+  std::ifstream stream( ARCHIVE, std::ios::binary );
+  std::string archive( ( std::istreambuf_iterator< char >( stream ) ), std::istreambuf_iterator< char >() );
+  stream.close();
+  const std::size_t HASH_TABLE_OFFSET = 0x14;
+  if( !CHECK( archive.size() > HASH_TABLE_OFFSET + 16 ) ) return checkResult();
+  std::swap_ranges( archive.begin() + HASH_TABLE_OFFSET, archive.begin() + HASH_TABLE_OFFSET + 8, archive.begin() + HASH_TABLE_OFFSET + 8 );
+  std::ofstream( MISMATCHED_ARCHIVE, std::ios::binary ) << archive;
+
+  PHYSFS_init( argv[ 0 ] );
+  registerBfsArchiver();
+  setBfsMountMode( BFS_MOUNT_HASH_TABLE );
+
+  if( CHECK( PHYSFS_mount( ARCHIVE, "/", 1 ) ) )
+  {
+    const unsigned int strings = stringCount( ARCHIVE );
+    // Checking the hash table takes some paths, but far from all
+    const unsigned int mountStrings = decodedStrings( ARCHIVE );
+    CHECK( mountStrings < strings / 2 );
+    // Directories and misses take the 20 directory strings, and the odd name of the same length as a miss
+    checkDirectories( files );
+    CHECK( decodedStrings( ARCHIVE ) < mountStrings + 100 );
+    checkFiles( files );
+    PHYSFS_unmount( ARCHIVE );
+  }
+
+  if( CHECK( PHYSFS_mount( MISMATCHED_ARCHIVE, "/", 1 ) ) )
+  {
+    CHECK( decodedStrings( MISMATCHED_ARCHIVE ) == stringCount( MISMATCHED_ARCHIVE ) );
+    checkDirectories( files );
+    checkFiles( files );
+    PHYSFS_unmount( MISMATCHED_ARCHIVE );
+  }
+
+  PHYSFS_deinit();
+  std::remove( ARCHIVE );
+  std::remove( MISMATCHED_ARCHIVE );
+  return checkResult();
+}
@@ -0,0 +1,127 @@
+/*
+Counts the reads mounting takes through a PHYSFS_Io: all of an archive's metadata comes in at most two reads, one if it fits
+the first, and none of the file data is read beyond what the first read takes along. Archives cut short within their metadata fail to mount.
+*/
+
+#include "testsupport.hpp"
+
+#include <physfs.h>
+#include "bfsarchiver.h"
+#include "bfsformat.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+static const char* const ARCHIVE = "metadatatest.bfs";
+/// No file by this name, so mounting reads through the PHYSFS_Io alone
+static const char* const MEMORY_ARCHIVE = "metadatatest-memory.bfs";
+/// What mounting reads first, in the hope that it covers all of the metadata
+static const std::uint64_t FIRST_READ_SIZE = 256 * 1024;
+
+/// Write an archive of fileCount files with long paths, each fileSize bytes; @return its contents
+static std::string writeArchive( std::size_t fileCount, std::size_t fileSize, std::map< std::string, std::string >& out_files )
+{
+  std::mt19937 random( static_cast< unsigned int >( fileCount ) );
+  BFSWriter writer;
+  out_files.clear();
+  for( std::size_t i = 0; i < fileCount; ++i )
+  {
+    const std::string path = "data/cars/car_" + std::to_string( i % 50 ) + "/textures/skin_" + std::to_string( i ) + "_diffuse.dds";
+    out_files[ path ] = makeTestData( random, fileSize );
+    writer.add( path, out_files[ path ], i % 3 == 0 ? 0 : 6 );
+  }
+  if( !CHECK( writer.write( ARCHIVE ) ) ) return std::string();
+  std::ifstream stream( ARCHIVE, std::ios::binary );
+  return std::string( std::istreambuf_iterator< char >( stream ), std::istreambuf_iterator< char >() );
+}
+
+/// Size of the header, hash table, string pool and file infos, the part of the archive before the file data
+static std::uint64_t metadataSize( const std::string& archive )
+{
+  BFSHeader header;
+  BFSStringPoolHeader stringPool;
+  if( !CHECK( archive.size() >= BFSHeader::HEADER_SIZE + sizeof( stringPool ) ) ) return archive.size();
+  std::memcpy( &header, archive.data(), sizeof( header ) );
+  std::memcpy( &stringPool, archive.data() + BFSHeader::HEADER_SIZE, sizeof( stringPool ) );
+  return BFSHeader::HEADER_SIZE + std::uint64_t( stringPool.end ) + std::uint64_t( header.fileCount ) * sizeof( BFSFileInfo );
+}
+
+/**
+@brief Mount the archive from memory and check the reads it took.
+@param counts Counts reads of the mounted archive from then on, so must outlive its mount
+@return whether it mounted
+**/
+static bool mountCounted( const std::string& archive, IoCounts& counts, unsigned int maxReads, std::uint64_t maxBytes, const char* what )
+{
+  counts.reads = 0;
+  counts.seeks = 0;
+  counts.bytesRead = 0;
+  PHYSFS_Io* io = createMemoryIo( std::make_shared< const std::string >( archive ), &counts );
+  const int mounted = PHYSFS_mountIo( io, MEMORY_ARCHIVE, "/", 1 );
+  if( !CHECK( counts.reads <= maxReads && counts.bytesRead <= maxBytes ) )
+  {
+    std::fprintf( stderr, "  %s: %u reads, %u seeks, %llu of %zu bytes\n", what, counts.reads.load(), counts.seeks.load(),
+      static_cast< unsigned long long >( counts.bytesRead ), archive.size() );
+  }
+  // The Io is still ours if mounting failed
+  if( !mounted ) io->destroy( io );
+  return mounted != 0;
+}
+
+static void checkFiles( const std::map< std::string, std::string >& files )
+{
+  std::string contents;
+  for( const auto& file : files )
+  {
+    PHYSFS_File* handle = PHYSFS_openRead( file.first.c_str() );
+    if( !CHECK( handle ) ) continue;
+    contents.assign( file.second.size(), '\0' );
+    CHECK( PHYSFS_readBytes( handle, &contents[ 0 ], contents.size() ) == PHYSFS_sint64( contents.size() ) && contents == file.second );
+    PHYSFS_close( handle );
+  }
+}
+
+/// Mount the archive in each mode, check the reads that took and the files, then mount parts of it cut within the metadata
+static void checkArchive( const std::string& archive, const std::map< std::string, std::string >& files, unsigned int maxReads )
+{
+  const std::uint64_t metadata = metadataSize( archive );
+  // The first read takes a guess at the size of the metadata, which may take some file data along
+  const std::uint64_t maxBytes = std::max< std::uint64_t >( metadata, FIRST_READ_SIZE );
+  IoCounts counts;
+  const std::pair< BFSMountMode, const char* > modes[] = { { BFS_MOUNT_INDEX, "index" }, { BFS_MOUNT_HASH_TABLE, "hash table" } };
+  for( const auto& mode : modes )
+  {
+    setBfsMountMode( mode.first );
+    if( CHECK( mountCounted( archive, counts, maxReads, maxBytes, mode.second ) ) )
+    {
+      checkFiles( files );
+      PHYSFS_unmount( MEMORY_ARCHIVE );
+    }
+  }
+  setBfsMountMode( BFS_MOUNT_INDEX );
+  for( std::uint64_t size : { std::uint64_t( 10 ), metadata / 2, metadata - 1 } )
+  {
+    if( !CHECK( !mountCounted( archive.substr( 0, std::size_t( size ) ), counts, 2, maxBytes, "cut short" ) ) ) PHYSFS_unmount( MEMORY_ARCHIVE );
+  }
+}
+
+int main( int argc, char** argv )
+{
+  PHYSFS_init( argv[ 0 ] );
+  registerBfsArchiver();
+
+  // Metadata that fits the first read, and metadata too large for it that takes a second one
+  std::map< std::string, std::string > files;
+  const std::string small = writeArchive( 100, 2000, files );
+  CHECK( metadataSize( small ) < FIRST_READ_SIZE );
+  checkArchive( small, files, 1 );
+  const std::string large = writeArchive( 20000, 200, files );
+  CHECK( metadataSize( large ) > FIRST_READ_SIZE );
+  checkArchive( large, files, 2 );
+
+  PHYSFS_deinit();
+  std::remove( ARCHIVE );
+  return checkResult();
+}
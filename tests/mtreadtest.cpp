@@ -0,0 +1,103 @@
+/*
+Reads files of one archive from many threads at once and checks their contents, for each way the archive is read:
+through the memory mapping, with positional reads of the archive file, and through the locked PHYSFS_Io of an archive mounted from memory.
+Usage: mtreadtest [threads, default 8] [files read per thread, default 300]
+*/
+
+#include "testsupport.hpp"
+
+#include <physfs.h>
+#include "bfsarchiver.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+static const char* const ARCHIVE = "mtreadtest.bfs";
+
+/// Read the whole file in random pieces, now and then seeking back to read part of it again
+static bool readFile( const std::string& path, std::mt19937& random, std::string& out )
+{
+  PHYSFS_File* file = PHYSFS_openRead( path.c_str() );
+  if( !file ) return false;
+  const PHYSFS_sint64 length = PHYSFS_fileLength( file );
+  out.assign( std::size_t( std::max< PHYSFS_sint64 >( length, 0 ) ), '\0' );
+  bool success = length >= 0;
+  PHYSFS_sint64 position = 0;
+  while( success && position < length )
+  {
+    const PHYSFS_sint64 size = std::min< PHYSFS_sint64 >( length - position, 1 + random() % 70000 );
+    success = PHYSFS_readBytes( file, &out[ std::size_t( position ) ], size ) == size;
+    position += size;
+    if( success && random() % 8 == 0 )
+    {
+      position = random() % position;
+      success = PHYSFS_seek( file, position ) != 0;
+    }
+  }
+  PHYSFS_close( file );
+  return success;
+}
+
+static void readConcurrently( const std::vector< std::pair< std::string, std::uint64_t > >& expected, unsigned int threadCount, unsigned int reads, const char* mode )
+{
+  std::atomic< unsigned int > failures( 0 );
+  std::vector< std::thread > threads;
+  for( unsigned int i = 0; i < threadCount; ++i )
+  {
+    threads.emplace_back( [ &, i ]()
+    {
+      std::mt19937 random( i );
+      std::string contents;
+      for( unsigned int j = 0; j < reads; ++j )
+      {
+        const auto& file = expected[ random() % expected.size() ];
+        if( !readFile( file.first, random, contents ) || checksum( contents ) != file.second ) ++failures;
+      }
+    } );
+  }
+  for( auto& thread : threads ) thread.join();
+  if( !CHECK( failures == 0 ) ) std::fprintf( stderr, "  %u of %u reads wrong, %s\n", failures.load(), threadCount * reads, mode );
+}
+
+int main( int argc, char** argv )
+{
+  const unsigned int threadCount = argc > 1 ? std::atoi( argv[ 1 ] ) : 8;
+  const unsigned int reads = argc > 2 ? std::atoi( argv[ 2 ] ) : 300;
+  const std::map< std::string, std::string > files = writeTestArchive( ARCHIVE, 300, 14, 200000 );
+  if( !CHECK( !files.empty() ) ) return checkResult();
+  std::vector< std::pair< std::string, std::uint64_t > > expected;
+  for( const auto& file : files ) expected.push_back( { file.first, checksum( file.second ) } );
+
+  PHYSFS_init( argv[ 0 ] );
+  registerBfsArchiver();
+
+  setBfsMemoryMap( 1 );
+  if( CHECK( PHYSFS_mount( ARCHIVE, "/", 1 ) ) )
+  {
+    readConcurrently( expected, threadCount, reads, "mapped" );
+    PHYSFS_unmount( ARCHIVE );
+  }
+
+  setBfsMemoryMap( 0 );
+  if( CHECK( PHYSFS_mount( ARCHIVE, "/", 1 ) ) )
+  {
+    readConcurrently( expected, threadCount, reads, "positional reads" );
+    PHYSFS_unmount( ARCHIVE );
+  }
+
+  // No file by this name, so all reads go through the PHYSFS_Io
+  std::ifstream stream( ARCHIVE, std::ios::binary );
+  std::shared_ptr< const std::string > data = std::make_shared< const std::string >( std::istreambuf_iterator< char >( stream ), std::istreambuf_iterator< char >() );
+  if( CHECK( PHYSFS_mountIo( createMemoryIo( data ), "mtreadtest-memory.bfs", "/", 1 ) ) )
+  {
+    readConcurrently( expected, threadCount, reads, "locked PHYSFS_Io" );
+    PHYSFS_unmount( "mtreadtest-memory.bfs" );
+  }
+
+  PHYSFS_deinit();
+  std::remove( ARCHIVE );
+  return checkResult();
+}
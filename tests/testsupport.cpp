@@ -0,0 +1,456 @@
+#include "testsupport.hpp"
+
+#include <zlib.h>
+
+#include <cstdio>
+#include <cstring>
+#include <atomic>
+#include <queue>
+#include <functional>
+
+static std::atomic< unsigned int > s_failures( 0 );
+
+bool checkCondition( bool condition, const char* text, const char* file, int line )
+{
+  if( !condition )
+  {
+    // Don't drown the interesting first failures in thousands of follow-ups
+    if( s_failures++ < 20 ) std::fprintf( stderr, "%s:%d: check failed: %s\n", file, line, text );
+  }
+  return condition;
+}
+
+int checkResult()
+{
+  const unsigned int failures = s_failures;
+  if( failures == 0 )
+  {
+    std::puts( "all checks passed" );
+    return 0;
+  }
+  std::printf( "%u checks failed\n", failures );
+  return 1;
+}
+
+std::string makeTestData( std::mt19937& random, std::size_t size )
+{
+  static const char ALPHABET[] = "abcdefghij \n";
+  std::string base( std::min< std::size_t >( size, 4096 ), '\0' );
+  for( char& c : base ) c = ALPHABET[ random() % ( sizeof( ALPHABET ) - 1 ) ];
+  std::string data;
+  data.reserve( size );
+  while( data.size() < size )
+  {
+    if( random() % 2 )
+    {
+      data.append( base, 0, 1 + random() % base.size() );
+    }
+    else
+    {
+      for( std::size_t count = 1 + random() % 64; count > 0; --count ) data.push_back( char( random() ) );
+    }
+  }
+  data.resize( size );
+  return data;
+}
+
+std::string deflateZlib( const std::string& data, int level, DeflateStrategy strategy, DeflateFlush flush, std::size_t flushInterval )
+{
+  static const int STRATEGIES[ STRATEGY_COUNT ] = { Z_DEFAULT_STRATEGY, Z_FILTERED, Z_HUFFMAN_ONLY, Z_RLE, Z_FIXED };
+  static const int FLUSHES[ FLUSH_COUNT ] = { Z_NO_FLUSH, Z_PARTIAL_FLUSH, Z_SYNC_FLUSH, Z_FULL_FLUSH, Z_BLOCK };
+  z_stream stream;
+  std::memset( &stream, 0, sizeof( stream ) );
+  if( deflateInit2( &stream, level, Z_DEFLATED, 15, 8, STRATEGIES[ strategy ] ) != Z_OK ) return std::string();
+  if( flushInterval == 0 ) flushInterval = data.size();
+  std::string result;
+  std::size_t pos = 0;
+  int status = Z_OK;
+  do
+  {
+    const std::size_t chunk = std::min( flushInterval, data.size() - pos );
+    stream.next_in = reinterpret_cast< Bytef* >( const_cast< char* >( data.data() + pos ) );
+    stream.avail_in = uInt( chunk );
+    pos += chunk;
+    const int mode = pos == data.size() ? Z_FINISH : FLUSHES[ flush ];
+    do
+    {
+      char buffer[ 16 * 1024 ];
+      stream.next_out = reinterpret_cast< Bytef* >( buffer );
+      stream.avail_out = sizeof( buffer );
+      status = deflate( &stream, mode );
+      result.append( buffer, sizeof( buffer ) - stream.avail_out );
+    }
+    while( stream.avail_out == 0 || ( mode == Z_FINISH && status == Z_OK ) );
+  }
+  while( pos < data.size() );
+  deflateEnd( &stream );
+  return status == Z_STREAM_END ? result : std::string();
+}
+
+bool uncompressZlib( const std::string& in, std::string& out )
+{
+  // uncompress() wants room for at least one byte
+  std::vector< Bytef > buffer( out.size() + 1 );
+  uLongf size = uLongf( buffer.size() );
+  if( uncompress( buffer.data(), &size, reinterpret_cast< const Bytef* >( in.data() ), uLong( in.size() ) ) != Z_OK || size != out.size() ) return false;
+  out.assign( buffer.begin(), buffer.begin() + size );
+  return true;
+}
+
+namespace
+{
+  enum : std::uint32_t
+  {
+    HASH_SIZE = 0x3e5,
+    HEADER_SIZE = 0x14 + HASH_SIZE * 8,
+    FILE_INFO_SIZE = 24,
+    COMPRESSION_STORED = 4,
+    COMPRESSION_ZLIB = 5,
+  };
+
+  /// Bucket of a path, as in the header's hash table
+  std::uint32_t bucket( const std::string& path )
+  {
+    std::uint32_t hash = 0;
+    for( unsigned char c : path )
+    {
+      if( c >= 'A' && c <= 'Z' ) c += 'a' - 'A';
+      hash = hash * 31 + c;
+    }
+    return hash % HASH_SIZE;
+  }
+
+  void append32( std::string& out, std::uint32_t value )
+  {
+    for( int i = 0; i < 4; ++i ) out.push_back( char( value >> ( 8 * i ) ) );
+  }
+
+  void append16( std::string& out, std::uint16_t value )
+  {
+    out.push_back( char( value ) );
+    out.push_back( char( value >> 8 ) );
+  }
+
+  void pad( std::string& out )
+  {
+    while( out.size() % 4 ) out.push_back( '\0' );
+  }
+
+  void put32( std::string& out, std::size_t pos, std::uint32_t value )
+  {
+    for( int i = 0; i < 4; ++i ) out[ pos + i ] = char( value >> ( 8 * i ) );
+  }
+
+  struct HuffmanNode
+  {
+    std::uint64_t weight;
+    int child0;
+    int child1;
+    unsigned char symbol;
+  };
+
+  /// Serialize the tree below node the way the archive's decoder reads it: symbol and flags, then the 1 child before the 0 child
+  void serializeTree( const std::vector< HuffmanNode >& nodes, int node, std::vector< bool >& code, std::vector< std::vector< bool > >& codes, std::string& out )
+  {
+    const HuffmanNode& current = nodes[ node ];
+    if( current.child0 < 0 )
+    {
+      out.push_back( char( current.symbol ) );
+      out.push_back( char( 0x80 ) );
+      codes[ current.symbol ] = code;
+      return;
+    }
+    out.push_back( '\0' );
+    out.push_back( '\0' );
+    code.push_back( true );
+    serializeTree( nodes, current.child1, code, codes, out );
+    code.back() = false;
+    serializeTree( nodes, current.child0, code, codes, out );
+    code.pop_back();
+  }
+
+  /// Huffman code all strings into a string pool block
+  std::string makeStringPool( const std::vector< std::string >& strings )
+  {
+    std::uint64_t frequencies[ 256 ] = {};
+    for( const std::string& string : strings )
+    {
+      for( unsigned char c : string ) ++frequencies[ c ];
+    }
+    std::vector< HuffmanNode > nodes;
+    typedef std::pair< std::uint64_t, int > Weighted;
+    std::priority_queue< Weighted, std::vector< Weighted >, std::greater< Weighted > > queue;
+    for( int symbol = 0; symbol < 256; ++symbol )
+    {
+      if( frequencies[ symbol ] == 0 ) continue;
+      queue.push( Weighted( frequencies[ symbol ], int( nodes.size() ) ) );
+      nodes.push_back( { frequencies[ symbol ], -1, -1, static_cast< unsigned char >( symbol ) } );
+    }
+    // A lone symbol still needs a bit per character
+    if( queue.size() == 1 )
+    {
+      queue.push( Weighted( 0, int( nodes.size() ) ) );
+      nodes.push_back( { 0, -1, -1, static_cast< unsigned char >( nodes[ 0 ].symbol + 1 ) } );
+    }
+    while( queue.size() > 1 )
+    {
+      const Weighted first = queue.top();
+      queue.pop();
+      const Weighted second = queue.top();
+      queue.pop();
+      queue.push( Weighted( first.first + second.first, int( nodes.size() ) ) );
+      nodes.push_back( { first.first + second.first, first.second, second.second, 0 } );
+    }
+
+    std::string tree;
+    std::vector< bool > code;
+    std::vector< std::vector< bool > > codes( 256 );
+    if( !nodes.empty() ) serializeTree( nodes, queue.top().second, code, codes, tree );
+
+    std::string packed;
+    std::vector< std::uint32_t > offsets;
+    for( const std::string& string : strings )
+    {
+      offsets.push_back( std::uint32_t( packed.size() ) );
+      unsigned int bitCount = 0;
+      unsigned char current = 0;
+      for( unsigned char c : string )
+      {
+        for( bool bit : codes[ c ] )
+        {
+          if( bit ) current |= 1 << bitCount;
+          if( ++bitCount == 8 )
+          {
+            packed.push_back( char( current ) );
+            current = 0;
+            bitCount = 0;
+          }
+        }
+      }
+      if( bitCount > 0 ) packed.push_back( char( current ) );
+    }
+
+    // Header, tree, sizes, offsets and strings, each 4 byte aligned
+    std::string pool( 20, '\0' );
+    const std::uint32_t treeOffset = std::uint32_t( pool.size() );
+    pool += tree;
+    pad( pool );
+    const std::uint32_t sizesOffset = std::uint32_t( pool.size() );
+    for( const std::string& string : strings ) append16( pool, std::uint16_t( string.size() ) );
+    pad( pool );
+    const std::uint32_t offsetsOffset = std::uint32_t( pool.size() );
+    for( std::uint32_t offset : offsets ) append32( pool, offset );
+    const std::uint32_t stringsOffset = std::uint32_t( pool.size() );
+    pool += packed;
+    pad( pool );
+    put32( pool, 0, std::uint32_t( pool.size() ) );
+    put32( pool, 4, offsetsOffset );
+    put32( pool, 8, sizesOffset );
+    put32( pool, 12, treeOffset );
+    put32( pool, 16, stringsOffset );
+    return pool;
+  }
+}
+
+void BFSWriter::add( const std::string& path, const std::string& data, int level )
+{
+  m_files.push_back( { path, data, level } );
+}
+
+bool BFSWriter::write( const std::string& filename ) const
+{
+  // Strings are numbered in order of first use by the paths in order
+  std::vector< File > files( m_files );
+  std::sort( files.begin(), files.end(), []( const File& lhs, const File& rhs ) { return lhs.path < rhs.path; } );
+  std::vector< std::string > strings;
+  std::map< std::string, std::uint16_t > stringIndices;
+  auto stringIndex = [ &strings, &stringIndices ]( const std::string& string )
+  {
+    auto it = stringIndices.find( string );
+    if( it != stringIndices.end() ) return it->second;
+    strings.push_back( string );
+    return stringIndices[ string ] = std::uint16_t( strings.size() - 1 );
+  };
+  struct Info
+  {
+    const File* file;
+    std::uint32_t bucket;
+    std::uint16_t dirIndex;
+    std::uint16_t fileIndex;
+  };
+  std::vector< Info > infos;
+  for( const File& file : files )
+  {
+    const std::size_t slash = file.path.rfind( '/' );
+    const std::uint16_t dirIndex = stringIndex( slash == std::string::npos ? std::string() : file.path.substr( 0, slash ) );
+    const std::uint16_t fileIndex = stringIndex( slash == std::string::npos ? file.path : file.path.substr( slash + 1 ) );
+    infos.push_back( { &file, bucket( file.path ), dirIndex, fileIndex } );
+  }
+  std::stable_sort( infos.begin(), infos.end(), []( const Info& lhs, const Info& rhs ) { return lhs.bucket < rhs.bucket; } );
+
+  const std::string pool = makeStringPool( strings );
+  const std::uint32_t dataOffset = std::uint32_t( HEADER_SIZE + pool.size() + infos.size() * FILE_INFO_SIZE );
+  std::string header( "bfs1" );
+  append32( header, 0x20070310 );
+  append32( header, dataOffset );
+  append32( header, std::uint32_t( infos.size() ) );
+  append32( header, HASH_SIZE );
+  std::vector< std::pair< std::uint32_t, std::uint32_t > > table( HASH_SIZE );
+  for( std::size_t i = 0; i < infos.size(); ++i )
+  {
+    auto& entry = table[ infos[ i ].bucket ];
+    if( entry.second++ == 0 ) entry.first = std::uint32_t( i );
+  }
+  for( const auto& entry : table )
+  {
+    append32( header, entry.first );
+    append32( header, entry.second );
+  }
+
+  std::string infoTable;
+  std::string data;
+  for( const Info& info : infos )
+  {
+    const File& file = *info.file;
+    const bool compressed = file.level > 0 && !file.data.empty();
+    const std::string stored = compressed ? deflateZlib( file.data, file.level, STRATEGY_DEFAULT ) : file.data;
+    append32( infoTable, compressed ? COMPRESSION_ZLIB : COMPRESSION_STORED );
+    append32( infoTable, std::uint32_t( dataOffset + data.size() ) );
+    append32( infoTable, std::uint32_t( file.data.size() ) );
+    append32( infoTable, std::uint32_t( stored.size() ) );
+    append32( infoTable, 0 );
+    append16( infoTable, info.dirIndex );
+    append16( infoTable, info.fileIndex );
+    data += stored;
+  }
+
+  std::FILE* out = std::fopen( filename.c_str(), "wb" );
+  if( !out ) return false;
+  bool written = true;
+  const std::string* const parts[] = { &header, &pool, &infoTable, &data };
+  for( const std::string* part : parts )
+  {
+    if( !part->empty() && std::fwrite( part->data(), part->size(), 1, out ) != 1 ) written = false;
+  }
+  return std::fclose( out ) == 0 && written;
+}
+
+std::map< std::string, std::string > writeTestArchive( const std::string& filename, std::size_t fileCount, std::uint32_t seed, std::size_t maxFileSize )
+{
+  static const char* const WORDS[] = { "data", "cars", "car", "tracks", "menu", "sound", "shader", "textures", "common", "lights", "fx", "level", "forest", "city", "arena" };
+  static const char* const EXTENSIONS[] = { ".dds", ".ini", ".bgm", ".wav", ".txt" };
+  const std::size_t wordCount = sizeof( WORDS ) / sizeof( WORDS[ 0 ] );
+  std::mt19937 random( seed );
+  std::map< std::string, std::string > files;
+  BFSWriter writer;
+  while( files.size() < fileCount )
+  {
+    std::string path;
+    for( unsigned int depth = 1 + random() % 4; depth > 0; --depth )
+    {
+      path += WORDS[ random() % wordCount ];
+      if( random() % 3 == 0 ) path += char( '0' + random() % 6 );
+      path += '/';
+    }
+    path += WORDS[ random() % wordCount ] + std::to_string( random() % 100000 ) + EXTENSIONS[ random() % 5 ];
+    if( files.count( path ) ) continue;
+    const std::string data = makeTestData( random, random() % ( maxFileSize + 1 ) );
+    writer.add( path, data, random() % 5 == 0 ? 0 : 1 + random() % 9 );
+    files[ path ] = data;
+  }
+  if( !writer.write( filename ) ) files.clear();
+  return files;
+}
+
+std::uint64_t checksum( const char* data, std::size_t size )
+{
+  std::uint64_t hash = 14695981039346656037ull;
+  for( std::size_t i = 0; i < size; ++i )
+  {
+    hash ^= static_cast< unsigned char >( data[ i ] );
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+namespace
+{
+  struct MemoryIo
+  {
+    std::shared_ptr< const std::string > data;
+    IoCounts* counts;
+    std::uint64_t position;
+  };
+
+  PHYSFS_sint64 memoryRead( PHYSFS_Io* io, void* buf, PHYSFS_uint64 len )
+  {
+    MemoryIo& memory = *static_cast< MemoryIo* >( io->opaque );
+    const std::uint64_t size = memory.data->size();
+    const std::uint64_t bytesRead = memory.position < size ? std::min( size - memory.position, len ) : 0;
+    std::memcpy( buf, memory.data->data() + memory.position, std::size_t( bytesRead ) );
+    memory.position += bytesRead;
+    if( memory.counts )
+    {
+      ++memory.counts->reads;
+      memory.counts->bytesRead += bytesRead;
+    }
+    return PHYSFS_sint64( bytesRead );
+  }
+
+  PHYSFS_sint64 memoryWrite( PHYSFS_Io*, const void*, PHYSFS_uint64 )
+  {
+    return -1;
+  }
+
+  int memorySeek( PHYSFS_Io* io, PHYSFS_uint64 offset )
+  {
+    MemoryIo& memory = *static_cast< MemoryIo* >( io->opaque );
+    if( memory.counts ) ++memory.counts->seeks;
+    if( offset > memory.data->size() ) return 0;
+    memory.position = offset;
+    return 1;
+  }
+
+  PHYSFS_sint64 memoryTell( PHYSFS_Io* io )
+  {
+    return PHYSFS_sint64( static_cast< MemoryIo* >( io->opaque )->position );
+  }
+
+  PHYSFS_sint64 memoryLength( PHYSFS_Io* io )
+  {
+    return PHYSFS_sint64( static_cast< MemoryIo* >( io->opaque )->data->size() );
+  }
+
+  PHYSFS_Io* memoryDuplicate( PHYSFS_Io* io )
+  {
+    const MemoryIo& memory = *static_cast< MemoryIo* >( io->opaque );
+    return createMemoryIo( memory.data, memory.counts );
+  }
+
+  int memoryFlush( PHYSFS_Io* )
+  {
+    return 1;
+  }
+
+  void memoryDestroy( PHYSFS_Io* io )
+  {
+    delete static_cast< MemoryIo* >( io->opaque );
+    delete io;
+  }
+}
+
+PHYSFS_Io* createMemoryIo( std::shared_ptr< const std::string > data, IoCounts* counts )
+{
+  PHYSFS_Io* io = new PHYSFS_Io;
+  io->version = 0;
+  io->opaque = new MemoryIo{ std::move( data ), counts, 0 };
+  io->read = memoryRead;
+  io->write = memoryWrite;
+  io->seek = memorySeek;
+  io->tell = memoryTell;
+  io->length = memoryLength;
+  io->duplicate = memoryDuplicate;
+  io->flush = memoryFlush;
+  io->destroy = memoryDestroy;
+  return io;
+}
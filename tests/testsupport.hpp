@@ -0,0 +1,128 @@
+#pragma once
+
+#include <physfs.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+/**
+@file
+@brief Shared by the tests and benchmarks: checks, generated data, zlib for reference, and writing BFS archives to test against.
+**/
+
+/// Report the condition if it doesn't hold and carry on, so one run shows every failure. Thread-safe.
+#define CHECK( condition ) checkCondition( ( condition ), #condition, __FILE__, __LINE__ )
+
+/// @return condition
+bool checkCondition( bool condition, const char* text, const char* file, int line );
+/// Print the outcome of all checks; @return exit code for main(), 0 if they all passed
+int checkResult();
+
+/// Data that compresses about as well as game assets do: runs of text mixed with random bytes
+std::string makeTestData( std::mt19937& random, std::size_t size );
+
+enum DeflateStrategy
+{
+  STRATEGY_DEFAULT,
+  STRATEGY_FILTERED,
+  STRATEGY_HUFFMAN_ONLY,
+  STRATEGY_RLE,
+  STRATEGY_FIXED,
+  STRATEGY_COUNT
+};
+
+enum DeflateFlush
+{
+  FLUSH_NONE,
+  FLUSH_PARTIAL,
+  FLUSH_SYNC,
+  FLUSH_FULL,
+  FLUSH_BLOCK,
+  FLUSH_COUNT
+};
+
+/**
+@brief Compress data into a zlib stream with zlib itself.
+@param flushInterval Flush after every this many input bytes, 0 for only at the end
+**/
+std::string deflateZlib( const std::string& data, int level, DeflateStrategy strategy, DeflateFlush flush = FLUSH_NONE, std::size_t flushInterval = 0 );
+/**
+@brief Decompress a zlib stream with zlib's uncompress(), the reference to compare against.
+@param out Resized to the expected size beforehand
+@return Whether it decompressed to exactly out.size() bytes
+**/
+bool uncompressZlib( const std::string& in, std::string& out );
+
+/**
+@brief Writes BFS archives the way FlatOut 2's tools lay them out: header with hash table, Huffman coded string pool, file infos by bucket, then the data.
+**/
+class BFSWriter
+{
+public:
+  /**
+  @param path "dir/file", unique within the archive
+  @param level zlib compression level from 1 to 9, 0 to store the file uncompressed
+  **/
+  void add( const std::string& path, const std::string& data, int level );
+  /// @return false if the file could not be written
+  bool write( const std::string& filename ) const;
+
+private:
+  struct File
+  {
+    std::string path;
+    std::string data;
+    int level;
+  };
+
+private:
+  std::vector< File > m_files;
+};
+
+/**
+@brief Write an archive of fileCount files with random paths and contents, 4 in 5 of them compressed.
+@param maxFileSize Files are between 0 and this many bytes large
+@return Contents by path
+**/
+std::map< std::string, std::string > writeTestArchive( const std::string& filename, std::size_t fileCount, std::uint32_t seed, std::size_t maxFileSize );
+
+/// FNV-1a hash of data, to compare file contents by
+std::uint64_t checksum( const char* data, std::size_t size );
+inline std::uint64_t checksum( const std::string& data ) { return checksum( data.data(), data.size() ); }
+
+/// Calls made to the PHYSFS_Io of createMemoryIo() and its duplicates
+struct IoCounts
+{
+  std::atomic< unsigned int > reads{ 0 };
+  std::atomic< unsigned int > seeks{ 0 };
+  std::atomic< std::uint64_t > bytesRead{ 0 };
+};
+
+/**
+@brief A PHYSFS_Io reading from memory, for mounting archives through PHYSFS_mountIo() that aren't files of their own.
+@param counts If not null, counts calls; must outlive the Io
+**/
+PHYSFS_Io* createMemoryIo( std::shared_ptr< const std::string > data, IoCounts* counts = nullptr );
+
+/// @return Fastest of several runs of f, in seconds
+template< typename Function >
+double bestOf( int runs, Function f )
+{
+  double best = 0;
+  for( int i = 0; i < runs; ++i )
+  {
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    const double seconds = std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+    best = i == 0 ? seconds : std::min( best, seconds );
+  }
+  return best;
+}
@@ -0,0 +1,190 @@
+/*
+Checks the bundled tinfl decoder against zlib: every stream zlib produces must decompress to exactly what zlib's uncompress() gives,
+whatever the flush mode, output buffer and chunking, and corrupt streams must fail the same way they do with zlib.
+*/
+
+#include "testsupport.hpp"
+
+#include <physfs.h>
+#include "physfs_miniz.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+/// Decompress in one call into a buffer of outCapacity bytes; @return false unless the stream is complete and valid
+static bool decodeWhole( const std::string& in, std::size_t outCapacity, std::string& out )
+{
+  std::unique_ptr< tinfl_decompressor > decompressor( new tinfl_decompressor );
+  tinfl_init( decompressor.get() );
+  std::vector< mz_uint8 > buffer( outCapacity + 1 );
+  std::size_t inSize = in.size();
+  std::size_t outSize = outCapacity;
+  const tinfl_status status = tinfl_decompress( decompressor.get(), reinterpret_cast< const mz_uint8* >( in.data() ), &inSize, buffer.data(), buffer.data(), &outSize,
+    TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF | TINFL_FLAG_COMPUTE_ADLER32 );
+  out.assign( buffer.begin(), buffer.begin() + outSize );
+  return status == TINFL_STATUS_DONE;
+}
+
+static void* allocate( void*, unsigned int items, unsigned int size )
+{
+  return std::malloc( std::size_t( items ) * size );
+}
+
+static void release( void*, void* address )
+{
+  std::free( address );
+}
+
+/**
+@brief Decompress the way streaming reads do, through mz_inflate() and its 32 KB dictionary, in pieces.
+@param inChunk Input is handed over this many bytes at a time
+@param outChunk Output is taken at most this many bytes at a time
+@param maxSize Give up once the output grows beyond this, as corrupt streams may go on for long
+**/
+static bool decodeStreaming( const std::string& in, std::size_t inChunk, std::size_t outChunk, std::size_t maxSize, std::string& out )
+{
+  mz_stream stream;
+  std::memset( &stream, 0, sizeof( stream ) );
+  stream.zalloc = allocate;
+  stream.zfree = release;
+  if( mz_inflateInit2( &stream, MZ_DEFAULT_WINDOW_BITS ) != MZ_OK ) return false;
+  std::vector< unsigned char > buffer( outChunk );
+  std::size_t inPos = 0;
+  int result;
+  out.clear();
+  do
+  {
+    if( stream.avail_in == 0 )
+    {
+      stream.next_in = reinterpret_cast< const unsigned char* >( in.data() ) + inPos;
+      stream.avail_in = unsigned( std::min( inChunk, in.size() - inPos ) );
+      inPos += stream.avail_in;
+    }
+    stream.next_out = buffer.data();
+    stream.avail_out = unsigned( buffer.size() );
+    result = mz_inflate( &stream, MZ_SYNC_FLUSH );
+    out.append( reinterpret_cast< const char* >( buffer.data() ), buffer.size() - stream.avail_out );
+  }
+  // Without input left, there is nothing that could make further progress
+  while( ( result == MZ_OK || ( result == MZ_BUF_ERROR && inPos < in.size() ) ) && out.size() <= maxSize );
+  mz_inflateEnd( &stream );
+  return result == MZ_STREAM_END && out.size() <= maxSize;
+}
+
+/// Decompress with tinfl in all ways and check each agrees with zlib on whether the stream is valid and of the expected size, and what it contains
+static void compare( const std::string& compressed, const std::string& expected, const char* what )
+{
+  std::string reference( expected.size(), '\0' );
+  const bool valid = uncompressZlib( compressed, reference );
+
+  std::string out;
+  const std::size_t capacities[] = { expected.size(), expected.size() + 100 };
+  for( std::size_t capacity : capacities )
+  {
+    const bool decoded = decodeWhole( compressed, capacity, out ) && out.size() == expected.size();
+    if( !CHECK( decoded == valid ) || !CHECK( !valid || out == reference ) ) std::fprintf( stderr, "  whole, %s, %zu bytes into %zu\n", what, expected.size(), capacity );
+  }
+  // Too small a buffer must not be mistaken for success, but what fits must still be right
+  if( valid && !expected.empty() )
+  {
+    CHECK( !decodeWhole( compressed, expected.size() - 1, out ) );
+    CHECK( out.size() <= expected.size() - 1 && reference.compare( 0, out.size(), out ) == 0 );
+  }
+
+  const std::size_t chunks[][ 2 ] = { { 1, 1 }, { 7, 13 }, { 4096, 70000 }, { 1 << 20, 1 << 20 } };
+  for( const auto& chunk : chunks )
+  {
+    // Byte by byte is slow; a few kilobytes show the same
+    if( chunk[ 0 ] == 1 && expected.size() > 20000 ) continue;
+    const bool decoded = decodeStreaming( compressed, chunk[ 0 ], chunk[ 1 ], expected.size(), out ) && out.size() == expected.size();
+    if( !CHECK( decoded == valid ) || !CHECK( !valid || out == reference ) )
+    {
+      std::fprintf( stderr, "  streaming, %s, %zu bytes in chunks of %zu in, %zu out\n", what, expected.size(), chunk[ 0 ], chunk[ 1 ] );
+    }
+  }
+}
+
+static std::string makeSource( std::mt19937& random, int kind, std::size_t size )
+{
+  std::string data( size, '\0' );
+  for( std::size_t i = 0; i < size; ++i )
+  {
+    switch( kind )
+    {
+    case 0: data[ i ] = char( random() ); break;
+    case 1: data[ i ] = 'a'; break;
+    case 2: data[ i ] = char( ( i / 7 ) % 251 ); break;
+    // Matches reaching back the full 32 KB window
+    case 3: data[ i ] = i >= 32768 ? data[ i - 32768 + random() % 3 ] : char( random() % 16 ); break;
+    }
+  }
+  return kind < 4 ? data : makeTestData( random, size );
+}
+
+int main( int argc, char** argv )
+{
+  const long fuzzCases = argc > 1 ? std::atol( argv[ 1 ] ) : 2000;
+  std::mt19937 random( 12345 );
+
+  std::vector< std::string > sources;
+  for( int kind = 0; kind < 5; ++kind )
+  {
+    for( std::size_t size : { 0, 1, 3, 100, 1000, 40000, 200000 } ) sources.push_back( makeSource( random, kind, size ) );
+  }
+
+  const char* const strategyNames[] = { "default", "filtered", "huffman only", "rle", "fixed" };
+  const char* const flushNames[] = { "no flush", "partial flush", "sync flush", "full flush", "block flush" };
+  long cases = 0;
+  for( const std::string& source : sources )
+  {
+    for( int strategy = 0; strategy < STRATEGY_COUNT; ++strategy )
+    {
+      for( int flush = 0; flush < FLUSH_COUNT; ++flush )
+      {
+        // Flushing every so often only makes a difference with something to flush
+        for( std::size_t interval : { 0, 1000, 33000 } )
+        {
+          if( ( flush == FLUSH_NONE ) != ( interval == 0 ) || ( interval != 0 && interval >= source.size() ) ) continue;
+          for( int level : { 0, 1, 6, 9 } )
+          {
+            const std::string compressed = deflateZlib( source, level, DeflateStrategy( strategy ), DeflateFlush( flush ), interval );
+            char what[ 128 ];
+            std::snprintf( what, sizeof( what ), "level %d, %s, %s every %zu", level, strategyNames[ strategy ], flushNames[ flush ], interval );
+            if( !CHECK( !compressed.empty() ) ) continue;
+            compare( compressed, source, what );
+            ++cases;
+          }
+        }
+      }
+    }
+  }
+  std::printf( "%ld valid streams\n", cases );
+
+  // Corrupt valid streams in different ways: zlib's verdict is the reference
+  for( long i = 0; i < fuzzCases; ++i )
+  {
+    const std::string& source = sources[ random() % sources.size() ];
+    const std::string compressed = deflateZlib( source, random() % 10, DeflateStrategy( random() % STRATEGY_COUNT ), DeflateFlush( random() % FLUSH_COUNT ), 1 + random() % 50000 );
+    std::string corrupt = compressed;
+    switch( random() % 4 )
+    {
+    case 0:
+      for( unsigned int flips = 1 + random() % 8; flips > 0; --flips ) corrupt[ random() % corrupt.size() ] ^= char( 1 << random() % 8 );
+      break;
+    case 1:
+      corrupt.resize( random() % corrupt.size() );
+      break;
+    case 2:
+      for( std::size_t j = 2; j < corrupt.size(); ++j ) corrupt[ j ] = char( random() );
+      break;
+    default:
+      if( corrupt.size() > 2 ) corrupt[ 2 + random() % ( corrupt.size() - 2 ) ] = char( random() );
+      break;
+    }
+    compare( corrupt, source, "corrupted" );
+  }
+  std::printf( "%ld corrupted streams\n", fuzzCases );
+  return checkResult();
+}